@@ -0,0 +1,431 @@
+// Replays a camera path over a model with vsync off and reports frame time
+// percentiles, CPU vs GPU time and draw statistics as JSON. Runs headless
+// through EGL by default so it works on llvmpipe in CI.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <glad/gl.h>
+
+#include <GLFW/glfw3.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "alloc_stats.h"
+#include "camera_path.h"
+#include "frame_capture.h"
+#include "headless.h"
+#include "json.hpp"
+#include "loader.h"
+#include "parallel.h"
+#include "renderer.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Frames the CPU may run ahead of the GPU before waiting on a fence.
+const int kFramesInFlight = 2;
+static_assert(kFramesInFlight < kFrameArenaSlots, "frame arena data must outlive the frames in flight");
+// Changes smaller than this are timer noise, whatever their relative size.
+const double kMinRegressionMs = 0.05;
+
+struct BenchOptions {
+  std::string modelPath = "resources/MaterialsVariantsShoe.glb";
+  std::string pathFile;
+  std::string outputPath;
+  std::string baselinePath;
+  std::string capturePath;
+  int frames = 600;
+  int warmup = 30;
+  int width = 1280;
+  int height = 720;
+  double threshold = 0.05;
+  bool window = false;
+  JobOptions jobOptions;
+};
+
+struct FrameSample {
+  double frameMs = 0.0;
+  double cpuMs = 0.0;
+  double gpuMs = 0.0;
+  double allocations = 0.0;
+  double nodesTested = 0.0;
+  double nodesVisible = 0.0;
+};
+
+static void printUsage(const char* program)
+{
+  std::printf(
+    "Usage: %s [options] [model.gltf|model.glb]\n"
+    "  --path FILE         camera path JSON (default: one orbit of the start view)\n"
+    "  --frames N          measured frames (default 600)\n"
+    "  --warmup N          frames rendered before measuring (default 30)\n"
+    "  --size WxH          framebuffer size (default 1280x720)\n"
+    "  --window            render into a GLFW window with vsync off instead of EGL\n"
+    "  --output FILE       also write the JSON report to FILE\n"
+    "  --baseline FILE     compare with an earlier report, exit 2 on regression, 3 if it is unreadable\n"
+    "  --capture FILE      capture every measured frame as FILE.y4m or a printf pattern of PNGs\n"
+    "  --threshold F       allowed relative slowdown against the baseline (default 0.05)\n"
+    "  --threads N         worker threads for loading, the main thread included (default: one per core)\n",
+    program);
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--path") == 0 && hasValue) options.pathFile = argv[++i];
+    else if (std::strcmp(arg, "--frames") == 0 && hasValue) options.frames = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--warmup") == 0 && hasValue) options.warmup = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--output") == 0 && hasValue) options.outputPath = argv[++i];
+    else if (std::strcmp(arg, "--baseline") == 0 && hasValue) options.baselinePath = argv[++i];
+    else if (std::strcmp(arg, "--capture") == 0 && hasValue) options.capturePath = argv[++i];
+    else if (std::strcmp(arg, "--threshold") == 0 && hasValue) options.threshold = std::atof(argv[++i]);
+    else if (std::strcmp(arg, "--threads") == 0 && hasValue) options.jobOptions.threads = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--window") == 0) options.window = true;
+    else if (std::strcmp(arg, "--size") == 0 && hasValue)
+    {
+      if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) return false;
+    }
+    else if (arg[0] == '-') return false;
+    else options.modelPath = arg;
+  }
+  return options.frames > 0 && options.warmup >= 0;
+}
+
+static double peakRssMb()
+{
+  rusage usage {};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+static nlohmann::json summarize(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+  auto percentile = [&](double p) {
+    const size_t rank = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+  };
+  double sum = 0.0;
+  for (double v : values) sum += v;
+  return {
+    {"mean", sum / values.size()},
+    {"p50", percentile(50.0)},
+    {"p95", percentile(95.0)},
+    {"p99", percentile(99.0)},
+    {"min", values.front()},
+    {"max", values.back()},
+  };
+}
+
+enum class BaselineResult { Ok, Regression, Invalid };
+
+// Compares the tracked metrics with a baseline report. Invalid when the
+// baseline cannot be read or holds a metric that is not a number, so a
+// broken baseline is not reported as a regression.
+static BaselineResult compareWithBaseline(const nlohmann::json& report, const std::string& baselinePath, double threshold)
+{
+  std::ifstream in(baselinePath);
+  const nlohmann::json baseline = nlohmann::json::parse(in, nullptr, false);
+  if (!in || baseline.is_discarded() || !baseline.is_object())
+  {
+    std::printf("Unable to read baseline %s\n", baselinePath.c_str());
+    return BaselineResult::Invalid;
+  }
+
+  const char* metrics[][2] = {
+    {"frame_ms", "mean"}, {"frame_ms", "p50"}, {"frame_ms", "p95"}, {"frame_ms", "p99"},
+    {"cpu_ms", "mean"}, {"gpu_ms", "mean"},
+  };
+  BaselineResult result = BaselineResult::Ok;
+  for (const auto& metric : metrics)
+  {
+    if (!baseline.contains(metric[0]) || !baseline[metric[0]].contains(metric[1])) continue;
+    if (!report.contains(metric[0]) || !report[metric[0]].contains(metric[1])) continue;
+    const nlohmann::json& value = baseline[metric[0]][metric[1]];
+    if (!value.is_number())
+    {
+      std::printf("Baseline %s has a %s %s that is not a number\n", baselinePath.c_str(), metric[0], metric[1]);
+      return BaselineResult::Invalid;
+    }
+    const double before = value.get<double>();
+    const double now = report[metric[0]][metric[1]].get<double>();
+    const double change = before > 0.0 ? (now - before) / before : 0.0;
+    const bool regressed = change > threshold && now - before > kMinRegressionMs;
+    if (regressed) result = BaselineResult::Regression;
+    std::fprintf(stderr, "%-8s %-4s %9.3f -> %9.3f ms (%+6.1f%%)%s\n", metric[0], metric[1], before, now, change * 100.0, regressed ? "  REGRESSION" : "");
+  }
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  BenchOptions options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+  configureJobs(options.jobOptions);
+
+  HeadlessContext ctx;
+  GLFWwindow* window = nullptr;
+  GLADloadfunc getProcAddress = nullptr;
+  if (options.window)
+  {
+    if (!glfwInit()) return -1;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    window = glfwCreateWindow(options.width, options.height, "Model Viewer Bench", nullptr, nullptr);
+    if (!window)
+    {
+      std::printf("Failed to create GLFW window\n");
+      glfwTerminate();
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    getProcAddress = glfwGetProcAddress;
+  }
+  else
+  {
+    if (!createHeadlessContext(ctx)) return -1;
+    getProcAddress = eglGetProcAddress;
+  }
+
+  if (!gladLoadGL(getProcAddress))
+  {
+    std::printf("Failed to initialize OpenGL context\n");
+    return -1;
+  }
+  // Synchronous debug output would serialize the driver and skew timings.
+  glDebugMessageCallback(message_callback, nullptr);
+  glEnable(GL_DEBUG_OUTPUT);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+
+  Framebuffer fb;
+  if (window)
+  {
+    glfwSwapInterval(0);
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    glViewport(0, 0, width, height);
+  }
+  else if (!createFramebuffer(fb, options.width, options.height))
+  {
+    return -1;
+  }
+
+  // Load in stages: parse, CPU-side compile on the job system, then the GL
+  // upload, which is all the context thread has to do.
+  auto msSince = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+  const auto loadStart = Clock::now();
+  tinygltf::Model gltfmodel;
+  if (!loadModel(gltfmodel, options.modelPath))
+  {
+    return -1;
+  }
+  const double parseMs = msSince(loadStart);
+  const auto prepareStart = Clock::now();
+  PreparedScene prepared;
+  if (!prepareRuntimeScene(prepared, gltfmodel))
+  {
+    return -1;
+  }
+  const double prepareMs = msSince(prepareStart);
+  const auto uploadStart = Clock::now();
+  RuntimeScene scene;
+  Renderer renderer;
+  uploadRuntimeScene(scene, prepared, gltfmodel);
+  gltfmodel = tinygltf::Model{};
+  if (!createRenderer(renderer))
+  {
+    return -1;
+  }
+  glFinish();
+  const double uploadMs = msSince(uploadStart);
+  const double loadMs = msSince(loadStart);
+
+  CameraPath path;
+  if (options.pathFile.empty())
+  {
+    path = makeOrbitPath(makeDefaultCamera(), glm::vec3 {0.5f, 0.5f, 0.0f}, 10.0, 16);
+  }
+  else if (!loadCameraPath(path, options.pathFile))
+  {
+    return -1;
+  }
+  const double duration = cameraPathDuration(path);
+
+  glm::mat4 proj = glm::perspectiveRH(45.0f, options.width / (float)options.height, 1.0f, 100.0f);
+
+  GLuint queries[kFramesInFlight][2];
+  glCreateQueries(GL_TIMESTAMP, 2 * kFramesInFlight, &queries[0][0]);
+  GLsync fences[kFramesInFlight] = {};
+  int fenceFrame[kFramesInFlight] = {};
+
+  const int totalFrames = options.warmup + options.frames;
+  std::vector<FrameSample> samples(totalFrames);
+  DrawStats stats;
+
+  // Waits for a frame's fence and collects its GPU time.
+  auto retire = [&](int slot) {
+    if (!fences[slot]) return;
+    glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fences[slot]);
+    fences[slot] = nullptr;
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+    samples[fenceFrame[slot]].gpuMs = (end - begin) / 1.0e6;
+  };
+
+  // Animations follow the camera path clock, so runs stay comparable.
+  std::vector<AnimationInstance> animations;
+  if (!scene.animations.empty()) startAnimation(animations, scene.animations, 0);
+  double lastTime = 0.0;
+  FrameArena frameArena;
+  createFrameArena(frameArena, kFrameArenaBytes);
+  VisibilityCache visibility;
+  FrameCapture capture;
+  const bool capturing = !options.capturePath.empty();
+  int captureWidth = options.width, captureHeight = options.height;
+  if (window) glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+  if (capturing && !createFrameCapture(capture, options.capturePath, captureWidth, captureHeight, 60))
+  {
+    return -1;
+  }
+
+  auto lastFrameEnd = Clock::now();
+  for (int frame = 0; frame < totalFrames; ++frame)
+  {
+    const int slot = frame % kFramesInFlight;
+    retire(slot);
+
+    // Warmup frames hold the first keyframe; measured frames cover the path evenly.
+    const int measured = std::max(0, frame - options.warmup);
+    const double time = options.frames > 1 ? duration * measured / (options.frames - 1) : 0.0;
+    const Camera camera = sampleCameraPath(path, time);
+    const glm::mat4 view = getViewMatrix(camera);
+
+    const AllocationStats allocationsBefore = allocationStats();
+    const auto cpuStart = Clock::now();
+    beginArenaFrame(frameArena, frame);
+    animateScene(animations, scene.animations, scene.graph, time - lastTime);
+    lastTime = time;
+    updateVisibility(visibility, scene, view, proj);
+    samples[frame].nodesTested = visibility.stats.tested;
+    samples[frame].nodesVisible = visibility.stats.visible;
+    DrawStats frameStats;
+    glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    drawFrame(renderer, proj * view, scene, visibility, frameArena, &frameStats);
+    glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+    const auto cpuEnd = Clock::now();
+    samples[frame].allocations = static_cast<double>(allocationsSince(allocationsBefore).count);
+    // Outside the CPU timing, but inside the frame time, which is where
+    // capture hitches would show.
+    if (capturing && frame >= options.warmup) captureFrame(capture, window ? 0 : fb.fbo, frame - options.warmup);
+
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fenceFrame[slot] = frame;
+    if (window)
+    {
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    else
+    {
+      glFlush();
+    }
+
+    const auto frameEnd = Clock::now();
+    samples[frame].cpuMs = std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+    samples[frame].frameMs = std::chrono::duration<double, std::milli>(frameEnd - lastFrameEnd).count();
+    lastFrameEnd = frameEnd;
+    if (frame == options.warmup) stats = frameStats;
+  }
+  for (int slot = 0; slot < kFramesInFlight; ++slot) retire(slot);
+  const auto captureFlushStart = Clock::now();
+  const bool captured = !capturing || destroyFrameCapture(capture);
+  const double captureFlushMs = msSince(captureFlushStart);
+
+  std::vector<double> frameMs, cpuMs, gpuMs, allocations, nodesTested, nodesVisible;
+  for (int frame = options.warmup; frame < totalFrames; ++frame)
+  {
+    frameMs.push_back(samples[frame].frameMs);
+    cpuMs.push_back(samples[frame].cpuMs);
+    gpuMs.push_back(samples[frame].gpuMs);
+    allocations.push_back(samples[frame].allocations);
+    nodesTested.push_back(samples[frame].nodesTested);
+    nodesVisible.push_back(samples[frame].nodesVisible);
+  }
+
+  nlohmann::json report = {
+    {"model", options.modelPath},
+    {"backend", window ? "glfw" : "egl"},
+    {"renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER))},
+    {"size", {options.width, options.height}},
+    {"frames", options.frames},
+    {"warmup", options.warmup},
+    {"load_ms", loadMs},
+    {"load", {{"threads", workerCount()}, {"parse_ms", parseMs}, {"prepare_ms", prepareMs}, {"upload_ms", uploadMs}}},
+    {"peak_rss_mb", peakRssMb()},
+    {"frame_ms", summarize(frameMs)},
+    {"cpu_ms", summarize(cpuMs)},
+    {"gpu_ms", summarize(gpuMs)},
+    {"allocations_per_frame", summarize(allocations)},
+    {"frame_arena_bytes", frameArena.highWater},
+    {"visibility", {{"nodes_tested", summarize(nodesTested)}, {"nodes_visible", summarize(nodesVisible)}}},
+    {"draw", {{"draw_calls", stats.drawCalls}, {"triangles", stats.triangles}}},
+  };
+  if (capturing)
+  {
+    report["capture"] = {{"path", options.capturePath}, {"frames", capture.written.load()}, {"stalls", capture.stalls},
+                         {"flush_ms", captureFlushMs}};
+  }
+
+  const std::string text = report.dump(2);
+  std::printf("%s\n", text.c_str());
+  if (!options.outputPath.empty())
+  {
+    std::ofstream out(options.outputPath);
+    out << text << "\n";
+  }
+
+  int result = captured ? 0 : -1;
+  if (!options.baselinePath.empty())
+  {
+    switch (compareWithBaseline(report, options.baselinePath, options.threshold))
+    {
+      case BaselineResult::Ok: break;
+      case BaselineResult::Regression: result = 2; break;
+      case BaselineResult::Invalid: result = 3; break;
+    }
+  }
+
+  glDeleteQueries(2 * kFramesInFlight, &queries[0][0]);
+  destroyRenderer(renderer);
+  destroyRuntimeScene(scene);
+  if (window)
+  {
+    glfwTerminate();
+  }
+  else
+  {
+    destroyFramebuffer(fb);
+    destroyHeadlessContext(ctx);
+  }
+  return result;
+}
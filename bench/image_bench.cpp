@@ -0,0 +1,279 @@
+// Compares image writers on a large frame: stbi_write_png against the
+// chunked parallel PNG encoder at several zlib levels, and QOI. Every output
+// is decoded again and checked against the source pixels. Reports median
+// encode times, sizes and throughput as JSON.
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "image_encode.h"
+#include "json.hpp"
+#include "parallel.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct ImageBenchOptions {
+  std::string inputPath;
+  std::string outputPath;
+  int width = 3840;
+  int height = 2160;
+  int repeat = 5;
+  std::vector<int> levels { 1, 3, 6 };
+  JobOptions jobOptions;
+};
+
+static void printUsage(const char* program)
+{
+  std::printf(
+    "Usage: %s [options]\n"
+    "  --input FILE        image to encode, e.g. a headless capture (default: a synthetic frame)\n"
+    "  --size WxH          synthetic frame size (default 3840x2160)\n"
+    "  --levels L,L,...    PNG compression levels to measure (default 1,3,6)\n"
+    "  --repeat N          encodes per measurement, the median is reported (default 5)\n"
+    "  --threads N         worker threads, the main thread included (default: one per core)\n"
+    "  --output FILE       also write the JSON report to FILE\n",
+    program);
+}
+
+static bool parseArgs(int argc, char** argv, ImageBenchOptions& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--input") == 0 && hasValue) options.inputPath = argv[++i];
+    else if (std::strcmp(arg, "--repeat") == 0 && hasValue) options.repeat = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--threads") == 0 && hasValue) options.jobOptions.threads = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(arg, "--output") == 0 && hasValue) options.outputPath = argv[++i];
+    else if (std::strcmp(arg, "--size") == 0 && hasValue)
+    {
+      if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) return false;
+    }
+    else if (std::strcmp(arg, "--levels") == 0 && hasValue)
+    {
+      options.levels.clear();
+      for (const char* p = argv[++i]; *p; ++p)
+      {
+        options.levels.push_back(std::atoi(p));
+        while (p[1] && *p != ',') ++p;
+      }
+    }
+    else return false;
+  }
+  return options.repeat > 0 && options.width > 0 && options.height > 0;
+}
+
+// Something like a render: a vertical gradient, shaded discs and a little
+// dithering noise, so neither encoder sees trivially flat data.
+static std::vector<unsigned char> makeFrame(int width, int height)
+{
+  std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 4);
+  uint32_t noise = 12345;
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      float r = 40.0f + 60.0f * y / height, g = 50.0f + 70.0f * y / height, b = 70.0f + 90.0f * y / height;
+      for (int disc = 0; disc < 5; ++disc)
+      {
+        const float cx = width * (0.15f + 0.175f * disc), cy = height * (0.35f + 0.1f * (disc % 3));
+        const float radius = height * 0.18f;
+        const float dx = (x - cx) / radius, dy = (y - cy) / radius;
+        const float d2 = dx * dx + dy * dy;
+        if (d2 < 1.0f)
+        {
+          const float shade = std::sqrt(1.0f - d2) * (0.6f - 0.3f * dx - 0.3f * dy);
+          r = 255.0f * shade * (disc & 1 ? 0.9f : 0.3f);
+          g = 255.0f * shade * (disc & 2 ? 0.8f : 0.4f);
+          b = 255.0f * shade * 0.5f;
+        }
+      }
+      noise = noise * 1664525u + 1013904223u;
+      const float dither = static_cast<float>(noise >> 30) - 1.5f;
+      unsigned char* p = pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+      p[0] = static_cast<unsigned char>(std::clamp(r + dither, 0.0f, 255.0f));
+      p[1] = static_cast<unsigned char>(std::clamp(g + dither, 0.0f, 255.0f));
+      p[2] = static_cast<unsigned char>(std::clamp(b + dither, 0.0f, 255.0f));
+      p[3] = 255;
+    }
+  }
+  return pixels;
+}
+
+// Reference decoder, only used to check the encoder's output.
+static bool decodeQoi(const std::vector<unsigned char>& bytes, std::vector<unsigned char>& pixels, int& width, int& height)
+{
+  if (bytes.size() < 22 || std::memcmp(bytes.data(), "qoif", 4) != 0) return false;
+  auto be32 = [&](size_t at) {
+    return static_cast<uint32_t>(bytes[at]) << 24 | bytes[at + 1] << 16 | bytes[at + 2] << 8 | bytes[at + 3];
+  };
+  width = static_cast<int>(be32(4));
+  height = static_cast<int>(be32(8));
+  pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+  unsigned char seen[64][4] = {};
+  unsigned char px[4] = { 0, 0, 0, 255 };
+  size_t at = 14;
+  int run = 0;
+  for (size_t i = 0; i < pixels.size(); i += 4)
+  {
+    if (run > 0)
+    {
+      --run;
+    }
+    else if (at < bytes.size() - 8)
+    {
+      const int op = bytes[at++];
+      if (op == 0xfe)
+      {
+        px[0] = bytes[at++]; px[1] = bytes[at++]; px[2] = bytes[at++];
+      }
+      else if (op == 0xff)
+      {
+        px[0] = bytes[at++]; px[1] = bytes[at++]; px[2] = bytes[at++]; px[3] = bytes[at++];
+      }
+      else if ((op & 0xc0) == 0x00)
+      {
+        std::memcpy(px, seen[op], 4);
+      }
+      else if ((op & 0xc0) == 0x40)
+      {
+        px[0] += ((op >> 4) & 3) - 2; px[1] += ((op >> 2) & 3) - 2; px[2] += (op & 3) - 2;
+      }
+      else if ((op & 0xc0) == 0x80)
+      {
+        const int next = bytes[at++];
+        const int dg = (op & 0x3f) - 32;
+        px[0] += dg - 8 + ((next >> 4) & 0x0f); px[1] += dg; px[2] += dg - 8 + (next & 0x0f);
+      }
+      else
+      {
+        run = op & 0x3f;
+      }
+      std::memcpy(seen[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+    }
+    std::memcpy(&pixels[i], px, 4);
+  }
+  return true;
+}
+
+// Median milliseconds over options.repeat runs of fn.
+template <typename Fn>
+static double measure(const ImageBenchOptions& options, Fn&& fn)
+{
+  std::vector<double> samples;
+  for (int r = 0; r < options.repeat; ++r)
+  {
+    const auto start = Clock::now();
+    fn();
+    samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+  ImageBenchOptions options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+  configureJobs(options.jobOptions);
+
+  std::vector<unsigned char> pixels;
+  int width = options.width, height = options.height;
+  if (options.inputPath.empty())
+  {
+    pixels = makeFrame(width, height);
+  }
+  else
+  {
+    int comp = 0;
+    unsigned char* loaded = stbi_load(options.inputPath.c_str(), &width, &height, &comp, 4);
+    if (!loaded)
+    {
+      std::printf("Unable to read %s\n", options.inputPath.c_str());
+      return -1;
+    }
+    pixels.assign(loaded, loaded + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(loaded);
+  }
+  const int stride = width * 4;
+  const double megabytes = pixels.size() / (1024.0 * 1024.0);
+
+  bool verified = true;
+  auto verifyPng = [&](const std::vector<unsigned char>& bytes) {
+    int w = 0, h = 0, comp = 0;
+    unsigned char* decoded = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &w, &h, &comp, 4);
+    const bool same = decoded && w == width && h == height && std::memcmp(decoded, pixels.data(), pixels.size()) == 0;
+    stbi_image_free(decoded);
+    verified = verified && same;
+    return same;
+  };
+  auto result = [&](double ms, size_t bytes, bool same) {
+    return nlohmann::json {
+      {"ms", ms}, {"bytes", bytes}, {"mb_per_s", megabytes / (ms / 1000.0)}, {"roundtrip", same},
+    };
+  };
+
+  nlohmann::json report;
+  report["input"] = options.inputPath.empty() ? "synthetic" : options.inputPath;
+  report["size"] = {width, height};
+  report["threads"] = workerCount();
+
+  std::vector<unsigned char> stbBytes;
+  const double stbMs = measure(options, [&] {
+    int length = 0;
+    unsigned char* png = stbi_write_png_to_mem(pixels.data(), stride, width, height, 4, &length);
+    stbBytes.assign(png, png + length);
+    STBIW_FREE(png);
+  });
+  report["stb_png"] = result(stbMs, stbBytes.size(), verifyPng(stbBytes));
+  report["stb_png"]["level"] = stbi_write_png_compression_level;
+
+  std::vector<unsigned char> bytes;
+  for (int level : options.levels)
+  {
+    const double ms = measure(options, [&] { encodePng(bytes, pixels.data(), width, height, 4, stride, level); });
+    nlohmann::json entry = result(ms, bytes.size(), verifyPng(bytes));
+    entry["level"] = level;
+    entry["speedup_vs_stb"] = stbMs / ms;
+    report["png"].push_back(entry);
+  }
+
+  const double qoiMs = measure(options, [&] { encodeQoi(bytes, pixels.data(), width, height, 4, stride); });
+  std::vector<unsigned char> decoded;
+  int qoiWidth = 0, qoiHeight = 0;
+  const bool qoiSame = decodeQoi(bytes, decoded, qoiWidth, qoiHeight) && qoiWidth == width && qoiHeight == height &&
+                       decoded == pixels;
+  verified = verified && qoiSame;
+  report["qoi"] = result(qoiMs, bytes.size(), qoiSame);
+  report["qoi"]["speedup_vs_stb"] = stbMs / qoiMs;
+
+  const std::string text = report.dump(2);
+  std::printf("%s\n", text.c_str());
+  if (!options.outputPath.empty())
+  {
+    std::ofstream out(options.outputPath);
+    out << text << "\n";
+    if (!out)
+    {
+      std::printf("Unable to write %s\n", options.outputPath.c_str());
+      return -1;
+    }
+  }
+  return verified ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Measures the scheduling overhead of the job system: empty jobs submitted
+// one by one, parallelFor over trivial bodies against a serial loop, chains
+// of dependent job batches and nested parallelFor. Reports the median cost
+// per job or index in nanoseconds as JSON.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "parallel.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct JobBenchOptions {
+  std::string outputPath;
+  size_t jobs = 100000;
+  int repeat = 9;
+  JobOptions jobOptions;
+};
+
+static void printUsage(const char* program)
+{
+  std::printf(
+    "Usage: %s [options]\n"
+    "  --jobs N            jobs or indices per measurement (default 100000)\n"
+    "  --repeat N          measurements per test, the median is reported (default 9)\n"
+    "  --threads N         worker threads, the main thread included (default: one per core)\n"
+    "  --pin-threads       pin each worker thread to its own core\n"
+    "  --output FILE       also write the JSON report to FILE\n",
+    program);
+}
+
+static bool parseArgs(int argc, char** argv, JobBenchOptions& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--jobs") == 0 && hasValue) options.jobs = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(arg, "--repeat") == 0 && hasValue) options.repeat = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--threads") == 0 && hasValue) options.jobOptions.threads = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(arg, "--pin-threads") == 0) options.jobOptions.pinThreads = true;
+    else if (std::strcmp(arg, "--output") == 0 && hasValue) options.outputPath = argv[++i];
+    else return false;
+  }
+  return options.jobs > 0 && options.repeat > 0;
+}
+
+// Median nanoseconds per unit of work over options.repeat runs of fn.
+template <typename Fn>
+static double measure(const JobBenchOptions& options, size_t units, Fn&& fn)
+{
+  std::vector<double> samples;
+  for (int r = 0; r < options.repeat; ++r)
+  {
+    const auto start = Clock::now();
+    fn();
+    samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / units);
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+  JobBenchOptions options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+  configureJobs(options.jobOptions);
+
+  const size_t n = options.jobs;
+  // Written by the benchmark bodies so the compiler keeps them.
+  std::vector<uint32_t> sink(n, 0);
+  nlohmann::json report;
+  report["threads"] = workerCount();
+  report["jobs"] = n;
+
+  report["submit_ns_per_job"] = measure(options, n, [&] {
+    JobCounter counter;
+    for (size_t i = 0; i < n; ++i)
+    {
+      submitJob([&sink, i] { sink[i] += 1; }, &counter);
+    }
+    waitForCounter(counter);
+  });
+
+  report["serial_ns_per_index"] = measure(options, n, [&] {
+    for (size_t i = 0; i < n; ++i) sink[i] += 1;
+  });
+  report["parallel_for_ns_per_index"] = measure(options, n, [&] {
+    parallelFor(n, [&](size_t i) { sink[i] += 1; });
+  });
+
+  // Batches of jobs where each batch waits on the one before.
+  const size_t batches = 64;
+  const size_t perBatch = std::max<size_t>(1, n / batches);
+  report["chain_ns_per_job"] = measure(options, batches * perBatch, [&] {
+    std::vector<JobCounter> counters(batches);
+    for (size_t b = 0; b < batches; ++b)
+    {
+      for (size_t j = 0; j < perBatch; ++j)
+      {
+        const size_t index = b * perBatch + j;
+        if (b == 0) submitJob([&sink, index] { sink[index] += 1; }, &counters[b]);
+        else submitJobAfter(counters[b - 1], [&sink, index] { sink[index] += 1; }, &counters[b]);
+      }
+    }
+    waitForCounter(counters.back());
+  });
+
+  const size_t outer = 64;
+  const size_t inner = std::max<size_t>(1, n / outer);
+  report["nested_ns_per_index"] = measure(options, outer * inner, [&] {
+    parallelFor(outer, [&](size_t o) {
+      parallelFor(inner, [&](size_t i) { sink[o * inner + i] += 1; });
+    });
+  });
+
+  const std::string text = report.dump(2);
+  std::printf("%s\n", text.c_str());
+  if (!options.outputPath.empty())
+  {
+    std::ofstream out(options.outputPath);
+    out << text << "\n";
+    if (!out)
+    {
+      std::printf("Unable to write %s\n", options.outputPath.c_str());
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,524 @@
+// Times tinygltf loading phase by phase: file reads, URI resolution and image
+// decode are measured through hooked callbacks during a full load, then JSON
+// parsing, every Parse* pass and base64 decoding are re-run in isolation on
+// the in-memory document. Runs with a warm and a cold page cache and reports
+// medians and throughput.
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct LoaderBenchOptions {
+  std::vector<std::string> modelPaths;
+  std::string outputPath;
+  int repeat = 10;
+  bool cold = true;
+};
+
+// Time spent inside the hooked tinygltf callbacks during one load.
+struct HookTimes {
+  double readMs = 0.0;
+  double resolveMs = 0.0;
+  double imageMs = 0.0;
+  size_t readBytes = 0;
+  size_t imageBytes = 0;
+};
+
+static HookTimes hookTimes;
+
+// One named phase, sampled once per repetition.
+struct Phase {
+  std::string name;
+  size_t bytes = 0;
+  size_t objects = 0;
+  std::vector<double> samples;
+};
+
+static double elapsedMs(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool timedFileExists(const std::string& path, void* userData)
+{
+  const auto start = Clock::now();
+  const bool exists = tinygltf::FileExists(path, userData);
+  hookTimes.resolveMs += elapsedMs(start);
+  return exists;
+}
+
+static std::string timedExpandFilePath(const std::string& path, void* userData)
+{
+  const auto start = Clock::now();
+  std::string expanded = tinygltf::ExpandFilePath(path, userData);
+  hookTimes.resolveMs += elapsedMs(start);
+  return expanded;
+}
+
+static bool timedGetFileSize(size_t* size, std::string* err, const std::string& path, void* userData)
+{
+  const auto start = Clock::now();
+  const bool ok = tinygltf::GetFileSizeInBytes(size, err, path, userData);
+  hookTimes.resolveMs += elapsedMs(start);
+  return ok;
+}
+
+static bool timedReadWholeFile(std::vector<unsigned char>* out, std::string* err, const std::string& path, void* userData)
+{
+  const auto start = Clock::now();
+  const bool ok = tinygltf::ReadWholeFile(out, err, path, userData);
+  hookTimes.readMs += elapsedMs(start);
+  hookTimes.readBytes += ok ? out->size() : 0;
+  return ok;
+}
+
+static bool timedLoadImageData(tinygltf::Image* image, const int index, std::string* err, std::string* warn,
+                               int reqWidth, int reqHeight, const unsigned char* bytes, int size, void*)
+{
+  // Same option the loader passes to its built-in decoder.
+  tinygltf::LoadImageDataOption option;
+  const auto start = Clock::now();
+  const bool ok = tinygltf::LoadImageData(image, index, err, warn, reqWidth, reqHeight, bytes, size, &option);
+  hookTimes.imageMs += elapsedMs(start);
+  hookTimes.imageBytes += size;
+  return ok;
+}
+
+static void printUsage(const char* program)
+{
+  std::printf(
+    "Usage: %s [options] [model.gltf|model.glb ...]\n"
+    "  --repeat N          loads per model and cache state (default 10)\n"
+    "  --warm-only         skip the cold page cache runs\n"
+    "  --output FILE       also write the JSON report to FILE\n"
+    "Models default to the files in resources/.\n",
+    program);
+}
+
+static bool parseArgs(int argc, char** argv, LoaderBenchOptions& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--repeat") == 0 && hasValue) options.repeat = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--warm-only") == 0) options.cold = false;
+    else if (std::strcmp(arg, "--output") == 0 && hasValue) options.outputPath = argv[++i];
+    else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) return false;
+    else if (arg[0] == '-')
+    {
+      std::printf("Unknown option %s\n", arg);
+      return false;
+    }
+    else options.modelPaths.push_back(arg);
+  }
+  if (options.modelPaths.empty())
+  {
+    options.modelPaths = { "resources/triangle.gltf", "resources/MaterialsVariantsShoe.glb" };
+  }
+  if (options.repeat < 1)
+  {
+    std::printf("--repeat must be at least 1\n");
+    return false;
+  }
+  return true;
+}
+
+static bool hasGlbExtension(const std::string& path)
+{
+  return path.size() >= 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+}
+
+static bool readFile(const std::string& path, std::vector<unsigned char>& data)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+  {
+    std::printf("Failed to open %s\n", path.c_str());
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Splits a file into its JSON text and, for GLB, the BIN chunk.
+static bool splitModelFile(const std::vector<unsigned char>& file, bool binary, std::string& json,
+                           const unsigned char*& bin, size_t& binSize)
+{
+  bin = nullptr;
+  binSize = 0;
+  if (!binary)
+  {
+    json.assign(file.begin(), file.end());
+    return true;
+  }
+
+  auto readU32 = [&file](size_t offset) {
+    uint32_t value;
+    std::memcpy(&value, file.data() + offset, 4);
+    return value;
+  };
+  if (file.size() < 20 || std::memcmp(file.data(), "glTF", 4) != 0 || readU32(16) != 0x4E4F534A)
+  {
+    std::printf("Invalid GLB header\n");
+    return false;
+  }
+  const size_t jsonSize = readU32(12);
+  if (20 + jsonSize > file.size())
+  {
+    std::printf("GLB JSON chunk is truncated\n");
+    return false;
+  }
+  json.assign(reinterpret_cast<const char*>(file.data()) + 20, jsonSize);
+
+  const size_t binHeader = 20 + jsonSize;
+  if (binHeader + 8 <= file.size())
+  {
+    binSize = std::min<size_t>(readU32(binHeader), file.size() - binHeader - 8);
+    bin = file.data() + binHeader + 8;
+  }
+  return true;
+}
+
+static std::string baseDirectory(const std::string& path)
+{
+  const size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+// The model file plus every buffer and image it references by path.
+static std::vector<std::string> referencedFiles(const std::string& path, const tinygltf::detail::JsonDocument& doc)
+{
+  std::vector<std::string> files = { path };
+  const std::string baseDir = baseDirectory(path);
+  for (const char* key : { "buffers", "images" })
+  {
+    auto it = doc.find(key);
+    if (it == doc.end() || !it->is_array()) continue;
+    for (const auto& o : *it)
+    {
+      auto uri = o.find("uri");
+      if (uri == o.end() || !uri->is_string()) continue;
+      const std::string value = uri->get<std::string>();
+      if (tinygltf::IsDataURI(value)) continue;
+      std::string decoded;
+      tinygltf::URIDecode(value, &decoded, nullptr);
+      files.push_back(baseDir.empty() ? decoded : baseDir + "/" + decoded);
+    }
+  }
+  return files;
+}
+
+// Asks the kernel to drop the files from the page cache. Only clean pages
+// are dropped, which is all a benchmark input should have.
+static void dropPageCache(const std::vector<std::string>& files)
+{
+  for (const std::string& file : files)
+  {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) continue;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+static double median(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+  const size_t mid = values.size() / 2;
+  return values.size() % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+static double megabytesPerSecond(size_t bytes, double ms)
+{
+  return ms > 0.0 ? bytes / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0;
+}
+
+static Phase& phase(std::vector<Phase>& phases, const std::string& name)
+{
+  for (Phase& p : phases)
+  {
+    if (p.name == name) return p;
+  }
+  Phase phase;
+  phase.name = name;
+  phases.push_back(std::move(phase));
+  return phases.back();
+}
+
+// Full LoadASCIIFromFile/LoadBinaryFromFile with the hooked callbacks.
+static bool runEndToEnd(const std::string& path, bool binary, std::vector<Phase>& phases)
+{
+  tinygltf::TinyGLTF loader;
+  tinygltf::FsCallbacks fs = {};
+  fs.FileExists = timedFileExists;
+  fs.ExpandFilePath = timedExpandFilePath;
+  fs.ReadWholeFile = timedReadWholeFile;
+  fs.WriteWholeFile = tinygltf::WriteWholeFile;
+  fs.GetFileSizeInBytes = timedGetFileSize;
+  loader.SetFsCallbacks(fs);
+  loader.SetImageLoader(timedLoadImageData, nullptr);
+
+  tinygltf::Model model;
+  std::string err;
+  std::string warn;
+  hookTimes = HookTimes{};
+  const auto start = Clock::now();
+  const bool ok = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, path)
+                         : loader.LoadASCIIFromFile(&model, &err, &warn, path);
+  const double totalMs = elapsedMs(start);
+  if (!ok)
+  {
+    std::printf("Failed to load %s: %s\n", path.c_str(), err.c_str());
+    return false;
+  }
+
+  const double parseMs = totalMs - hookTimes.readMs - hookTimes.resolveMs - hookTimes.imageMs;
+  Phase& total = phase(phases, "load");
+  total.samples.push_back(totalMs);
+  total.bytes = hookTimes.readBytes;
+  Phase& read = phase(phases, "file read");
+  read.samples.push_back(hookTimes.readMs);
+  read.bytes = hookTimes.readBytes;
+  phase(phases, "uri resolve").samples.push_back(hookTimes.resolveMs);
+  Phase& image = phase(phases, "image decode");
+  image.samples.push_back(hookTimes.imageMs);
+  image.bytes = hookTimes.imageBytes;
+  phase(phases, "parse (rest)").samples.push_back(std::max(parseMs, 0.0));
+  return true;
+}
+
+// Times one Parse* function over every element of a top-level array.
+template <typename T, typename ParseFn>
+static void timeArray(std::vector<Phase>& phases, const tinygltf::detail::JsonDocument& doc, const char* key, ParseFn parse)
+{
+  auto it = doc.find(key);
+  if (it == doc.end() || !it->is_array() || it->empty()) return;
+
+  std::string err;
+  std::vector<T> objects(it->size());
+  const auto start = Clock::now();
+  size_t i = 0;
+  for (const auto& o : *it)
+  {
+    parse(&objects[i++], &err, o);
+  }
+  Phase& p = phase(phases, std::string("Parse ") + key);
+  p.samples.push_back(elapsedMs(start));
+  p.objects = it->size();
+}
+
+// Re-runs the loader's parsing steps one by one on an in-memory file.
+static bool runIsolated(const std::string& path, const std::vector<unsigned char>& file, bool binary,
+                        std::vector<Phase>& phases)
+{
+  using namespace tinygltf;
+
+  std::string json;
+  const unsigned char* bin = nullptr;
+  size_t binSize = 0;
+  if (!splitModelFile(file, binary, json, bin, binSize)) return false;
+
+  detail::JsonDocument doc;
+  auto start = Clock::now();
+  detail::JsonParse(doc, json.data(), json.size(), false);
+  Phase& jsonPhase = phase(phases, "JSON parse");
+  jsonPhase.samples.push_back(elapsedMs(start));
+  jsonPhase.bytes = json.size();
+  if (!doc.is_object())
+  {
+    std::printf("%s does not contain a JSON object\n", path.c_str());
+    return false;
+  }
+
+  // Buffers resolve their URIs and read or decode the data, so they are
+  // timed together with that I/O.
+  FsCallbacks fs = { &tinygltf::FileExists, &tinygltf::ExpandFilePath, &tinygltf::ReadWholeFile,
+                     &tinygltf::WriteWholeFile, &tinygltf::GetFileSizeInBytes, nullptr };
+  URICallbacks uriCallbacks = { nullptr, &tinygltf::URIDecode, nullptr };
+  const std::string baseDir = baseDirectory(path);
+  timeArray<Buffer>(phases, doc, "buffers", [&](Buffer* buffer, std::string* err, const detail::json& o) {
+    return ParseBuffer(buffer, err, o, false, &fs, &uriCallbacks, baseDir, std::numeric_limits<int32_t>::max(),
+                       binary, bin, binSize);
+  });
+  timeArray<BufferView>(phases, doc, "bufferViews", [](BufferView* view, std::string* err, const detail::json& o) {
+    return ParseBufferView(view, err, o, false);
+  });
+  timeArray<Accessor>(phases, doc, "accessors", [](Accessor* accessor, std::string* err, const detail::json& o) {
+    return ParseAccessor(accessor, err, o, false);
+  });
+  Model meshOwner;
+  timeArray<Mesh>(phases, doc, "meshes", [&](Mesh* mesh, std::string* err, const detail::json& o) {
+    return ParseMesh(mesh, &meshOwner, err, o, false);
+  });
+  timeArray<Node>(phases, doc, "nodes", [](Node* node, std::string* err, const detail::json& o) {
+    return ParseNode(node, err, o, false);
+  });
+  timeArray<Material>(phases, doc, "materials", [](Material* material, std::string* err, const detail::json& o) {
+    return ParseMaterial(material, err, o, false);
+  });
+  timeArray<Texture>(phases, doc, "textures", [&](Texture* texture, std::string* err, const detail::json& o) {
+    return ParseTexture(texture, err, o, false, baseDir);
+  });
+  timeArray<Sampler>(phases, doc, "samplers", [](Sampler* sampler, std::string* err, const detail::json& o) {
+    return ParseSampler(sampler, err, o, false);
+  });
+  timeArray<Animation>(phases, doc, "animations", [](Animation* animation, std::string* err, const detail::json& o) {
+    return ParseAnimation(animation, err, o, false);
+  });
+  timeArray<Skin>(phases, doc, "skins", [](Skin* skin, std::string* err, const detail::json& o) {
+    return ParseSkin(skin, err, o, false);
+  });
+
+  // Embedded data URIs, decoded on their own to isolate base64 cost.
+  std::vector<std::string> encoded;
+  for (const char* key : { "buffers", "images" })
+  {
+    auto it = doc.find(key);
+    if (it == doc.end() || !it->is_array()) continue;
+    for (const auto& o : *it)
+    {
+      auto uri = o.find("uri");
+      if (uri == o.end() || !uri->is_string()) continue;
+      const std::string value = uri->get<std::string>();
+      const size_t comma = value.find(',');
+      if (IsDataURI(value) && comma != std::string::npos) encoded.push_back(value.substr(comma + 1));
+    }
+  }
+  if (!encoded.empty())
+  {
+    size_t bytes = 0;
+    start = Clock::now();
+    for (const std::string& data : encoded)
+    {
+      bytes += data.size();
+      std::string decoded = base64_decode(data);
+      (void)decoded;
+    }
+    Phase& base64 = phase(phases, "base64 decode");
+    base64.samples.push_back(elapsedMs(start));
+    base64.bytes = bytes;
+  }
+  return true;
+}
+
+static void printPhases(const char* title, const std::vector<Phase>& phases)
+{
+  std::printf("  %s\n", title);
+  for (const Phase& p : phases)
+  {
+    const double ms = median(p.samples);
+    if (p.objects) std::printf("    %-20s %10.3f ms  %8zu objects\n", p.name.c_str(), ms, p.objects);
+    else if (p.bytes) std::printf("    %-20s %10.3f ms  %8.1f MB/s\n", p.name.c_str(), ms, megabytesPerSecond(p.bytes, ms));
+    else std::printf("    %-20s %10.3f ms\n", p.name.c_str(), ms);
+  }
+}
+
+static nlohmann::json phasesJson(const std::vector<Phase>& phases)
+{
+  nlohmann::json result = nlohmann::json::object();
+  for (const Phase& p : phases)
+  {
+    const double ms = median(p.samples);
+    auto sorted = p.samples;
+    std::sort(sorted.begin(), sorted.end());
+    result[p.name] = {
+      { "median_ms", ms },
+      { "bytes", p.bytes },
+      { "min_ms", sorted.front() },
+      { "max_ms", sorted.back() },
+    };
+    if (p.objects) result[p.name]["objects"] = p.objects;
+    else if (p.bytes) result[p.name]["mb_per_s"] = megabytesPerSecond(p.bytes, ms);
+  }
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  LoaderBenchOptions options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  nlohmann::json report = { { "repeat", options.repeat }, { "models", nlohmann::json::array() } };
+  for (const std::string& path : options.modelPaths)
+  {
+    const bool binary = hasGlbExtension(path);
+    std::vector<unsigned char> file;
+    if (!readFile(path, file)) return 1;
+
+    std::string json;
+    const unsigned char* bin = nullptr;
+    size_t binSize = 0;
+    if (!splitModelFile(file, binary, json, bin, binSize)) return 1;
+    tinygltf::detail::JsonDocument doc;
+    tinygltf::detail::JsonParse(doc, json.data(), json.size(), false);
+    const std::vector<std::string> files = referencedFiles(path, doc);
+
+    std::vector<Phase> warm;
+    std::vector<Phase> cold;
+    std::vector<Phase> isolated;
+    // One untimed load so the warm runs really start from a warm cache.
+    std::vector<Phase> discard;
+    if (!runEndToEnd(path, binary, discard)) return 1;
+    for (int i = 0; i < options.repeat; ++i)
+    {
+      if (!runEndToEnd(path, binary, warm)) return 1;
+      if (options.cold)
+      {
+        dropPageCache(files);
+        if (!runEndToEnd(path, binary, cold)) return 1;
+      }
+      if (!runIsolated(path, file, binary, isolated)) return 1;
+    }
+
+    std::printf("%s (%.2f MB in %zu file%s)\n", path.c_str(), phase(warm, "load").bytes / (1024.0 * 1024.0),
+                files.size(), files.size() == 1 ? "" : "s");
+    printPhases("warm cache", warm);
+    if (options.cold) printPhases("cold cache", cold);
+    printPhases("isolated (warm, in memory)", isolated);
+
+    nlohmann::json entry = {
+      { "model", path },
+      { "files", files.size() },
+      { "bytes", phase(warm, "load").bytes },
+      { "warm", phasesJson(warm) },
+      { "isolated", phasesJson(isolated) },
+    };
+    if (options.cold) entry["cold"] = phasesJson(cold);
+    report["models"].push_back(entry);
+  }
+
+  if (!options.outputPath.empty())
+  {
+    std::ofstream out(options.outputPath);
+    if (!out.is_open())
+    {
+      std::printf("Failed to write %s\n", options.outputPath.c_str());
+      return 1;
+    }
+    out << report.dump(2) << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include "accessor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+float readComponent(const unsigned char* p, int componentType)
+{
+  switch (componentType)
+  {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT: { float f; std::memcpy(&f, p, sizeof(f)); return f; }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return *p / 255.0f;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, sizeof(v)); return v / 65535.0f; }
+    case TINYGLTF_COMPONENT_TYPE_BYTE: { int8_t v; std::memcpy(&v, p, sizeof(v)); return std::max(v / 127.0f, -1.0f); }
+    case TINYGLTF_COMPONENT_TYPE_SHORT: { int16_t v; std::memcpy(&v, p, sizeof(v)); return std::max(v / 32767.0f, -1.0f); }
+    default: return 0.0f;
+  }
+}
+
+// Bytes [offset, offset + size) of a buffer view, or null unless the view
+// exists, lies inside its buffer and holds the whole range.
+static const unsigned char* viewBytes(const tinygltf::Model& model, int viewIndex, size_t offset, size_t size)
+{
+  if (viewIndex < 0 || viewIndex >= (int)model.bufferViews.size()) return nullptr;
+  const tinygltf::BufferView& view = model.bufferViews[viewIndex];
+  if (view.buffer < 0 || view.buffer >= (int)model.buffers.size()) return nullptr;
+  const std::vector<unsigned char>& data = model.buffers[view.buffer].data;
+  if (view.byteLength > data.size() || view.byteOffset > data.size() - view.byteLength) return nullptr;
+  if (size > view.byteLength || offset > view.byteLength - size) return nullptr;
+  return data.data() + view.byteOffset + offset;
+}
+
+bool findAccessorData(const tinygltf::Model& model, int accessorIndex, AccessorData& data)
+{
+  if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+  const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+  if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size()) return false;
+  const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+  const int components = tinygltf::GetNumComponentsInType(accessor.type);
+  const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  const int stride = accessor.ByteStride(view);
+  if (components <= 0 || componentSize <= 0 || stride <= 0) return false;
+
+  // The last element ends elementSize bytes after its start.
+  const size_t elementSize = size_t(components) * componentSize;
+  if (accessor.count > 0 && accessor.count - 1 > (SIZE_MAX - elementSize) / stride) return false;
+  const size_t extent = accessor.count == 0 ? 0 : (accessor.count - 1) * stride + elementSize;
+  const unsigned char* base = viewBytes(model, accessor.bufferView, accessor.byteOffset, extent);
+  if (!base) return false;
+  data = { &accessor, &view, base, stride };
+  return true;
+}
+
+// Overwrites the elements of out listed in the accessor's sparse section.
+static bool applySparse(const tinygltf::Model& model, const tinygltf::Accessor& accessor, std::vector<glm::vec4>& out)
+{
+  const auto& sparse = accessor.sparse;
+  const int indexSize = tinygltf::GetComponentSizeInBytes(sparse.indices.componentType);
+  const int components = tinygltf::GetNumComponentsInType(accessor.type);
+  const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  if (sparse.count < 0 || indexSize <= 0) return false;
+  const unsigned char* indices =
+    viewBytes(model, sparse.indices.bufferView, sparse.indices.byteOffset, size_t(sparse.count) * indexSize);
+  const unsigned char* values = viewBytes(model, sparse.values.bufferView, sparse.values.byteOffset,
+                                          size_t(sparse.count) * components * componentSize);
+  if (!indices || !values) return false;
+
+  for (int i = 0; i < sparse.count; ++i)
+  {
+    uint32_t index = 0;
+    switch (sparse.indices.componentType)
+    {
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: index = indices[i]; break;
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, indices + i * 2, sizeof(v)); index = v; break; }
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: std::memcpy(&index, indices + i * 4, sizeof(index)); break;
+      default: return false;
+    }
+    if (index >= out.size()) return false;
+    for (int c = 0; c < components; ++c)
+    {
+      out[index][c] = readComponent(values + (size_t(i) * components + c) * componentSize, accessor.componentType);
+    }
+  }
+  return true;
+}
+
+bool readAccessor(const tinygltf::Model& model, int accessorIndex, std::vector<glm::vec4>& out, float defaultW)
+{
+  if (accessorIndex < 0 || accessorIndex >= (int)model.accessors.size()) return false;
+  const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+  const int components = tinygltf::GetNumComponentsInType(accessor.type);
+  const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  if (components < 1 || components > 4 || componentSize <= 0) return false;
+
+  // Sparse accessors without a buffer view start out as zeros.
+  if (accessor.bufferView < 0)
+  {
+    if (!accessor.sparse.isSparse) return false;
+    out.assign(accessor.count, glm::vec4(0.0f, 0.0f, 0.0f, defaultW));
+    return applySparse(model, accessor, out);
+  }
+
+  AccessorData data;
+  if (!findAccessorData(model, accessorIndex, data)) return false;
+
+  out.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i)
+  {
+    glm::vec4 v {0.0f, 0.0f, 0.0f, defaultW};
+    for (int c = 0; c < components; ++c)
+    {
+      v[c] = readComponent(data.base + i * data.stride + c * componentSize, accessor.componentType);
+    }
+    out[i] = v;
+  }
+  return !accessor.sparse.isSparse || applySparse(model, accessor, out);
+}
+
+bool readAccessorUint(const tinygltf::Model& model, int accessorIndex, std::vector<glm::uvec4>& out)
+{
+  AccessorData data;
+  if (!findAccessorData(model, accessorIndex, data)) return false;
+  const tinygltf::Accessor& accessor = *data.accessor;
+  const int components = tinygltf::GetNumComponentsInType(accessor.type);
+  const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  if (components > 4) return false;
+
+  out.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i)
+  {
+    glm::uvec4 v {0, 0, 0, 0};
+    for (int c = 0; c < components; ++c)
+    {
+      const unsigned char* p = data.base + i * data.stride + c * componentSize;
+      switch (accessor.componentType)
+      {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: v[c] = *p; break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t u; std::memcpy(&u, p, sizeof(u)); v[c] = u; break; }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: { uint32_t u; std::memcpy(&u, p, sizeof(u)); v[c] = u; break; }
+        default: return false;
+      }
+    }
+    out[i] = v;
+  }
+  return true;
+}
+
+bool readIndices(const tinygltf::Model& model, int accessorIndex, std::vector<uint32_t>& out)
+{
+  AccessorData data;
+  if (!findAccessorData(model, accessorIndex, data)) return false;
+  const tinygltf::Accessor& accessor = *data.accessor;
+
+  out.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i)
+  {
+    const unsigned char* p = data.base + i * data.stride;
+    switch (accessor.componentType)
+    {
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: out[i] = *p; break;
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, sizeof(v)); out[i] = v; break; }
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, sizeof(v)); out[i] = v; break; }
+      default: return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "tiny_gltf.h"
+
+// CPU-side reads of glTF accessor data, for code that needs the values
+// rather than a GL buffer binding.
+
+// Where the elements of an accessor with a buffer view live.
+struct AccessorData {
+  const tinygltf::Accessor* accessor = nullptr;
+  const tinygltf::BufferView* view = nullptr;
+  // Element i starts at base + i * stride.
+  const unsigned char* base = nullptr;
+  int stride = 0;
+};
+
+// Checks that accessorIndex names an accessor with a buffer view, that the
+// view lies inside its buffer and that all of the accessor's elements lie
+// inside the view. False otherwise, so readers never index past the data
+// of a malformed file.
+bool findAccessorData(const tinygltf::Model& model, int accessorIndex, AccessorData& data);
+
+// One float or normalized integer component; other types read as 0.
+float readComponent(const unsigned char* p, int componentType);
+
+// Reads up to four components per element of a float or normalized accessor,
+// with any sparse substitution applied.
+bool readAccessor(const tinygltf::Model& model, int accessorIndex, std::vector<glm::vec4>& out, float defaultW);
+
+// Reads up to four unsigned integer components per element, e.g. JOINTS_0.
+bool readAccessorUint(const tinygltf::Model& model, int accessorIndex, std::vector<glm::uvec4>& out);
+
+bool readIndices(const tinygltf::Model& model, int accessorIndex, std::vector<uint32_t>& out);
@@ -0,0 +1,69 @@
+#include "alloc_stats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocationCount {0};
+std::atomic<uint64_t> allocationBytes {0};
+
+void* countedAlloc(size_t size, size_t alignment)
+{
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(size, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+  // aligned_alloc wants the size to be a multiple of the alignment.
+  return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void* countedAllocOrThrow(size_t size, size_t alignment)
+{
+  void* p = countedAlloc(size, alignment);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+}
+
+AllocationStats allocationStats()
+{
+  AllocationStats stats;
+  stats.count = allocationCount.load(std::memory_order_relaxed);
+  stats.bytes = allocationBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+AllocationStats allocationsSince(const AllocationStats& before)
+{
+  AllocationStats now = allocationStats();
+  now.count -= before.count;
+  now.bytes -= before.bytes;
+  return now;
+}
+
+// Replacements for the global allocation functions. Everything, including
+// the standard library, allocates through these.
+void* operator new(size_t size) { return countedAllocOrThrow(size, 0); }
+void* operator new[](size_t size) { return countedAllocOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return countedAllocOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return countedAllocOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts every allocation made through the global operator new, from any
+// thread. Read it before and after a frame to see how many heap allocations
+// the frame made; a loaded scene should make none.
+
+struct AllocationStats {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+AllocationStats allocationStats();
+
+// Allocations made since an earlier snapshot.
+AllocationStats allocationsSince(const AllocationStats& before);
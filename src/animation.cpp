@@ -0,0 +1,331 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "accessor.h"
+#include "parallel.h"
+
+namespace {
+
+const size_t kChannelsPerJob = 512;
+
+// a * wa + b * wb, four lanes at once.
+inline glm::vec4 combine(const glm::vec4& a, float wa, const glm::vec4& b, float wb)
+{
+#if defined(__SSE2__)
+  const __m128 r = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&a[0]), _mm_set1_ps(wa)), _mm_mul_ps(_mm_loadu_ps(&b[0]), _mm_set1_ps(wb)));
+  glm::vec4 out;
+  _mm_storeu_ps(&out[0], r);
+  return out;
+#else
+  return a * wa + b * wb;
+#endif
+}
+
+inline float dot4(const glm::vec4& a, const glm::vec4& b)
+{
+#if defined(__SSE2__)
+  const __m128 m = _mm_mul_ps(_mm_loadu_ps(&a[0]), _mm_loadu_ps(&b[0]));
+  const __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehl_ps(s, s)));
+#else
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+#endif
+}
+
+inline glm::vec4 normalizeQuat(const glm::vec4& q)
+{
+  const float length = std::sqrt(dot4(q, q));
+  return length > 0.0f ? combine(q, 1.0f / length, q, 0.0f) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// Shortest-path slerp of quaternions stored as (x, y, z, w).
+inline glm::vec4 slerpQuat(const glm::vec4& a, const glm::vec4& b, float u)
+{
+  float cosine = dot4(a, b);
+  const float sign = cosine < 0.0f ? -1.0f : 1.0f;
+  cosine *= sign;
+  if (cosine > 0.9995f)
+  {
+    return normalizeQuat(combine(a, 1.0f - u, b, sign * u));
+  }
+  const float angle = std::acos(cosine);
+  const float invSin = 1.0f / std::sin(angle);
+  return combine(a, std::sin((1.0f - u) * angle) * invSin, b, sign * std::sin(u * angle) * invSin);
+}
+
+// Index k of the key interval [times[k], times[k + 1]] holding t, starting
+// from the cached cursor. Playing forward moves it by at most a few keys, so
+// the walk almost always ends without the binary search.
+uint32_t findKey(const float* times, uint32_t count, float t, uint32_t cursor)
+{
+  if (count < 2) return 0;
+  const uint32_t last = count - 2;
+  if (cursor > last || t < times[cursor])
+  {
+    cursor = 0;
+  }
+  for (int step = 0; step < 4; ++step)
+  {
+    if (cursor >= last || times[cursor + 1] > t) return cursor;
+    ++cursor;
+  }
+  const uint32_t found = static_cast<uint32_t>(std::upper_bound(times + cursor, times + count, t) - times);
+  return std::min(found - 1, last);
+}
+
+void stepTracks(AnimationInstance& instance, const AnimationClip& clip, double dt)
+{
+  instance.time += dt * instance.speed;
+  if (clip.duration > 0.0f)
+  {
+    if (instance.loop)
+    {
+      instance.time = std::fmod(instance.time, static_cast<double>(clip.duration));
+      if (instance.time < 0.0) instance.time += clip.duration;
+    }
+    else
+    {
+      instance.time = std::clamp(instance.time, 0.0, static_cast<double>(clip.duration));
+    }
+  }
+
+  const float t = static_cast<float>(instance.time);
+  for (size_t track = 0; track + 1 < clip.trackStart.size(); ++track)
+  {
+    const float* times = clip.times.data() + clip.trackStart[track];
+    const uint32_t count = clip.trackStart[track + 1] - clip.trackStart[track];
+    const uint32_t key = findKey(times, count, t, instance.cursors[track]);
+    instance.cursors[track] = key;
+
+    float fraction = 0.0f;
+    if (count >= 2 && t > times[key])
+    {
+      const float span = times[key + 1] - times[key];
+      fraction = span > 0.0f ? std::min((t - times[key]) / span, 1.0f) : 1.0f;
+    }
+    instance.trackFraction[track] = fraction;
+  }
+}
+
+void sampleChannels(AnimationInstance& instance, const AnimationClip& clip, size_t begin, size_t end)
+{
+  for (size_t c = begin; c < end; ++c)
+  {
+    const AnimationChannel& channel = clip.channels[c];
+    const uint32_t track = channel.track;
+    const uint32_t count = clip.trackStart[track + 1] - clip.trackStart[track];
+    const uint32_t key = instance.cursors[track];
+    const uint32_t next = count > 1 ? key + 1 : key;
+    const float u = instance.trackFraction[track];
+    const bool rotation = channel.path == kPathRotation;
+    glm::vec4& out = instance.output[c];
+
+    switch (channel.interpolation)
+    {
+      case kInterpolationStep:
+      {
+        out = clip.values[channel.firstValue + (u < 1.0f ? key : next)];
+        break;
+      }
+      case kInterpolationCubicSpline:
+      {
+        const glm::vec4* keys = clip.values.data() + channel.firstValue;
+        const float* times = clip.times.data() + clip.trackStart[track];
+        const float span = times[next] - times[key];
+        const float u2 = u * u;
+        const float u3 = u2 * u;
+        const glm::vec4 start = combine(keys[key * 3 + 1], 2.0f * u3 - 3.0f * u2 + 1.0f, keys[key * 3 + 2], (u3 - 2.0f * u2 + u) * span);
+        const glm::vec4 finish = combine(keys[next * 3 + 1], -2.0f * u3 + 3.0f * u2, keys[next * 3], (u3 - u2) * span);
+        out = combine(start, 1.0f, finish, 1.0f);
+        if (rotation) out = normalizeQuat(out);
+        break;
+      }
+      default:
+      {
+        const glm::vec4& a = clip.values[channel.firstValue + key];
+        const glm::vec4& b = clip.values[channel.firstValue + next];
+        out = rotation ? slerpQuat(a, b, u) : combine(a, 1.0f - u, b, u);
+        break;
+      }
+    }
+  }
+}
+
+}
+
+bool compileAnimations(std::vector<AnimationClip>& clips, const tinygltf::Model& gltfmodel, const SceneGraph& graph)
+{
+  clips.clear();
+  clips.resize(gltfmodel.animations.size());
+  std::vector<glm::vec4> values;
+  for (size_t a = 0; a < gltfmodel.animations.size(); ++a)
+  {
+    const tinygltf::Animation& animation = gltfmodel.animations[a];
+    AnimationClip& clip = clips[a];
+    clip.name = animation.name;
+    clip.trackStart.push_back(0);
+    // Input accessor and track of every track added so far.
+    std::vector<std::pair<int, uint32_t>> tracks;
+
+    for (const tinygltf::AnimationChannel& source : animation.channels)
+    {
+      const int node = source.target_node;
+      if (node < 0 || node >= (int)graph.flatIndex.size() || graph.flatIndex[node] < 0) continue;
+      if (source.sampler < 0 || source.sampler >= (int)animation.samplers.size()) continue;
+
+      AnimationChannel channel;
+      channel.node = static_cast<uint32_t>(graph.flatIndex[node]);
+      if (source.target_path == "translation") channel.path = kPathTranslation;
+      else if (source.target_path == "rotation") channel.path = kPathRotation;
+      else if (source.target_path == "scale") channel.path = kPathScale;
+      else if (source.target_path == "weights") channel.path = kPathWeights;
+      else continue;
+      const uint32_t weightCount = graph.weightCount[channel.node];
+      if (channel.path == kPathWeights && weightCount == 0) continue;
+
+      const tinygltf::AnimationSampler& sampler = animation.samplers[source.sampler];
+      if (sampler.interpolation == "STEP") channel.interpolation = kInterpolationStep;
+      else if (sampler.interpolation == "CUBICSPLINE") channel.interpolation = kInterpolationCubicSpline;
+      else channel.interpolation = kInterpolationLinear;
+
+      if (sampler.input < 0 || sampler.input >= (int)gltfmodel.accessors.size() ||
+          sampler.output < 0 || sampler.output >= (int)gltfmodel.accessors.size())
+      {
+        std::printf("Animation %zu has a sampler with an invalid accessor\n", a);
+        continue;
+      }
+
+      auto existing = std::find_if(tracks.begin(), tracks.end(), [&](const auto& t) { return t.first == sampler.input; });
+      if (existing != tracks.end())
+      {
+        channel.track = existing->second;
+      }
+      else
+      {
+        if (!readAccessor(gltfmodel, sampler.input, values, 0.0f) || values.empty())
+        {
+          std::printf("Animation %zu has an unreadable input accessor\n", a);
+          continue;
+        }
+        channel.track = static_cast<uint32_t>(clip.trackStart.size() - 1);
+        for (const glm::vec4& v : values) clip.times.push_back(v.x);
+        clip.trackStart.push_back(static_cast<uint32_t>(clip.times.size()));
+        clip.duration = std::max(clip.duration, values.back().x);
+        tracks.emplace_back(sampler.input, channel.track);
+      }
+
+      const size_t keys = clip.trackStart[channel.track + 1] - clip.trackStart[channel.track];
+      const size_t expected = keys * (channel.interpolation == kInterpolationCubicSpline ? 3 : 1);
+      const size_t scalars = channel.path == kPathWeights ? weightCount : 1;
+      if (!readAccessor(gltfmodel, sampler.output, values, 0.0f) || values.size() < expected * scalars)
+      {
+        std::printf("Animation %zu has an output accessor with too few values\n", a);
+        continue;
+      }
+      if (channel.path != kPathWeights)
+      {
+        channel.firstValue = static_cast<uint32_t>(clip.values.size());
+        clip.values.insert(clip.values.end(), values.begin(), values.begin() + expected);
+        clip.channels.push_back(channel);
+        continue;
+      }
+
+      // Weights come as weightCount scalars per key; regroup them four at a
+      // time.
+      for (uint32_t first = 0; first < weightCount; first += 4)
+      {
+        channel.firstValue = static_cast<uint32_t>(clip.values.size());
+        channel.firstWeight = first;
+        for (size_t k = 0; k < expected; ++k)
+        {
+          glm::vec4 v(0.0f);
+          for (uint32_t w = first; w < std::min(first + 4, weightCount); ++w) v[w - first] = values[k * weightCount + w].x;
+          clip.values.push_back(v);
+        }
+        clip.channels.push_back(channel);
+      }
+    }
+  }
+  return true;
+}
+
+void startAnimation(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, uint32_t clip)
+{
+  AnimationInstance instance;
+  instance.clip = clip;
+  const size_t tracks = clips[clip].trackStart.empty() ? 0 : clips[clip].trackStart.size() - 1;
+  instance.cursors.assign(tracks, 0);
+  instance.trackFraction.assign(tracks, 0.0f);
+  instance.output.assign(clips[clip].channels.size(), glm::vec4(0.0f));
+  instances.push_back(std::move(instance));
+}
+
+void advanceAnimations(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, double dt)
+{
+  if (instances.size() >= workerCount())
+  {
+    parallelFor(instances.size(), [&](size_t i) {
+      AnimationInstance& instance = instances[i];
+      const AnimationClip& clip = clips[instance.clip];
+      stepTracks(instance, clip, dt);
+      sampleChannels(instance, clip, 0, clip.channels.size());
+    });
+    return;
+  }
+
+  for (AnimationInstance& instance : instances)
+  {
+    const AnimationClip& clip = clips[instance.clip];
+    stepTracks(instance, clip, dt);
+    const size_t channels = clip.channels.size();
+    parallelFor((channels + kChannelsPerJob - 1) / kChannelsPerJob, [&](size_t job) {
+      sampleChannels(instance, clip, job * kChannelsPerJob, std::min(channels, (job + 1) * kChannelsPerJob));
+    });
+  }
+}
+
+void applyAnimation(const AnimationInstance& instance, const AnimationClip& clip, SceneGraph& graph)
+{
+  for (size_t c = 0; c < clip.channels.size(); ++c)
+  {
+    const AnimationChannel& channel = clip.channels[c];
+    const glm::vec4& v = instance.output[c];
+    switch (channel.path)
+    {
+      case kPathTranslation: setNodeTranslation(graph, channel.node, glm::vec3(v)); break;
+      case kPathRotation: setNodeRotation(graph, channel.node, glm::quat(v.w, v.x, v.y, v.z)); break;
+      case kPathScale: setNodeScale(graph, channel.node, glm::vec3(v)); break;
+      case kPathWeights: setNodeWeights(graph, channel.node, channel.firstWeight, &v[0], 4); break;
+    }
+  }
+}
+
+bool animationsPlaying(const std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips)
+{
+  for (const AnimationInstance& instance : instances)
+  {
+    const AnimationClip& clip = clips[instance.clip];
+    if (clip.channels.empty() || clip.duration <= 0.0f || instance.speed == 0.0f) continue;
+    if (instance.loop) return true;
+    if (instance.speed > 0.0f ? instance.time < clip.duration : instance.time > 0.0) return true;
+  }
+  return false;
+}
+
+void animateScene(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, SceneGraph& graph, double dt)
+{
+  if (instances.empty()) return;
+  advanceAnimations(instances, clips, dt);
+  for (const AnimationInstance& instance : instances)
+  {
+    applyAnimation(instance, clips[instance.clip], graph);
+  }
+  updateWorldTransforms(graph);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_graph.h"
+#include "tiny_gltf.h"
+
+// glTF animation clips compiled into contiguous arrays. Every clip keeps the
+// key times of all its channels back to back in one array, with channels that
+// share an input accessor sharing a time track, and all output values padded
+// to vec4 in another. Sampling caches the last key per track, so playing
+// forward costs O(1) per channel per frame. Morph weight channels are split
+// into one channel per four weights so they sample like any other vec4.
+
+enum AnimationPath : uint8_t {
+  kPathTranslation,
+  kPathRotation,
+  kPathScale,
+  kPathWeights,
+};
+
+enum AnimationInterpolation : uint8_t {
+  kInterpolationLinear,
+  kInterpolationStep,
+  kInterpolationCubicSpline,
+};
+
+struct AnimationChannel {
+  uint32_t node = 0;        // flat scene graph index
+  uint32_t track = 0;
+  // First key in AnimationClip::values. Cubic spline keys take three
+  // entries each: in-tangent, value, out-tangent.
+  uint32_t firstValue = 0;
+  // First of the four morph target weights a kPathWeights channel drives.
+  uint32_t firstWeight = 0;
+  uint8_t path = kPathTranslation;
+  uint8_t interpolation = kInterpolationLinear;
+};
+
+struct AnimationClip {
+  std::string name;
+  float duration = 0.0f;
+  // trackStart[t]..trackStart[t + 1] are the key times of track t.
+  std::vector<float> times;
+  std::vector<uint32_t> trackStart;
+  std::vector<glm::vec4> values;
+  std::vector<AnimationChannel> channels;
+};
+
+// Playback state of one clip. The per-track and per-channel arrays are sized
+// by startAnimation() and reused every frame.
+struct AnimationInstance {
+  uint32_t clip = 0;
+  double time = 0.0;
+  float speed = 1.0f;
+  bool loop = true;
+  std::vector<uint32_t> cursors;     // last key used, per track
+  std::vector<float> trackFraction;  // position between that key and the next
+  std::vector<glm::vec4> output;     // sampled value, per channel
+};
+
+// Channels that target nodes outside the scene graph, or morph weights of
+// nodes without targets, are dropped. Clips left without channels are kept so indices match the model.
+bool compileAnimations(std::vector<AnimationClip>& clips, const tinygltf::Model& gltfmodel, const SceneGraph& graph);
+
+// Appends an instance playing clips[clip] from the start.
+void startAnimation(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, uint32_t clip);
+
+// Advances every instance by dt seconds and samples all of its channels.
+// Instances are spread over the worker threads, or the channels of each
+// instance when there are fewer instances than threads.
+void advanceAnimations(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, double dt);
+
+// Writes an instance's sampled values into the graph's local transforms and
+// morph weights.
+void applyAnimation(const AnimationInstance& instance, const AnimationClip& clip, SceneGraph& graph);
+
+// True while an instance still changes the scene: a looping clip, or a
+// one-shot clip that has not reached its end. Clips without channels never
+// play.
+bool animationsPlaying(const std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips);
+
+// advanceAnimations(), applyAnimation() for each instance, then
+// updateWorldTransforms().
+void animateScene(std::vector<AnimationInstance>& instances, const std::vector<AnimationClip>& clips, SceneGraph& graph, double dt);
@@ -0,0 +1,68 @@
+#include "asset_pipeline.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "loader.h"
+
+namespace {
+
+bool readFile(const std::string& path, std::vector<unsigned char>& data)
+{
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in)
+  {
+    std::printf("Unable to open %s\n", path.c_str());
+    return false;
+  }
+  data.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(data.data()), data.size()));
+}
+
+Task<void> decodeImageAsync(tinygltf::Model& model, const DeferredImage& image, std::atomic<bool>& ok)
+{
+  co_await switchToWorker();
+  if (!decodeImage(model, image)) ok = false;
+}
+
+}
+
+Task<bool> loadRuntimeSceneAsync(RuntimeScene& scene, std::string path, ModelSubset subset)
+{
+  co_await switchToWorker();
+  tinygltf::Model gltfmodel;
+  std::vector<DeferredImage> images;
+  {
+    std::vector<unsigned char> data;
+    std::string error;
+    if (isWholeModel(subset))
+    {
+      if (!readFile(path, data)) co_return false;
+    }
+    else if (!readModelSubset(path, subset, data, error))
+    {
+      std::printf("Unable to load part of %s: %s\n", path.c_str(), error.c_str());
+      co_return false;
+    }
+    if (!parseModel(gltfmodel, data, path, images)) co_return false;
+  }
+
+  std::atomic<bool> decoded {true};
+  std::vector<Task<void>> decodes;
+  decodes.reserve(images.size());
+  for (const DeferredImage& image : images) decodes.push_back(decodeImageAsync(gltfmodel, image, decoded));
+  Task<void> all = whenAll(std::move(decodes));
+  co_await all;
+  if (!decoded) co_return false;
+  images.clear();
+
+  PreparedScene prepared;
+  if (!prepareRuntimeScene(prepared, gltfmodel)) co_return false;
+
+  co_await switchToMainThread();
+  uploadRuntimeScene(scene, prepared, gltfmodel);
+  co_return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "model_subset.h"
+#include "runtime_scene.h"
+#include "task.h"
+
+// Asynchronous loadRuntimeScene(): the file read, glTF parse, image decodes
+// and prepareRuntimeScene() run on the job system, and only
+// uploadRuntimeScene() resumes on the main thread at its next
+// runMainThreadTasks(). Several
+// scenes can load at once by awaiting whenAll() over their tasks.
+//
+// scene must stay alive, and must not be drawn from another thread, until the
+// task finishes; it is filled in on the main thread. With a subset only that
+// part of the file is read. Callers that are coroutines keep the task in a
+// variable and await that: GCC 12 frees the argument objects made for a call
+// inside a co_await expression from the wrong frame.
+Task<bool> loadRuntimeSceneAsync(RuntimeScene& scene, std::string path, ModelSubset subset = {});
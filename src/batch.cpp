@@ -0,0 +1,197 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "frame_capture.h"
+#include "headless.h"
+#include "render_job.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Output sizes whose framebuffer and readback buffers are kept.
+const size_t kCachedTargets = 4;
+
+struct RenderTarget {
+  Framebuffer fb;
+  FrameCapture capture;
+  uint64_t lastUsed = 0;
+};
+
+double msSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool parseJob(const std::string& line, RenderJob& job, std::string& output)
+{
+  const nlohmann::json value = nlohmann::json::parse(line, nullptr, false);
+  std::string error;
+  if (value.is_discarded() || !readRenderJob(value, job, error))
+  {
+    std::printf("%s\n", value.is_discarded() ? "not a JSON object" : error.c_str());
+    return false;
+  }
+  if (!value.contains("output") || !value["output"].is_string())
+  {
+    std::printf("needs an output path\n");
+    return false;
+  }
+  output = value["output"].get<std::string>();
+  return true;
+}
+
+// Waits for the target's last images and frees it. Returns the number of
+// images that failed to write.
+int releaseTarget(RenderTarget& target)
+{
+  destroyFrameCapture(target.capture);
+  destroyFramebuffer(target.fb);
+  return target.capture.captured - target.capture.written.load();
+}
+
+// The framebuffer and readback ring for a width x height output. Evicting
+// a target adds its failed writes to failures.
+RenderTarget* acquireTarget(std::vector<std::unique_ptr<RenderTarget>>& targets, int width, int height, int pngLevel,
+                            uint64_t use, int& failures)
+{
+  for (std::unique_ptr<RenderTarget>& target : targets)
+  {
+    if (target->fb.width == width && target->fb.height == height)
+    {
+      target->lastUsed = use;
+      return target.get();
+    }
+  }
+
+  if (targets.size() >= kCachedTargets)
+  {
+    auto oldest = std::min_element(targets.begin(), targets.end(), [](const auto& a, const auto& b) { return a->lastUsed < b->lastUsed; });
+    failures += releaseTarget(**oldest);
+    targets.erase(oldest);
+  }
+
+  auto target = std::make_unique<RenderTarget>();
+  if (!createFramebuffer(target->fb, width, height)) return nullptr;
+  if (!createFrameCapture(target->capture, "", width, height, 0))
+  {
+    destroyFramebuffer(target->fb);
+    return nullptr;
+  }
+  target->capture.pngLevel = pngLevel;
+  target->lastUsed = use;
+  targets.push_back(std::move(target));
+  return targets.back().get();
+}
+
+}
+
+int runBatch(const BatchOptions& options)
+{
+  std::ifstream jobs(options.jobsPath);
+  if (!jobs)
+  {
+    std::printf("Unable to open %s\n", options.jobsPath.c_str());
+    return -1;
+  }
+
+  HeadlessContext ctx;
+  if (!createHeadlessContext(ctx))
+  {
+    return -1;
+  }
+  if (!gladLoadGL(eglGetProcAddress))
+  {
+    std::printf("Failed to initialize OpenGL context\n");
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  enableDebugOutput(false);
+
+  Renderer renderer;
+  if (!createRenderer(renderer))
+  {
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+
+  SceneCache scenes;
+  scenes.capacity = static_cast<size_t>(std::max(1, options.cachedScenes));
+  std::vector<std::unique_ptr<RenderTarget>> targets;
+  std::vector<AnimationInstance> animations;
+  FrameArena frameArena;
+  createFrameArena(frameArena, kFrameArenaBytes);
+
+  const auto batchStart = Clock::now();
+  uint64_t use = 0;
+  int jobCount = 0, failures = 0, sceneLoads = 0;
+  double loadMs = 0.0;
+  std::string line;
+  for (int lineNumber = 1; std::getline(jobs, line); ++lineNumber)
+  {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+    ++jobCount;
+    ++use;
+
+    std::printf("%s:%d: ", options.jobsPath.c_str(), lineNumber);
+    RenderJob job;
+    std::string output;
+    if (!parseJob(line, job, output))
+    {
+      ++failures;
+      continue;
+    }
+
+    const auto loadStart = Clock::now();
+    bool loaded = false;
+    CachedScene* cached = runUntilComplete(acquireScene(scenes, job.model, 0, &loaded));
+    if (!cached)
+    {
+      std::printf("unable to load %s\n", job.model.c_str());
+      ++failures;
+      continue;
+    }
+    if (loaded)
+    {
+      ++sceneLoads;
+      loadMs += msSince(loadStart);
+    }
+
+    RenderTarget* target = acquireTarget(targets, job.width, job.height, options.pngLevel, use, failures);
+    if (!target)
+    {
+      std::printf("unable to create a %dx%d framebuffer\n", job.width, job.height);
+      releaseScene(*cached);
+      ++failures;
+      continue;
+    }
+
+    const auto renderStart = Clock::now();
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fb.fbo);
+    glViewport(0, 0, job.width, job.height);
+    if (!drawRenderJob(renderer, *cached, job, animations, frameArena, use))
+    {
+      std::printf("no variant %s, using the default materials; ", job.variant.c_str());
+    }
+    releaseScene(*cached);
+    captureFrameTo(target->capture, target->fb.fbo, output);
+    std::printf("%s -> %s (%s, rendered in %.1f ms)\n", job.model.c_str(), output.c_str(), loaded ? "loaded" : "cached",
+                msSince(renderStart));
+  }
+
+  for (std::unique_ptr<RenderTarget>& target : targets) failures += releaseTarget(*target);
+  destroySceneCache(scenes);
+  destroyRenderer(renderer);
+  destroyHeadlessContext(ctx);
+
+  const double totalMs = msSince(batchStart);
+  std::printf("%d jobs, %d failed, %d scene loads (%.1f ms), %.1f s total, %.1f images/s\n", jobCount, failures,
+              sceneLoads, loadMs, totalMs / 1000.0, jobCount > 0 ? jobCount / (totalMs / 1000.0) : 0.0);
+  return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "image_encode.h"
+
+// Headless batch rendering: one job per line of a JSON Lines file,
+//
+//   {"model": "shoe.glb", "output": "shoe_beach.png", "size": [1024, 1024],
+//    "camera": {"pos": [0, -3, 1], "target": [0, 0, 0.5]},
+//    "variant": "beach", "time": 0.5}
+//
+// Only model and output are required. size defaults to 800x600, camera to
+// the viewer's start view (see readCamera() for the forms it takes), variant
+// to the glTF materials and time to the rest pose of animation 0. A .qoi
+// output is written as QOI, anything else as PNG.
+//
+// One EGL context and renderer, so the shaders compile once, serve every
+// job. Compiled scenes stay in a least-recently-used cache, so consecutive
+// jobs on the same model skip loading entirely; so do the framebuffers and
+// readback buffers of each output size. Images are encoded on the job system
+// while the next job renders. A job that fails is reported and skipped.
+
+struct BatchOptions {
+  std::string jobsPath;
+  // Compiled scenes kept loaded between jobs.
+  int cachedScenes = 4;
+  int pngLevel = kDefaultPngLevel;
+};
+
+// Returns 0 when every job was written.
+int runBatch(const BatchOptions& options);
@@ -0,0 +1,84 @@
+#include "camera.h"
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+MouseState mouseState;
+CameraMovement cameraMovement;
+
+Camera makeDefaultCamera()
+{
+  glm::vec3 camPos {-2.0f, 1.0f, 3.0f};
+  glm::vec3 target {0.5f, 0.5f, 0.0f};
+  glm::vec3 up {0.0f, 0.0f, 1.0f};
+  return Camera { camPos, glm::lookAt(camPos, target, up) };
+}
+
+glm::mat4 getViewMatrix(const Camera& camera)
+{
+  const glm::mat4 t = glm::translate(glm::mat4{1.0f}, -camera.pos);
+  const glm::mat4 r = glm::mat4_cast(camera.orientation);
+  return r * t;
+}
+
+void setUpVector(Camera& camera, const glm::vec3& up)
+{
+  const glm::mat4 view = getViewMatrix(camera);
+  const glm::vec3 dir = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+  camera.orientation = glm::lookAt(camera.pos, camera.pos + dir, up);
+}
+
+void resetMousePosition(MouseState& ms, const glm::vec2& p)
+{
+  ms.pos = p;
+}
+
+bool cameraMoving(const CameraMovement& movement)
+{
+  return movement.forward || movement.backward || movement.left || movement.right || movement.up || movement.down ||
+         movement.resetUp;
+}
+
+void updateCamera(Camera& camera, double deltaSeconds, const MouseState& newState, MouseState& oldState, const CameraMovement& movement)
+{
+  if (cameraMovement.resetUp) setUpVector(camera, glm::vec3{0.0f, 1.0f, 0.0f});
+
+  if (mouseState.pressedLeft)
+  {
+    const glm::vec2 delta = newState.pos - oldState.pos;
+    const glm::quat deltaQuat = glm::quat(glm::vec3(movement.lookSpeed * delta.y, movement.lookSpeed * delta.x, 0.0f));
+    camera.orientation = glm::normalize(deltaQuat * camera.orientation);
+  }
+  oldState = newState;
+
+  const glm::mat4 v = glm::mat4_cast(camera.orientation);
+  const glm::vec3 forward = -glm::vec3(v[0][2], v[1][2], v[2][2]);
+  const glm::vec3 right = glm::vec3(v[0][0], v[1][0], v[2][0]);
+  const glm::vec3 up = glm::cross(right, forward);
+
+  glm::vec3 accel {0.0f};
+  if (cameraMovement.forward) accel += forward;
+  if (cameraMovement.backward) accel -= forward;
+  if (cameraMovement.left) accel -= right;
+  if (cameraMovement.right) accel += right;
+  if (cameraMovement.up) accel += up;
+  if (cameraMovement.down) accel -= up;
+  if (cameraMovement.fastSpeed) accel *= cameraMovement.fastCoef;
+
+  if (accel == glm::zero<glm::vec3>())
+  {
+    cameraMovement.moveSpeed -= cameraMovement.moveSpeed * std::min((1.0f / cameraMovement.damping) * static_cast<float>(deltaSeconds), 1.0f);
+  }
+  else
+  {
+    cameraMovement.moveSpeed += accel * cameraMovement.acceleration * static_cast<float>(deltaSeconds);
+    const float maxSpeed = cameraMovement.fastSpeed ? cameraMovement.maxSpeed * cameraMovement.fastCoef : cameraMovement.maxSpeed;
+    if (glm::length(cameraMovement.moveSpeed) > maxSpeed)
+    {
+      cameraMovement.moveSpeed = glm::normalize(cameraMovement.moveSpeed) * maxSpeed;
+    }
+
+    camera.pos += cameraMovement.moveSpeed * static_cast<float>(deltaSeconds);
+  }
+}
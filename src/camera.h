@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct Camera {
+  glm::vec3 pos;
+  glm::quat orientation;
+};
+
+struct MouseState {
+  glm::vec2 pos {0.0f};
+  bool pressedLeft = false;
+};
+
+struct CameraMovement {
+  bool forward = false;
+  bool backward = false;
+  bool left = false;
+  bool right = false;
+  bool up = false;
+  bool down = false;
+  bool fastSpeed = false;
+  bool resetUp = false;
+  float lookSpeed = 4.0f;
+  float acceleration = 150.0f;
+  float damping = 0.2f;
+  float maxSpeed = 10.0f;
+  float fastCoef = 10.0f;
+  glm::vec3 moveSpeed {0.0f};
+};
+
+extern MouseState mouseState;
+extern CameraMovement cameraMovement;
+
+// The viewpoint the viewer starts from.
+Camera makeDefaultCamera();
+
+glm::mat4 getViewMatrix(const Camera& camera);
+void setUpVector(Camera& camera, const glm::vec3& up);
+void resetMousePosition(MouseState& ms, const glm::vec2& p);
+// True while held keys keep the camera moving between input events.
+bool cameraMoving(const CameraMovement& movement);
+
+void updateCamera(Camera& camera, double deltaSeconds, const MouseState& newState, MouseState& oldState, const CameraMovement& movement);
@@ -0,0 +1,128 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "json.hpp"
+
+static bool readVec3(const nlohmann::json& value, glm::vec3& out)
+{
+  if (!value.is_array() || value.size() != 3) return false;
+  for (int i = 0; i < 3; ++i)
+  {
+    if (!value[i].is_number()) return false;
+    out[i] = value[i].get<float>();
+  }
+  return true;
+}
+
+bool readCamera(const nlohmann::json& value, Camera& camera)
+{
+  if (!value.is_object() || !value.contains("pos") || !readVec3(value["pos"], camera.pos)) return false;
+
+  glm::vec3 target, up {0.0f, 0.0f, 1.0f};
+  if (value.contains("orientation") && value["orientation"].is_array() && value["orientation"].size() == 4)
+  {
+    const nlohmann::json& q = value["orientation"];
+    for (int i = 0; i < 4; ++i)
+    {
+      if (!q[i].is_number()) return false;
+    }
+    camera.orientation = glm::normalize(glm::quat(q[3].get<float>(), q[0].get<float>(), q[1].get<float>(), q[2].get<float>()));
+    return true;
+  }
+  if (value.contains("target") && readVec3(value["target"], target))
+  {
+    if (value.contains("up")) readVec3(value["up"], up);
+    camera.orientation = glm::lookAt(camera.pos, target, up);
+    return true;
+  }
+  return false;
+}
+
+bool loadCameraPath(CameraPath& path, const std::string& file)
+{
+  std::ifstream in(file);
+  if (!in)
+  {
+    std::printf("Unable to open camera path %s\n", file.c_str());
+    return false;
+  }
+
+  const nlohmann::json doc = nlohmann::json::parse(in, nullptr, false);
+  if (doc.is_discarded() || !doc.contains("keyframes") || !doc["keyframes"].is_array())
+  {
+    std::printf("Camera path %s has no keyframes array\n", file.c_str());
+    return false;
+  }
+
+  path.keyframes.clear();
+  for (const nlohmann::json& key : doc["keyframes"])
+  {
+    CameraKeyframe keyframe;
+    if (key.is_object() && key.contains("time") && !key["time"].is_number())
+    {
+      std::printf("Camera path %s: keyframe time must be a number\n", file.c_str());
+      return false;
+    }
+    keyframe.time = key.is_object() ? key.value("time", 0.0) : 0.0;
+    if (!readCamera(key, keyframe.camera))
+    {
+      std::printf("Camera path %s: keyframe needs pos and either orientation or target\n", file.c_str());
+      return false;
+    }
+    path.keyframes.push_back(keyframe);
+  }
+
+  if (path.keyframes.empty())
+  {
+    std::printf("Camera path %s is empty\n", file.c_str());
+    return false;
+  }
+  std::stable_sort(path.keyframes.begin(), path.keyframes.end(), [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+  return true;
+}
+
+CameraPath makeOrbitPath(const Camera& camera, const glm::vec3& target, double duration, int keyframes)
+{
+  const glm::vec3 up {0.0f, 0.0f, 1.0f};
+  const glm::vec3 offset = camera.pos - target;
+  CameraPath path;
+  for (int i = 0; i <= keyframes; ++i)
+  {
+    const float angle = 2.0f * 3.14159265f * i / keyframes;
+    const glm::vec3 rotated {
+      offset.x * std::cos(angle) - offset.y * std::sin(angle),
+      offset.x * std::sin(angle) + offset.y * std::cos(angle),
+      offset.z
+    };
+    const glm::vec3 pos = target + rotated;
+    path.keyframes.push_back(CameraKeyframe { duration * i / keyframes, Camera { pos, glm::lookAt(pos, target, up) } });
+  }
+  return path;
+}
+
+double cameraPathDuration(const CameraPath& path)
+{
+  return path.keyframes.empty() ? 0.0 : path.keyframes.back().time;
+}
+
+Camera sampleCameraPath(const CameraPath& path, double time)
+{
+  const std::vector<CameraKeyframe>& keys = path.keyframes;
+  if (time <= keys.front().time) return keys.front().camera;
+  if (time >= keys.back().time) return keys.back().camera;
+
+  const auto next = std::upper_bound(keys.begin(), keys.end(), time, [](double t, const CameraKeyframe& k) { return t < k.time; });
+  const CameraKeyframe& b = *next;
+  const CameraKeyframe& a = *(next - 1);
+  const float t = static_cast<float>((time - a.time) / (b.time - a.time));
+  return Camera {
+    glm::mix(a.camera.pos, b.camera.pos, t),
+    glm::slerp(a.camera.orientation, b.camera.orientation, t)
+  };
+}
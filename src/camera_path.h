@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "json.hpp"
+
+struct CameraKeyframe {
+  double time = 0.0;
+  Camera camera;
+};
+
+// Keyframed camera positions and orientations, sampled by time so replays do
+// not depend on how fast frames are produced.
+struct CameraPath {
+  std::vector<CameraKeyframe> keyframes;
+};
+
+// Reads {"pos": [x,y,z], "target": [x,y,z], "up": [x,y,z]}, up defaulting to
+// +z, or {"pos": ..., "orientation": [x,y,z,w]}.
+bool readCamera(const nlohmann::json& value, Camera& camera);
+
+// Reads {"keyframes": [{"time": s, "pos": [x,y,z], "target": [x,y,z], "up": [x,y,z]}]}.
+// A keyframe may give "orientation": [x,y,z,w] instead of target/up.
+bool loadCameraPath(CameraPath& path, const std::string& file);
+
+// A full turn around target about the z axis, starting from camera.
+CameraPath makeOrbitPath(const Camera& camera, const glm::vec3& target, double duration, int keyframes);
+
+double cameraPathDuration(const CameraPath& path);
+
+// Linear position and slerped orientation between the surrounding keyframes.
+Camera sampleCameraPath(const CameraPath& path, double time);
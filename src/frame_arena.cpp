@@ -0,0 +1,56 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+
+void createFrameArena(FrameArena& arena, size_t bytesPerSlot)
+{
+  for (FrameArena::Slot& slot : arena.slots)
+  {
+    slot.memory.reset(new unsigned char[bytesPerSlot]);
+    slot.capacity = bytesPerSlot;
+    slot.overflow.clear();
+    slot.overflowBytes = 0;
+  }
+  arena.current = 0;
+  arena.offset = 0;
+  arena.highWater = 0;
+}
+
+void beginArenaFrame(FrameArena& arena, uint64_t frame)
+{
+  arena.highWater = std::max(arena.highWater, arena.offset);
+  arena.current = static_cast<int>(frame % kFrameArenaSlots);
+  arena.offset = 0;
+
+  FrameArena::Slot& slot = arena.slots[arena.current];
+  if (slot.overflowBytes > 0 || slot.capacity < arena.highWater)
+  {
+    // Grow with some headroom so a slowly growing scene does not regrow
+    // every frame.
+    const size_t capacity = std::max(arena.highWater, slot.capacity + slot.overflowBytes) * 3 / 2;
+    slot.memory.reset(new unsigned char[capacity]);
+    slot.capacity = capacity;
+    slot.overflow.clear();
+    slot.overflowBytes = 0;
+  }
+}
+
+size_t arenaUsed(const FrameArena& arena)
+{
+  return arena.offset;
+}
+
+void* arenaAllocate(FrameArena& arena, size_t bytes, size_t alignment)
+{
+  FrameArena::Slot& slot = arena.slots[arena.current];
+  const uintptr_t base = reinterpret_cast<uintptr_t>(slot.memory.get());
+  const size_t start = ((base + arena.offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+  arena.offset = start + bytes;
+  if (arena.offset <= slot.capacity) return slot.memory.get() + start;
+
+  // new[] only guarantees max_align_t alignment; over-allocate for more.
+  slot.overflow.emplace_back(new unsigned char[bytes + alignment]);
+  slot.overflowBytes += bytes + alignment;
+  const uintptr_t address = reinterpret_cast<uintptr_t>(slot.overflow.back().get());
+  return reinterpret_cast<void*>((address + alignment - 1) & ~(uintptr_t(alignment) - 1));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that only lives for one frame: draw lists, sort
+// keys, staged uniforms, culling results. There is one block per frame in
+// flight, so data handed to the GPU for a frame stays valid until that
+// frame's slot comes round again; beginArenaFrame() resets the slot for the
+// new frame in O(1).
+//
+// A frame that outgrows its block takes the rest from the heap and the block
+// is regrown at the next reset, so after the first few frames of a scene the
+// arena makes no allocations at all.
+
+const int kFrameArenaSlots = 3;
+// Starting size of each slot; enough for the draw list of a few thousand
+// nodes before the first regrow.
+const size_t kFrameArenaBytes = 1 << 20;
+
+struct FrameArena {
+  struct Slot {
+    std::unique_ptr<unsigned char[]> memory;
+    size_t capacity = 0;
+    // Heap blocks taken when memory ran out, freed at the next reset.
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+    size_t overflowBytes = 0;
+  };
+  Slot slots[kFrameArenaSlots];
+  int current = 0;
+  size_t offset = 0;
+  // Most bytes any frame has asked for.
+  size_t highWater = 0;
+};
+
+void createFrameArena(FrameArena& arena, size_t bytesPerSlot);
+
+// Switches to the slot of the given frame number and empties it.
+void beginArenaFrame(FrameArena& arena, uint64_t frame);
+
+// Bytes requested so far this frame.
+size_t arenaUsed(const FrameArena& arena);
+
+void* arenaAllocate(FrameArena& arena, size_t bytes, size_t alignment);
+
+// Uninitialized storage for count objects. Nothing is destroyed on reset, so
+// only trivially destructible types are allowed.
+template <typename T>
+T* arenaArray(FrameArena& arena, size_t count)
+{
+  static_assert(std::is_trivially_destructible_v<T>, "frame arena objects are never destroyed");
+  return static_cast<T*>(arenaAllocate(arena, count * sizeof(T), alignof(T)));
+}
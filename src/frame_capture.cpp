@@ -0,0 +1,235 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+
+
+namespace {
+
+const GLbitfield kMapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+bool isY4mPath(const std::string& path)
+{
+  return path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+}
+
+size_t chromaSize(const FrameCapture& capture)
+{
+  return static_cast<size_t>((capture.width + 1) / 2) * ((capture.height + 1) / 2);
+}
+
+// Full-range BT.601, as Y4M's C420jpeg expects. GL rows start at the bottom,
+// so the planes are filled top row first from the end of the buffer.
+void convertToYuv420(const FrameCapture& capture, const unsigned char* rgba, unsigned char* yuv)
+{
+  const int width = capture.width;
+  const int height = capture.height;
+  const size_t stride = static_cast<size_t>(width) * 4;
+  unsigned char* yPlane = yuv;
+  unsigned char* uPlane = yuv + static_cast<size_t>(width) * height;
+  unsigned char* vPlane = uPlane + chromaSize(capture);
+  auto pixel = [&](int x, int y) { return rgba + (height - 1 - y) * stride + x * 4; };
+
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      const unsigned char* p = pixel(x, y);
+      yPlane[static_cast<size_t>(y) * width + x] = static_cast<unsigned char>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+    }
+  }
+
+  const int chromaWidth = (width + 1) / 2;
+  for (int cy = 0; cy < (height + 1) / 2; ++cy)
+  {
+    const int y0 = cy * 2;
+    const int y1 = std::min(y0 + 1, height - 1);
+    for (int cx = 0; cx < chromaWidth; ++cx)
+    {
+      const int x0 = cx * 2;
+      const int x1 = std::min(x0 + 1, width - 1);
+      int r = 0, g = 0, b = 0;
+      for (const unsigned char* p : { pixel(x0, y0), pixel(x1, y0), pixel(x0, y1), pixel(x1, y1) })
+      {
+        r += p[0];
+        g += p[1];
+        b += p[2];
+      }
+      // Sums of four pixels, hence the extra shift by two. Pure blue or red
+      // rounds up to 256.
+      const size_t index = static_cast<size_t>(cy) * chromaWidth + cx;
+      uPlane[index] = static_cast<unsigned char>(std::min(255, ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128));
+      vPlane[index] = static_cast<unsigned char>(std::min(255, ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128));
+    }
+  }
+}
+
+void encodeSlot(FrameCapture& capture, FrameCapture::Slot& slot)
+{
+  const size_t stride = static_cast<size_t>(capture.width) * 4;
+  bool ok;
+  if (capture.format == CaptureFormat::Y4m)
+  {
+    convertToYuv420(capture, slot.pixels, slot.yuv.data());
+    ok = std::fputs("FRAME\n", capture.stream) >= 0 &&
+         std::fwrite(slot.yuv.data(), 1, slot.yuv.size(), capture.stream) == slot.yuv.size();
+  }
+  else
+  {
+    // A negative stride from the last row flips GL's bottom-up rows.
+    const unsigned char* top = slot.pixels + stride * (capture.height - 1);
+    ok = writeImage(slot.path, top, capture.width, capture.height, 4, -static_cast<ptrdiff_t>(stride), capture.pngLevel);
+  }
+
+  if (ok)
+  {
+    capture.written.fetch_add(1);
+  }
+  else if (!capture.failed.exchange(true))
+  {
+    std::printf("Failed to write captured frame %d to %s\n", slot.frame,
+                capture.format == CaptureFormat::Y4m ? capture.path.c_str() : slot.path.c_str());
+  }
+}
+
+// Hands a finished readback to an encoder job; blocks on the fence when wait
+// is set, otherwise returns false if the readback is still in flight.
+bool startEncoding(FrameCapture& capture, int index, bool wait)
+{
+  FrameCapture::Slot& slot = capture.slots[index];
+  const GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+  if (status == GL_TIMEOUT_EXPIRED) return false;
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  auto encode = [&capture, &slot] { encodeSlot(capture, slot); };
+  if (capture.ordered && capture.lastEncoded >= 0)
+  {
+    submitJobAfter(capture.slots[capture.lastEncoded].encoding, encode, &slot.encoding);
+  }
+  else
+  {
+    submitJob(encode, &slot.encoding);
+  }
+  capture.lastEncoded = index;
+  return true;
+}
+
+// Starts encoders for finished readbacks, oldest first, stopping at the
+// first one still in flight so ordered output stays in order.
+void startFinishedEncoding(FrameCapture& capture, bool wait)
+{
+  for (int i = 0; i < kCaptureSlots; ++i)
+  {
+    const int index = (capture.next + i) % kCaptureSlots;
+    if (capture.slots[index].fence && !startEncoding(capture, index, wait)) return;
+  }
+}
+
+// Reads the frame into the next slot, waiting for the slot if its encoder is
+// behind, and returns the slot.
+FrameCapture::Slot& readIntoNextSlot(FrameCapture& capture, GLuint framebuffer, int frame)
+{
+  startFinishedEncoding(capture, false);
+
+  FrameCapture::Slot& slot = capture.slots[capture.next];
+  if (slot.fence || slot.encoding.state.load() != 0)
+  {
+    // Encoders are a full ring behind.
+    ++capture.stalls;
+    if (slot.fence) startFinishedEncoding(capture, true);
+    waitForCounter(slot.encoding);
+  }
+
+  glNamedFramebufferReadBuffer(framebuffer, framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frame = frame;
+  capture.next = (capture.next + 1) % kCaptureSlots;
+  ++capture.captured;
+  return slot;
+}
+
+}
+
+bool createFrameCapture(FrameCapture& capture, const std::string& path, int width, int height, int fps)
+{
+  capture.format = isY4mPath(path) ? CaptureFormat::Y4m : CaptureFormat::Image;
+  std::string expanded;
+  if (capture.format == CaptureFormat::Image && !expandFramePattern(path, 0, expanded))
+  {
+    std::printf("%s may hold one %%d frame number and no other %% conversion\n", path.c_str());
+    return false;
+  }
+  capture.path = path;
+  capture.width = width;
+  capture.height = height;
+  // Files named per frame are independent; so are the files of a pattern.
+  capture.ordered = capture.format == CaptureFormat::Y4m || (!path.empty() && path.find('%') == std::string::npos);
+
+  if (capture.format == CaptureFormat::Y4m)
+  {
+    capture.stream = std::fopen(path.c_str(), "wb");
+    if (!capture.stream)
+    {
+      std::printf("Unable to open %s\n", path.c_str());
+      return false;
+    }
+    std::fprintf(capture.stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+  }
+
+  const GLsizeiptr bytes = static_cast<GLsizeiptr>(width) * height * 4;
+  for (FrameCapture::Slot& slot : capture.slots)
+  {
+    glCreateBuffers(1, &slot.buffer);
+    glNamedBufferStorage(slot.buffer, bytes, nullptr, kMapFlags);
+    slot.pixels = static_cast<const unsigned char*>(glMapNamedBufferRange(slot.buffer, 0, bytes, kMapFlags));
+    if (!slot.pixels)
+    {
+      std::printf("Unable to map a %dx%d capture buffer\n", width, height);
+      destroyFrameCapture(capture);
+      return false;
+    }
+    if (capture.format == CaptureFormat::Y4m) slot.yuv.resize(static_cast<size_t>(width) * height + 2 * chromaSize(capture));
+  }
+  return true;
+}
+
+void captureFrame(FrameCapture& capture, GLuint framebuffer, int frame)
+{
+  FrameCapture::Slot& slot = readIntoNextSlot(capture, framebuffer, frame);
+  if (capture.format == CaptureFormat::Image)
+  {
+    // createFrameCapture() checked the pattern.
+    expandFramePattern(capture.path, frame, slot.path);
+  }
+}
+
+void captureFrameTo(FrameCapture& capture, GLuint framebuffer, const std::string& path)
+{
+  readIntoNextSlot(capture, framebuffer, capture.captured).path = path;
+}
+
+bool destroyFrameCapture(FrameCapture& capture)
+{
+  startFinishedEncoding(capture, true);
+  for (FrameCapture::Slot& slot : capture.slots)
+  {
+    waitForCounter(slot.encoding);
+    if (slot.pixels) glUnmapNamedBuffer(slot.buffer);
+    if (slot.buffer) glDeleteBuffers(1, &slot.buffer);
+    slot.buffer = 0;
+    slot.pixels = nullptr;
+  }
+  if (capture.stream && std::fclose(capture.stream) != 0) capture.failed = true;
+  capture.stream = nullptr;
+  if (capture.captured > 0)
+  {
+    std::printf("Captured %d frames to %s, %d stalls\n", capture.written.load(),
+                capture.path.empty() ? "their own files" : capture.path.c_str(), capture.stalls);
+  }
+  return !capture.failed;
+}
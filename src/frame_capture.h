@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "image_encode.h"
+#include "parallel.h"
+
+// Framebuffer capture that never waits for the GPU or an encoder. Each frame
+// is read with glReadPixels into a persistently mapped pixel buffer from a
+// small ring, and a fence marks when the copy lands. A later captureFrame()
+// call hands buffers whose fence has signalled to an encoder job, and a
+// buffer is reused once its job is done. Rendering only waits when encoders
+// fall a whole ring behind, which is counted in stalls.
+//
+// A .y4m path writes one YUV 4:2:0 stream, which video tools read directly
+// (ffmpeg -i turntable.y4m turntable.mp4). Other paths are written as images
+// through writeImage(), QOI for .qoi and PNG otherwise; a printf pattern
+// such as "frame_%04d.png" writes one file per frame. With an empty path
+// every frame names its own file through captureFrameTo().
+
+const int kCaptureSlots = 4;
+
+enum class CaptureFormat {
+  Image,
+  Y4m,
+};
+
+struct FrameCapture {
+  struct Slot {
+    GLuint buffer = 0;
+    const unsigned char* pixels = nullptr;
+    // Set while the readback may still be in flight.
+    GLsync fence = nullptr;
+    int frame = 0;
+    // Image file the frame goes to.
+    std::string path;
+    // Pending encoder job; the buffer is free again once this reaches zero.
+    JobCounter encoding;
+    // Y4M planes, converted by the encoder job.
+    std::vector<unsigned char> yuv;
+  };
+
+  CaptureFormat format = CaptureFormat::Image;
+  std::string path;
+  // zlib level for PNG output; may be changed before the first capture.
+  int pngLevel = kDefaultPngLevel;
+  int width = 0;
+  int height = 0;
+  // Frames must be written in capture order: a stream, or a single file
+  // that the last frame should win.
+  bool ordered = false;
+  Slot slots[kCaptureSlots];
+  // Slot the next frame is read into; slots fill and drain in ring order.
+  int next = 0;
+  // Slot of the most recently submitted encoder job, or -1.
+  int lastEncoded = -1;
+  std::FILE* stream = nullptr;
+  int captured = 0;
+  int stalls = 0;
+  std::atomic<int> written {0};
+  std::atomic<bool> failed {false};
+};
+
+// Allocates the pixel buffers for width x height frames and, for Y4M, opens
+// the stream. fps is only recorded in the Y4M header.
+bool createFrameCapture(FrameCapture& capture, const std::string& path, int width, int height, int fps);
+
+// Queues a readback of the color buffer of framebuffer (0 for the window's
+// back buffer, so call before swapping) and starts encoders for earlier
+// frames whose readback has finished. frame numbers an image pattern.
+void captureFrame(FrameCapture& capture, GLuint framebuffer, int frame);
+
+// captureFrame() for a capture created with an empty path: the frame is
+// written to path, in whichever image format its extension picks.
+void captureFrameTo(FrameCapture& capture, GLuint framebuffer, const std::string& path);
+
+// Waits for every queued frame to be encoded and written, then frees the
+// buffers. Returns false if any frame failed to write.
+bool destroyFrameCapture(FrameCapture& capture);
@@ -0,0 +1,110 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+
+namespace {
+
+// Logs a finished frame and frees its fence.
+void retire(FramePacer& pacer, int slot)
+{
+  const double completed = pacer.clock();
+  glDeleteSync(pacer.fences[slot]);
+  pacer.fences[slot] = nullptr;
+
+  const FrameTimes& times = pacer.times[slot];
+  const double latencyMs = (completed - times.input) * 1000.0;
+  if (times.input >= 0.0)
+  {
+    ++pacer.latencyFrames;
+    pacer.latencySum += latencyMs;
+    pacer.latencyMax = std::max(pacer.latencyMax, latencyMs);
+  }
+  if (pacer.log)
+  {
+    std::fprintf(pacer.log, "%llu,%.6f,%.6f,%.6f,%.6f,%.6f,", static_cast<unsigned long long>(pacer.frames[slot]),
+                 times.input, times.sampled, times.submitted, times.presented, completed);
+    if (times.input >= 0.0) std::fprintf(pacer.log, "%.3f", latencyMs);
+    std::fputc('\n', pacer.log);
+  }
+}
+
+// Retires the oldest queued frames for as long as they have finished; with
+// wait set, blocks until the frame in slot has.
+void retireFinished(FramePacer& pacer, int slot, bool wait)
+{
+  const int count = pacer.framesInFlight;
+  for (int i = 0; i < count; ++i)
+  {
+    // Oldest first: the slot about to be reused, then the newer frames.
+    const int oldest = static_cast<int>((pacer.submitted + i) % count);
+    if (!pacer.fences[oldest]) continue;
+    const bool mustWait = wait && oldest == slot;
+    const GLenum status = glClientWaitSync(pacer.fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                           mustWait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED) return;
+    retire(pacer, oldest);
+  }
+}
+
+}
+
+bool createFramePacer(FramePacer& pacer, int framesInFlight, double (*clock)(), const std::string& logPath)
+{
+  pacer = FramePacer{};
+  pacer.framesInFlight = std::clamp(framesInFlight, 1, kMaxFramesInFlight);
+  pacer.clock = clock;
+  if (logPath.empty()) return true;
+
+  pacer.log = std::fopen(logPath.c_str(), "w");
+  if (!pacer.log)
+  {
+    std::printf("Unable to open latency log %s\n", logPath.c_str());
+    return false;
+  }
+  std::fprintf(pacer.log, "frame,input,sampled,submitted,presented,completed,latency_ms\n");
+  return true;
+}
+
+void waitForFrameSlot(FramePacer& pacer)
+{
+  retireFinished(pacer, static_cast<int>(pacer.submitted % pacer.framesInFlight), true);
+}
+
+void endFrame(FramePacer& pacer, const FrameTimes& times)
+{
+  const int slot = static_cast<int>(pacer.submitted % pacer.framesInFlight);
+  if (pacer.fences[slot])
+  {
+    // waitForFrameSlot() was skipped; keep the limit anyway.
+    ++pacer.lateWaits;
+    glClientWaitSync(pacer.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    retire(pacer, slot);
+  }
+  pacer.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  pacer.times[slot] = times;
+  pacer.frames[slot] = pacer.submitted++;
+}
+
+void destroyFramePacer(FramePacer& pacer)
+{
+  for (int i = 0; i < pacer.framesInFlight; ++i)
+  {
+    const int slot = static_cast<int>((pacer.submitted + i) % pacer.framesInFlight);
+    if (!pacer.fences[slot]) continue;
+    glClientWaitSync(pacer.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    retire(pacer, slot);
+  }
+  if (pacer.latencyFrames > 0)
+  {
+    std::printf("Input to GPU completion: mean %.2f ms, max %.2f ms over %llu frames (%d in flight)\n",
+                pacer.latencySum / pacer.latencyFrames, pacer.latencyMax,
+                static_cast<unsigned long long>(pacer.latencyFrames), pacer.framesInFlight);
+  }
+  if (pacer.lateWaits > 0)
+  {
+    std::printf("%llu frames waited for a slot after building, not before sampling input\n",
+                static_cast<unsigned long long>(pacer.lateWaits));
+  }
+  if (pacer.log) std::fclose(pacer.log);
+  pacer.log = nullptr;
+}
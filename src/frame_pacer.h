@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <glad/gl.h>
+
+// Bounds how many frames the driver may queue, with a fence per frame, and
+// logs when each frame's input arrived, was sampled, submitted, presented
+// and finished on the GPU. Waiting for a frame slot before polling input
+// keeps the input a frame is built from as fresh as the limit allows.
+
+const int kMaxFramesInFlight = 3;
+
+// Seconds on the caller's clock; input is negative when the frame consumed
+// no input event.
+struct FrameTimes {
+  double input = -1.0;
+  double sampled = 0.0;
+  double submitted = 0.0;
+  double presented = 0.0;
+};
+
+struct FramePacer {
+  // Frames queued or being built at once, 1 to kMaxFramesInFlight.
+  int framesInFlight = 2;
+  double (*clock)() = nullptr;
+  GLsync fences[kMaxFramesInFlight] = {};
+  FrameTimes times[kMaxFramesInFlight];
+  uint64_t frames[kMaxFramesInFlight] = {};
+  uint64_t submitted = 0;
+  std::FILE* log = nullptr;
+  // Input-to-GPU-completion latency over the frames that had input.
+  uint64_t latencyFrames = 0;
+  double latencySum = 0.0;
+  double latencyMax = 0.0;
+  // Frames whose slot was still busy at endFrame(), so waitForFrameSlot()
+  // was skipped or did not wait; 0 when pacing works as intended.
+  uint64_t lateWaits = 0;
+};
+
+// clock timestamps GPU completion and must match the FrameTimes clock, e.g.
+// glfwGetTime. logPath may be empty. Returns false if the log cannot be
+// opened.
+bool createFramePacer(FramePacer& pacer, int framesInFlight, double (*clock)(), const std::string& logPath);
+
+// Retires finished frames and blocks until fewer than framesInFlight frames
+// are queued. Call before sampling input for the next frame.
+void waitForFrameSlot(FramePacer& pacer);
+
+// Fences the frame just presented.
+void endFrame(FramePacer& pacer, const FrameTimes& times);
+
+// Waits for every queued frame, prints the latency summary and closes the log.
+void destroyFramePacer(FramePacer& pacer);
@@ -0,0 +1,346 @@
+#include "gltf_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t readLe32(const unsigned char* p)
+{
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+         static_cast<uint32_t>(p[3]) << 24;
+}
+
+bool readAt(int fd, uint64_t offset, void* dest, uint64_t size, uint64_t& bytesRead)
+{
+  bytesRead += size;
+  unsigned char* p = static_cast<unsigned char*>(dest);
+  while (size > 0)
+  {
+    const ssize_t n = pread(fd, p, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    offset += static_cast<uint64_t>(n);
+    size -= static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+// Whether [offset, offset + size) lies within total bytes, without the sum
+// overflowing.
+bool rangeFits(uint64_t offset, uint64_t size, uint64_t total)
+{
+  return size <= total && offset <= total - size;
+}
+
+int base64Value(char c)
+{
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+// Decodes bytes [offset, offset + size) of base64 text, starting at the
+// four-character group that holds offset. False if the text ends first.
+bool decodeBase64Range(const char* text, size_t length, uint64_t offset, uint64_t size, std::vector<unsigned char>& out)
+{
+  out.clear();
+  out.reserve(size);
+  uint64_t skip = offset % 3;
+  for (uint64_t i = offset / 3 * 4; i + 1 < length && out.size() < size; i += 4)
+  {
+    int values[4] = { -1, -1, -1, -1 };
+    for (int k = 0; k < 4 && i + k < length; ++k) values[k] = base64Value(text[i + k]);
+    if (values[0] < 0 || values[1] < 0) break;
+    const unsigned char bytes[3] = {
+      static_cast<unsigned char>(values[0] << 2 | values[1] >> 4),
+      static_cast<unsigned char>((values[1] & 15) << 4 | std::max(values[2], 0) >> 2),
+      static_cast<unsigned char>((std::max(values[2], 0) & 3) << 6 | std::max(values[3], 0)),
+    };
+    // '=' padding, or the end of the text, cuts the last group short.
+    const int count = values[2] < 0 ? 1 : values[3] < 0 ? 2 : 3;
+    for (int k = 0; k < count && out.size() < size; ++k)
+    {
+      if (skip > 0) --skip;
+      else out.push_back(bytes[k]);
+    }
+    if (count < 3) break;
+  }
+  return out.size() == size;
+}
+
+// Decoded size of a base64 data: URI's payload.
+uint64_t base64Bytes(const std::string& uri, size_t payload)
+{
+  size_t end = uri.size();
+  while (end > payload && uri[end - 1] == '=') --end;
+  return static_cast<uint64_t>(end - payload) * 3 / 4;
+}
+
+// Start of the payload of a base64 data: URI, or npos for other URIs.
+size_t base64Payload(const std::string& uri)
+{
+  if (uri.compare(0, 5, "data:") != 0) return std::string::npos;
+  const size_t comma = uri.find(',');
+  if (comma == std::string::npos || comma < 7 || uri.compare(comma - 7, 7, ";base64") != 0) return std::string::npos;
+  return comma + 1;
+}
+
+const nlohmann::json* findElement(const nlohmann::json& json, const char* array, int index)
+{
+  if (!json.contains(array) || !json[array].is_array() || index < 0 || static_cast<size_t>(index) >= json[array].size())
+  {
+    return nullptr;
+  }
+  return &json[array][index];
+}
+
+}
+
+std::string decodeUri(const std::string& uri)
+{
+  auto hex = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  std::string decoded;
+  decoded.reserve(uri.size());
+  for (size_t i = 0; i < uri.size(); ++i)
+  {
+    if (uri[i] == '%' && i + 2 < uri.size() && hex(uri[i + 1]) >= 0 && hex(uri[i + 2]) >= 0)
+    {
+      decoded.push_back(static_cast<char>(hex(uri[i + 1]) * 16 + hex(uri[i + 2])));
+      i += 2;
+    }
+    else
+    {
+      decoded.push_back(uri[i]);
+    }
+  }
+  return decoded;
+}
+
+bool openGltfFile(GltfFile& file, const std::string& path, std::string& error)
+{
+  closeGltfFile(file);
+  file.path = path;
+  const size_t slash = path.find_last_of("/\\");
+  file.baseDir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+  auto fail = [&](const std::string& message) {
+    error = message;
+    closeGltfFile(file);
+    return false;
+  };
+
+  file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (file.fd < 0 || fstat(file.fd, &info) != 0) return fail("unable to open " + path);
+  file.fileBytes = static_cast<uint64_t>(info.st_size);
+
+  std::string text;
+  unsigned char header[20];
+  if (file.fileBytes >= 12 && readAt(file.fd, 0, header, 12, file.bytesRead) && readLe32(header) == kGlbMagic)
+  {
+    if (file.fileBytes < 20 || !readAt(file.fd, 12, header + 12, 8, file.bytesRead) || readLe32(header + 16) != kGlbChunkJson)
+    {
+      return fail("GLB without a JSON chunk");
+    }
+    const uint64_t jsonBytes = readLe32(header + 12);
+    if (20 + jsonBytes > file.fileBytes) return fail("GLB JSON chunk runs past the end of the file");
+    text.resize(jsonBytes);
+    if (!readAt(file.fd, 20, text.data(), jsonBytes, file.bytesRead)) return fail("unable to read " + path);
+
+    // Chunks start on 4-byte boundaries.
+    const uint64_t binChunk = 20 + (jsonBytes + 3) / 4 * 4;
+    unsigned char chunk[8];
+    if (binChunk + 8 <= file.fileBytes && readAt(file.fd, binChunk, chunk, 8, file.bytesRead) && readLe32(chunk + 4) == kGlbChunkBin)
+    {
+      file.hasBinChunk = true;
+      file.binOffset = binChunk + 8;
+      file.binBytes = readLe32(chunk);
+    }
+  }
+  else
+  {
+    text.resize(file.fileBytes);
+    if (!readAt(file.fd, 0, text.data(), file.fileBytes, file.bytesRead)) return fail("unable to read " + path);
+  }
+
+  file.json = nlohmann::json::parse(text, nullptr, false);
+  if (file.json.is_discarded() || !file.json.is_object()) return fail("invalid glTF JSON");
+  if (file.json.contains("buffers") && file.json["buffers"].is_array()) file.bufferFds.assign(file.json["buffers"].size(), -1);
+  return true;
+}
+
+void closeGltfFile(GltfFile& file)
+{
+  if (file.fd >= 0) close(file.fd);
+  for (int fd : file.bufferFds)
+  {
+    if (fd >= 0) close(fd);
+  }
+  file = GltfFile{};
+}
+
+bool readBufferRange(GltfFile& file, int buffer, uint64_t offset, uint64_t size, std::vector<unsigned char>& out,
+                     std::string& error)
+{
+  const nlohmann::json* source = findElement(file.json, "buffers", buffer);
+  if (!source || !source->is_object())
+  {
+    error = "no buffer " + std::to_string(buffer);
+    return false;
+  }
+
+  if (!source->contains("uri"))
+  {
+    if (buffer != 0 || !file.hasBinChunk)
+    {
+      error = "buffer " + std::to_string(buffer) + " has no data";
+      return false;
+    }
+    if (!rangeFits(offset, size, file.binBytes))
+    {
+      error = "range past the end of the GLB binary chunk";
+      return false;
+    }
+    out.resize(size);
+    if (!readAt(file.fd, file.binOffset + offset, out.data(), size, file.bytesRead))
+    {
+      error = "unable to read the GLB binary chunk";
+      return false;
+    }
+    return true;
+  }
+
+  if (!(*source)["uri"].is_string())
+  {
+    error = "buffer " + std::to_string(buffer) + " has an invalid uri";
+    return false;
+  }
+  const std::string& uri = (*source)["uri"].get_ref<const std::string&>();
+  const size_t payload = base64Payload(uri);
+  if (payload != std::string::npos)
+  {
+    if (!rangeFits(offset, size, base64Bytes(uri, payload)) ||
+        !decodeBase64Range(uri.data() + payload, uri.size() - payload, offset, size, out))
+    {
+      error = "range past the end of buffer " + std::to_string(buffer);
+      return false;
+    }
+    return true;
+  }
+  if (uri.compare(0, 5, "data:") == 0)
+  {
+    error = "buffer " + std::to_string(buffer) + " is a data: URI that is not base64";
+    return false;
+  }
+
+  int& fd = file.bufferFds[buffer];
+  const std::string path = file.baseDir + decodeUri(uri);
+  if (fd < 0) fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0)
+  {
+    error = "unable to open " + path;
+    return false;
+  }
+  if (!rangeFits(offset, size, static_cast<uint64_t>(info.st_size)))
+  {
+    error = "range past the end of " + path;
+    return false;
+  }
+  out.resize(size);
+  if (!readAt(fd, offset, out.data(), size, file.bytesRead))
+  {
+    error = "unable to read " + std::to_string(size) + " bytes at " + std::to_string(offset) + " of " + path;
+    return false;
+  }
+  return true;
+}
+
+bool readBufferView(const nlohmann::json& view, int& buffer, uint64_t& offset, uint64_t& length)
+{
+  if (!view.is_object() || !view.contains("buffer") || !view.contains("byteLength")) return false;
+  const nlohmann::json& bufferValue = view["buffer"];
+  const nlohmann::json& lengthValue = view["byteLength"];
+  if (!bufferValue.is_number_unsigned() || bufferValue.get<uint64_t>() > INT_MAX || !lengthValue.is_number_unsigned()) return false;
+  offset = 0;
+  if (view.contains("byteOffset"))
+  {
+    if (!view["byteOffset"].is_number_unsigned()) return false;
+    offset = view["byteOffset"].get<uint64_t>();
+  }
+  buffer = bufferValue.get<int>();
+  length = lengthValue.get<uint64_t>();
+  return true;
+}
+
+bool readImagePrefix(GltfFile& file, int image, uint64_t maxBytes, std::vector<unsigned char>& out, uint64_t& total,
+                     std::string& error)
+{
+  const nlohmann::json* source = findElement(file.json, "images", image);
+  if (!source || !source->is_object())
+  {
+    error = "no image " + std::to_string(image);
+    return false;
+  }
+
+  if (source->contains("bufferView"))
+  {
+    const nlohmann::json* view =
+      (*source)["bufferView"].is_number_integer() ? findElement(file.json, "bufferViews", (*source)["bufferView"].get<int>()) : nullptr;
+    int buffer;
+    uint64_t offset;
+    if (!view || !readBufferView(*view, buffer, offset, total))
+    {
+      error = "image " + std::to_string(image) + " has an invalid bufferView";
+      return false;
+    }
+    return readBufferRange(file, buffer, offset, std::min(total, maxBytes), out, error);
+  }
+
+  if (!source->contains("uri") || !(*source)["uri"].is_string())
+  {
+    error = "image " + std::to_string(image) + " has no data";
+    return false;
+  }
+  const std::string& uri = (*source)["uri"].get_ref<const std::string&>();
+  const size_t payload = base64Payload(uri);
+  if (payload != std::string::npos)
+  {
+    total = base64Bytes(uri, payload);
+    if (!decodeBase64Range(uri.data() + payload, uri.size() - payload, 0, std::min(total, maxBytes), out))
+    {
+      error = "image " + std::to_string(image) + " has invalid base64 data";
+      return false;
+    }
+    return true;
+  }
+
+  const std::string path = file.baseDir + decodeUri(uri);
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  bool read = fd >= 0 && fstat(fd, &info) == 0;
+  if (read)
+  {
+    total = static_cast<uint64_t>(info.st_size);
+    out.resize(std::min(total, maxBytes));
+    read = readAt(fd, 0, out.data(), out.size(), file.bytesRead);
+  }
+  if (fd >= 0) close(fd);
+  if (!read) error = "unable to read " + path;
+  return read;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+// A .gltf or .glb opened for range reads: only the JSON is read and parsed
+// up front, while the GLB binary chunk, external .bin files and images stay
+// on disk until some byte range of them is asked for. GLB is recognized by
+// its magic, not the extension.
+
+const uint32_t kGlbMagic = 0x46546C67;  // "glTF"
+const uint32_t kGlbChunkJson = 0x4E4F534A;
+const uint32_t kGlbChunkBin = 0x004E4942;
+
+struct GltfFile {
+  std::string path;
+  // Directory external URIs are relative to, with a trailing slash.
+  std::string baseDir;
+  int fd = -1;
+  uint64_t fileBytes = 0;
+  nlohmann::json json;
+  // The GLB binary chunk, which buffer 0 refers to when it has no uri.
+  bool hasBinChunk = false;
+  uint64_t binOffset = 0;
+  uint64_t binBytes = 0;
+  // Descriptors of external buffer files, opened on first read; -1 until then.
+  std::vector<int> bufferFds;
+  // Bytes read from disk so far, JSON included.
+  uint64_t bytesRead = 0;
+};
+
+// Reads the header and JSON. error says what is wrong on failure.
+bool openGltfFile(GltfFile& file, const std::string& path, std::string& error);
+void closeGltfFile(GltfFile& file);
+
+// Replaces out with bytes [offset, offset + size) of buffer, wherever it
+// lives: the GLB binary chunk, an external file or a base64 data: URI, of
+// which only the part covering the range is decoded.
+bool readBufferRange(GltfFile& file, int buffer, uint64_t offset, uint64_t size, std::vector<unsigned char>& out,
+                     std::string& error);
+
+// Replaces out with up to maxBytes from the start of image's encoded data,
+// from its buffer view or URI. total is set to the full encoded size.
+bool readImagePrefix(GltfFile& file, int image, uint64_t maxBytes, std::vector<unsigned char>& out, uint64_t& total,
+                     std::string& error);
+
+// Reads a bufferView's buffer, byteOffset (default 0) and byteLength. False
+// when view is not an object or any of them is missing or not a
+// non-negative integer, so malformed JSON is reported instead of throwing.
+bool readBufferView(const nlohmann::json& view, int& buffer, uint64_t& offset, uint64_t& length);
+
+// Decodes %XX escapes in a relative URI, as tinygltf does before opening it.
+std::string decodeUri(const std::string& uri);
@@ -0,0 +1,244 @@
+#include "headless.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <EGL/eglext.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "alloc_stats.h"
+#include "asset_pipeline.h"
+#include "camera.h"
+#include "frame_capture.h"
+#include "input.h"
+#include "renderer.h"
+
+bool createHeadlessContext(HeadlessContext& ctx)
+{
+  auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (getPlatformDisplay)
+  {
+    ctx.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (ctx.display == EGL_NO_DISPLAY)
+  {
+    ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLint major, minor;
+  if (ctx.display == EGL_NO_DISPLAY || !eglInitialize(ctx.display, &major, &minor))
+  {
+    std::printf("Failed to initialize EGL display (0x%x)\n", eglGetError());
+    return false;
+  }
+  std::printf("EGL %d.%d\n", major, minor);
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    std::printf("EGL has no desktop OpenGL support\n");
+    eglTerminate(ctx.display);
+    return false;
+  }
+
+  // 4.5 core is the lowest version with the DSA entry points the renderer uses,
+  // and the highest llvmpipe exposes.
+  const EGLint attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 5,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  ctx.context = eglCreateContext(ctx.display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+  if (ctx.context == EGL_NO_CONTEXT)
+  {
+    std::printf("Failed to create EGL context (0x%x)\n", eglGetError());
+    eglTerminate(ctx.display);
+    return false;
+  }
+
+  if (!eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context))
+  {
+    std::printf("Failed to make EGL context current (0x%x)\n", eglGetError());
+    destroyHeadlessContext(ctx);
+    return false;
+  }
+
+  return true;
+}
+
+void destroyHeadlessContext(HeadlessContext& ctx)
+{
+  if (ctx.display == EGL_NO_DISPLAY) return;
+  eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (ctx.context != EGL_NO_CONTEXT) eglDestroyContext(ctx.display, ctx.context);
+  eglTerminate(ctx.display);
+  ctx = HeadlessContext{};
+}
+
+bool createFramebuffer(Framebuffer& fb, int width, int height)
+{
+  fb.width = width;
+  fb.height = height;
+
+  glCreateRenderbuffers(1, &fb.color);
+  glNamedRenderbufferStorage(fb.color, GL_RGBA8, width, height);
+  glCreateRenderbuffers(1, &fb.depth);
+  glNamedRenderbufferStorage(fb.depth, GL_DEPTH_COMPONENT24, width, height);
+
+  glCreateFramebuffers(1, &fb.fbo);
+  glNamedFramebufferRenderbuffer(fb.fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fb.color);
+  glNamedFramebufferRenderbuffer(fb.fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, fb.depth);
+
+  const GLenum status = glCheckNamedFramebufferStatus(fb.fbo, GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::printf("Framebuffer incomplete (0x%x)\n", status);
+    destroyFramebuffer(fb);
+    return false;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
+  glViewport(0, 0, width, height);
+  return true;
+}
+
+void destroyFramebuffer(Framebuffer& fb)
+{
+  glDeleteFramebuffers(1, &fb.fbo);
+  glDeleteRenderbuffers(1, &fb.color);
+  glDeleteRenderbuffers(1, &fb.depth);
+  fb = Framebuffer{};
+}
+
+int runHeadless(const HeadlessOptions& options)
+{
+  HeadlessContext ctx;
+  if (!createHeadlessContext(ctx))
+  {
+    return -1;
+  }
+
+  auto version = gladLoadGL(eglGetProcAddress);
+  if (!version)
+  {
+    std::printf("Failed to initialize OpenGL context\n" );
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  std::printf("GL %d.%d %s\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version), glGetString(GL_RENDERER));
+  enableDebugOutput();
+
+  Renderer renderer;
+  RuntimeScene scene;
+  Framebuffer fb;
+  if (!runUntilComplete(loadRuntimeSceneAsync(scene, options.modelPath, options.subset)) || !createRenderer(renderer) || !createFramebuffer(fb, options.width, options.height))
+  {
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+
+  Camera camera = makeDefaultCamera();
+
+  glm::mat4 proj = glm::perspectiveRH(45.0f, options.width / (float)options.height, 1.0f, 100.0f);
+  InputReplay replay;
+  MouseState oldMouseState;
+  std::vector<AnimationInstance> animations;
+  if (!scene.animations.empty()) startAnimation(animations, scene.animations, 0);
+  int frames = options.frames;
+  if (!options.replayPath.empty())
+  {
+    if (!loadInputReplay(replay, options.replayPath))
+    {
+      destroyHeadlessContext(ctx);
+      return -1;
+    }
+    frames = static_cast<int>(replay.frames);
+  }
+
+  // Timestamp pairs rather than GL_TIME_ELAPSED: llvmpipe reports garbage for
+  // an elapsed query that begins before the first draw of the context.
+  GLuint timers[2];
+  glCreateQueries(GL_TIMESTAMP, 2, timers);
+
+  FrameArena frameArena;
+  createFrameArena(frameArena, kFrameArenaBytes);
+  VisibilityCache visibility;
+
+  FrameCapture capture;
+  if (!createFrameCapture(capture, options.outputPath, options.width, options.height, 60))
+  {
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  capture.pngLevel = options.pngLevel;
+  const bool perFrameOutput = options.outputPath.find('%') != std::string::npos || capture.format == CaptureFormat::Y4m;
+  double cpuTotal = 0.0;
+  double gpuTotal = 0.0;
+  uint64_t steadyAllocations = 0;
+  int result = 0;
+
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    // Without a replay, animations step a fixed 60 Hz from the rest pose.
+    double deltaSeconds = frame > 0 ? 1.0 / 60.0 : 0.0;
+    if (!options.replayPath.empty() && replayNextFrame(replay, deltaSeconds))
+    {
+      updateCamera(camera, deltaSeconds, mouseState, oldMouseState, cameraMovement);
+    }
+    const glm::mat4 view = getViewMatrix(camera);
+
+    const AllocationStats allocationsBefore = allocationStats();
+    const auto start = std::chrono::steady_clock::now();
+    beginArenaFrame(frameArena, frame);
+    animateScene(animations, scene.animations, scene.graph, deltaSeconds);
+    updateVisibility(visibility, scene, view, proj);
+    glQueryCounter(timers[0], GL_TIMESTAMP);
+    drawFrame(renderer, proj * view, scene, visibility, frameArena);
+    glQueryCounter(timers[1], GL_TIMESTAMP);
+    glFinish();
+    const auto end = std::chrono::steady_clock::now();
+    const AllocationStats allocations = allocationsSince(allocationsBefore);
+    // The first frames size the reused buffers and every arena slot; later
+    // ones should not allocate.
+    if (frame > kFrameArenaSlots) steadyAllocations += allocations.count;
+
+    GLuint64 gpuStart = 0, gpuEnd = 0;
+    glGetQueryObjectui64v(timers[0], GL_QUERY_RESULT, &gpuStart);
+    glGetQueryObjectui64v(timers[1], GL_QUERY_RESULT, &gpuEnd);
+    const GLuint64 gpuNs = gpuEnd - gpuStart;
+    const double cpuMs = std::chrono::duration<double, std::milli>(end - start).count();
+    const double gpuMs = gpuNs / 1.0e6;
+    cpuTotal += cpuMs;
+    gpuTotal += gpuMs;
+    std::printf("frame %d: cpu %.3f ms, gpu %.3f ms, %llu allocations (%llu bytes)\n", frame, cpuMs, gpuMs,
+                (unsigned long long)allocations.count, (unsigned long long)allocations.bytes);
+
+    if (perFrameOutput || frame == frames - 1)
+    {
+      captureFrame(capture, fb.fbo, frame);
+    }
+    if (capture.failed)
+    {
+      result = -1;
+      break;
+    }
+  }
+
+  if (frames > 0)
+  {
+    std::printf("%d frames: avg cpu %.3f ms, avg gpu %.3f ms\n", frames, cpuTotal / frames, gpuTotal / frames);
+    std::printf("%llu allocations after the first %d frames, frame arena peak %zu bytes\n",
+                (unsigned long long)steadyAllocations, kFrameArenaSlots + 1, frameArena.highWater);
+  }
+
+  if (!destroyFrameCapture(capture)) result = -1;
+  glDeleteQueries(2, timers);
+  destroyFramebuffer(fb);
+  destroyRenderer(renderer);
+  destroyRuntimeScene(scene);
+  destroyHeadlessContext(ctx);
+  return result;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+
+#include <EGL/egl.h>
+
+#include <glad/gl.h>
+
+#include "image_encode.h"
+#include "model_subset.h"
+
+// A surfaceless EGL context (EGL_MESA_platform_surfaceless), so rendering
+// works without a display server, e.g. on Mesa llvmpipe.
+struct HeadlessContext {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+};
+
+// Offscreen render target; with no default framebuffer everything draws here.
+struct Framebuffer {
+  GLuint fbo = 0;
+  GLuint color = 0;
+  GLuint depth = 0;
+  int width = 0;
+  int height = 0;
+};
+
+struct HeadlessOptions {
+  std::string modelPath;
+  // Part of the model to load; all of it by default.
+  ModelSubset subset;
+  // Written through FrameCapture: PNG, or QOI for .qoi. A printf pattern
+  // such as "out_%03d.png" or a .y4m stream gets every frame, otherwise
+  // only the last frame is written.
+  std::string outputPath = "out.png";
+  int frames = 1;
+  // zlib level for PNG output, 0 to 9.
+  int pngLevel = kDefaultPngLevel;
+  int width = 800;
+  int height = 600;
+  // Render on the CPU with the software rasterizer instead of EGL.
+  bool software = false;
+  // Input recording to replay; its frame count replaces frames.
+  std::string replayPath;
+  // Worker processes for sort-last rendering (see sort_last.h); 0 renders
+  // in this process.
+  int sortLastWorkers = 0;
+};
+
+bool createHeadlessContext(HeadlessContext& ctx);
+void destroyHeadlessContext(HeadlessContext& ctx);
+
+bool createFramebuffer(Framebuffer& fb, int width, int height);
+void destroyFramebuffer(Framebuffer& fb);
+
+int runHeadless(const HeadlessOptions& options);
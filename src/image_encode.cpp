@@ -0,0 +1,396 @@
+#include "image_encode.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "parallel.h"
+
+namespace {
+
+// Raw bytes per deflate chunk: large enough that the sync flush and lost
+// matches at chunk starts cost little, small enough that a 4K frame gives
+// every worker plenty of chunks.
+const size_t kPngChunkBytes = 256 * 1024;
+const size_t kDeflateWindow = 32 * 1024;
+
+void putBigEndian32(unsigned char* out, uint32_t value)
+{
+  out[0] = static_cast<unsigned char>(value >> 24);
+  out[1] = static_cast<unsigned char>(value >> 16);
+  out[2] = static_cast<unsigned char>(value >> 8);
+  out[3] = static_cast<unsigned char>(value);
+}
+
+void appendBigEndian32(std::vector<unsigned char>& out, uint32_t value)
+{
+  unsigned char bytes[4];
+  putBigEndian32(bytes, value);
+  out.insert(out.end(), bytes, bytes + 4);
+}
+
+void appendPngChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+{
+  appendBigEndian32(out, static_cast<uint32_t>(size));
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+  uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+  crc = crc32(crc, data, static_cast<uInt>(size));
+  appendBigEndian32(out, static_cast<uint32_t>(crc));
+}
+
+unsigned char paeth(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+  return static_cast<unsigned char>(pb <= pc ? b : c);
+}
+
+// Applies PNG filter type filter to row; above is the previous row, or
+// zeros for the first.
+void applyFilter(int filter, unsigned char* out, const unsigned char* row, const unsigned char* above, size_t rowBytes,
+                 size_t comp)
+{
+  const size_t first = std::min(comp, rowBytes);
+  switch (filter)
+  {
+    case 0:
+      std::memcpy(out, row, rowBytes);
+      break;
+    case 1:
+      std::memcpy(out, row, first);
+      for (size_t i = first; i < rowBytes; ++i) out[i] = static_cast<unsigned char>(row[i] - row[i - comp]);
+      break;
+    case 2:
+      for (size_t i = 0; i < rowBytes; ++i) out[i] = static_cast<unsigned char>(row[i] - above[i]);
+      break;
+    case 3:
+      for (size_t i = 0; i < first; ++i) out[i] = static_cast<unsigned char>(row[i] - (above[i] >> 1));
+      for (size_t i = first; i < rowBytes; ++i)
+      {
+        out[i] = static_cast<unsigned char>(row[i] - ((row[i - comp] + above[i]) >> 1));
+      }
+      break;
+    default:
+      for (size_t i = 0; i < first; ++i) out[i] = static_cast<unsigned char>(row[i] - above[i]);
+      for (size_t i = first; i < rowBytes; ++i)
+      {
+        out[i] = static_cast<unsigned char>(row[i] - paeth(row[i - comp], above[i], above[i - comp]));
+      }
+      break;
+  }
+}
+
+// Writes the filter type byte and the filtered row. Without adaptive
+// filtering rows are stored as they are; otherwise the filter with the
+// smallest sum of absolute signed bytes is picked, the heuristic libpng and
+// stb use. scratch holds two rows.
+void filterRow(unsigned char* out, const unsigned char* row, const unsigned char* above, size_t rowBytes, int comp,
+               bool adaptive, unsigned char* scratch)
+{
+  if (!adaptive)
+  {
+    out[0] = 0;
+    std::memcpy(out + 1, row, rowBytes);
+    return;
+  }
+
+  unsigned char* candidate = scratch;
+  unsigned char* best = scratch + rowBytes;
+  uint64_t bestCost = UINT64_MAX;
+  for (int filter = 0; filter < 5; ++filter)
+  {
+    applyFilter(filter, candidate, row, above, rowBytes, static_cast<size_t>(comp));
+    uint64_t cost = 0;
+    for (size_t i = 0; i < rowBytes; ++i) cost += static_cast<uint64_t>(std::abs(static_cast<signed char>(candidate[i])));
+    if (cost < bestCost)
+    {
+      bestCost = cost;
+      out[0] = static_cast<unsigned char>(filter);
+      std::swap(candidate, best);
+    }
+  }
+  std::memcpy(out + 1, best, rowBytes);
+}
+
+struct DeflateChunk {
+  std::vector<unsigned char> data;
+  uLong adler = 0;
+  size_t inputBytes = 0;
+  bool ok = false;
+};
+
+void deflateChunk(DeflateChunk& chunk, const unsigned char* filtered, size_t begin, size_t end, bool last, int level)
+{
+  z_stream stream {};
+  // Raw deflate: the zlib header and checksum are written once, around all
+  // the chunks. Z_FILTERED suits PNG-filtered rows, as in libpng.
+  if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, level > 0 ? Z_FILTERED : Z_DEFAULT_STRATEGY) != Z_OK) return;
+  if (begin > 0)
+  {
+    const size_t window = std::min(begin, kDeflateWindow);
+    deflateSetDictionary(&stream, filtered + begin - window, static_cast<uInt>(window));
+  }
+
+  const size_t size = end - begin;
+  // Room for the sync flush marker on top of the bound.
+  chunk.data.resize(deflateBound(&stream, static_cast<uLong>(size)) + 16);
+  stream.next_in = const_cast<Bytef*>(filtered + begin);
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = chunk.data.data();
+  stream.avail_out = static_cast<uInt>(chunk.data.size());
+  const int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  chunk.ok = last ? status == Z_STREAM_END : status == Z_OK && stream.avail_in == 0;
+  chunk.data.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  chunk.adler = adler32(adler32(0, nullptr, 0), filtered + begin, static_cast<uInt>(size));
+  chunk.inputBytes = size;
+}
+
+struct QoiColor {
+  unsigned char r, g, b, a;
+};
+
+bool operator==(const QoiColor& x, const QoiColor& y)
+{
+  return x.r == y.r && x.g == y.g && x.b == y.b && x.a == y.a;
+}
+
+}
+
+ImageFormat imageFormatForPath(const std::string& path)
+{
+  const bool qoi = path.size() >= 4 && path.compare(path.size() - 4, 4, ".qoi") == 0;
+  return qoi ? ImageFormat::Qoi : ImageFormat::Png;
+}
+
+bool expandFramePattern(const std::string& pattern, int frame, std::string& path)
+{
+  const size_t kMaxWidth = 32;
+  path.clear();
+  bool expanded = false;
+  for (size_t i = 0; i < pattern.size(); ++i)
+  {
+    if (pattern[i] != '%')
+    {
+      path.push_back(pattern[i]);
+      continue;
+    }
+    if (i + 1 < pattern.size() && pattern[i + 1] == '%')
+    {
+      path.push_back('%');
+      ++i;
+      continue;
+    }
+
+    size_t j = i + 1;
+    const bool zeroPad = j < pattern.size() && pattern[j] == '0';
+    if (zeroPad) ++j;
+    size_t width = 0;
+    for (; j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9'; ++j)
+    {
+      width = width * 10 + (pattern[j] - '0');
+      if (width > kMaxWidth) return false;
+    }
+    if (expanded || j == pattern.size() || pattern[j] != 'd') return false;
+
+    const std::string digits = std::to_string(frame);
+    if (digits.size() < width) path.append(width - digits.size(), zeroPad ? '0' : ' ');
+    path += digits;
+    expanded = true;
+    i = j;
+  }
+  return true;
+}
+
+bool encodePng(std::vector<unsigned char>& out, const unsigned char* pixels, int width, int height, int comp,
+               ptrdiff_t stride, int level)
+{
+  if (width <= 0 || height <= 0 || comp < 1 || comp > 4) return false;
+  level = std::clamp(level, 0, 9);
+
+  // Every row, filter byte first, then the chunks compress ranges of it.
+  const size_t rowBytes = static_cast<size_t>(width) * comp;
+  const size_t filteredRowBytes = rowBytes + 1;
+  std::vector<unsigned char> filtered(filteredRowBytes * height);
+  const size_t rowsPerChunk = std::max<size_t>(1, kPngChunkBytes / filteredRowBytes);
+  const size_t chunkCount = (height + rowsPerChunk - 1) / rowsPerChunk;
+  const bool adaptive = level > 0;
+
+  parallelFor(chunkCount, [&](size_t c) {
+    // Two scratch rows, then a row of zeros standing in above the first.
+    std::vector<unsigned char> scratch(rowBytes * 3);
+    const unsigned char* zeros = scratch.data() + rowBytes * 2;
+    const size_t end = std::min(static_cast<size_t>(height), (c + 1) * rowsPerChunk);
+    for (size_t y = c * rowsPerChunk; y < end; ++y)
+    {
+      const unsigned char* row = pixels + static_cast<ptrdiff_t>(y) * stride;
+      const unsigned char* above = y > 0 ? row - stride : zeros;
+      filterRow(filtered.data() + y * filteredRowBytes, row, above, rowBytes, comp, adaptive, scratch.data());
+    }
+  });
+
+  std::vector<DeflateChunk> chunks(chunkCount);
+  parallelFor(chunkCount, [&](size_t c) {
+    const size_t begin = c * rowsPerChunk * filteredRowBytes;
+    const size_t end = std::min(filtered.size(), (c + 1) * rowsPerChunk * filteredRowBytes);
+    deflateChunk(chunks[c], filtered.data(), begin, end, c + 1 == chunkCount, level);
+  });
+
+  size_t compressedBytes = 0;
+  uLong adler = adler32(0, nullptr, 0);
+  for (const DeflateChunk& chunk : chunks)
+  {
+    if (!chunk.ok) return false;
+    compressedBytes += chunk.data.size();
+    adler = adler32_combine(adler, chunk.adler, static_cast<z_off_t>(chunk.inputBytes));
+  }
+
+  // One IDAT holding the zlib stream: header, the chunks, checksum.
+  std::vector<unsigned char> idat;
+  idat.reserve(compressedBytes + 6);
+  const unsigned char cmf = 0x78;
+  const int levelBits = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  unsigned char flg = static_cast<unsigned char>(levelBits << 6);
+  flg = static_cast<unsigned char>(flg + 31 - (cmf * 256 + flg) % 31);
+  idat.push_back(cmf);
+  idat.push_back(flg);
+  for (const DeflateChunk& chunk : chunks) idat.insert(idat.end(), chunk.data.begin(), chunk.data.end());
+  appendBigEndian32(idat, static_cast<uint32_t>(adler));
+
+  static const unsigned char kColorTypes[] = { 0, 4, 2, 6 };
+  unsigned char header[13];
+  putBigEndian32(header, static_cast<uint32_t>(width));
+  putBigEndian32(header + 4, static_cast<uint32_t>(height));
+  header[8] = 8;
+  header[9] = kColorTypes[comp - 1];
+  header[10] = 0;
+  header[11] = 0;
+  header[12] = 0;
+
+  static const unsigned char kSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  out.clear();
+  out.reserve(idat.size() + 64);
+  out.insert(out.end(), kSignature, kSignature + sizeof(kSignature));
+  appendPngChunk(out, "IHDR", header, sizeof(header));
+  appendPngChunk(out, "IDAT", idat.data(), idat.size());
+  appendPngChunk(out, "IEND", nullptr, 0);
+  return true;
+}
+
+bool encodeQoi(std::vector<unsigned char>& out, const unsigned char* pixels, int width, int height, int comp,
+               ptrdiff_t stride)
+{
+  if (width <= 0 || height <= 0 || (comp != 3 && comp != 4)) return false;
+
+  // Worst case is a full RGBA op for every pixel.
+  const size_t pixelCount = static_cast<size_t>(width) * height;
+  out.resize(14 + pixelCount * 5 + 8);
+  unsigned char* p = out.data();
+  std::memcpy(p, "qoif", 4);
+  putBigEndian32(p + 4, static_cast<uint32_t>(width));
+  putBigEndian32(p + 8, static_cast<uint32_t>(height));
+  p[12] = static_cast<unsigned char>(comp);
+  p[13] = 0;
+  p += 14;
+
+  QoiColor seen[64] = {};
+  QoiColor previous { 0, 0, 0, 255 };
+  int run = 0;
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char* row = pixels + static_cast<ptrdiff_t>(y) * stride;
+    for (int x = 0; x < width; ++x)
+    {
+      const unsigned char* source = row + static_cast<size_t>(x) * comp;
+      const QoiColor color { source[0], source[1], source[2], comp == 4 ? source[3] : static_cast<unsigned char>(255) };
+      const bool lastPixel = y == height - 1 && x == width - 1;
+      if (color == previous)
+      {
+        if (++run == 62 || lastPixel)
+        {
+          *p++ = static_cast<unsigned char>(0xc0 | (run - 1));
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0)
+      {
+        *p++ = static_cast<unsigned char>(0xc0 | (run - 1));
+        run = 0;
+      }
+
+      const int hash = (color.r * 3 + color.g * 5 + color.b * 7 + color.a * 11) % 64;
+      if (seen[hash] == color)
+      {
+        *p++ = static_cast<unsigned char>(hash);
+      }
+      else
+      {
+        seen[hash] = color;
+        if (color.a == previous.a)
+        {
+          const int dr = static_cast<signed char>(color.r - previous.r);
+          const int dg = static_cast<signed char>(color.g - previous.g);
+          const int db = static_cast<signed char>(color.b - previous.b);
+          const int drdg = dr - dg;
+          const int dbdg = db - dg;
+          if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+          {
+            *p++ = static_cast<unsigned char>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+          }
+          else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7)
+          {
+            *p++ = static_cast<unsigned char>(0x80 | (dg + 32));
+            *p++ = static_cast<unsigned char>((drdg + 8) << 4 | (dbdg + 8));
+          }
+          else
+          {
+            *p++ = 0xfe;
+            *p++ = color.r;
+            *p++ = color.g;
+            *p++ = color.b;
+          }
+        }
+        else
+        {
+          *p++ = 0xff;
+          *p++ = color.r;
+          *p++ = color.g;
+          *p++ = color.b;
+          *p++ = color.a;
+        }
+      }
+      previous = color;
+    }
+  }
+
+  static const unsigned char kEnd[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  std::memcpy(p, kEnd, sizeof(kEnd));
+  p += sizeof(kEnd);
+  out.resize(p - out.data());
+  return true;
+}
+
+bool writeImage(const std::string& path, const unsigned char* pixels, int width, int height, int comp, ptrdiff_t stride,
+                int pngLevel)
+{
+  std::vector<unsigned char> bytes;
+  const bool encoded = imageFormatForPath(path) == ImageFormat::Qoi
+    ? encodeQoi(bytes, pixels, width, height, comp, stride)
+    : encodePng(bytes, pixels, width, height, comp, stride, pngLevel);
+  if (!encoded) return false;
+
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) return false;
+  const bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return std::fclose(file) == 0 && written;
+}
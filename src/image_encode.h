@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Image writers for rendered frames, faster than stbi_write_png.
+//
+// PNG: rows are filtered and deflated in chunks of a few hundred kilobytes,
+// spread over the job system. Each chunk is a run of deflate blocks ending
+// in a sync flush, primed with the 32 KiB before it as a preset dictionary,
+// so the chunks concatenate into one valid zlib stream and compress almost
+// as well as a single deflate. The checksum is joined with adler32_combine.
+//
+// QOI (qoiformat.org): a single pass with no entropy coding. Files are
+// larger than PNG but encode many times faster, which suits intermediate
+// frames that a video tool or a later pass consumes.
+
+// zlib levels: 0 stores, 1 is fastest, 9 is smallest. 3 is already smaller
+// than stbi_write_png and faster even on one thread.
+const int kDefaultPngLevel = 3;
+
+enum class ImageFormat {
+  Png,
+  Qoi,
+};
+
+// QOI for a .qoi extension, PNG for anything else.
+ImageFormat imageFormatForPath(const std::string& path);
+
+// Expands a per-frame output pattern such as "frame_%04d.png": one %d field,
+// optionally with a 0 flag and a width, and %% for a literal '%'. False for
+// any other conversion or a second field, so a user's path is never used
+// as a printf format.
+bool expandFramePattern(const std::string& pattern, int frame, std::string& path);
+
+// pixels points at the top row of 8-bit samples with comp (1 to 4 for PNG,
+// 3 or 4 for QOI) channels; stride is the byte distance between rows and
+// may be negative for bottom-up data. out is replaced with the file bytes.
+bool encodePng(std::vector<unsigned char>& out, const unsigned char* pixels, int width, int height, int comp,
+               ptrdiff_t stride, int level = kDefaultPngLevel);
+bool encodeQoi(std::vector<unsigned char>& out, const unsigned char* pixels, int width, int height, int comp,
+               ptrdiff_t stride);
+
+// Encodes in the format picked by imageFormatForPath() and writes the file.
+bool writeImage(const std::string& path, const unsigned char* pixels, int width, int height, int comp, ptrdiff_t stride,
+                int pngLevel = kDefaultPngLevel);
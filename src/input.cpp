@@ -0,0 +1,240 @@
+#include "input.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <GLFW/glfw3.h>
+
+#include "camera.h"
+
+namespace {
+
+const char kMagic[4] = {'M', 'V', 'I', 'N'};
+const uint32_t kVersion = 1;
+
+enum RecordType : uint8_t {
+  RecordKey = 1,
+  RecordCursorPos = 2,
+  RecordMouseButton = 3,
+  RecordFrame = 4,
+};
+
+template <typename T>
+void put(unsigned char*& p, T value)
+{
+  std::memcpy(p, &value, sizeof(value));
+  p += sizeof(value);
+}
+
+template <typename T>
+bool get(const InputReplay& replay, size_t& offset, T& value)
+{
+  if (offset + sizeof(value) > replay.data.size()) return false;
+  std::memcpy(&value, replay.data.data() + offset, sizeof(value));
+  offset += sizeof(value);
+  return true;
+}
+
+void writeRecord(InputRecorder& recorder, RecordType type, double time, const unsigned char* payload, size_t size)
+{
+  if (!recorder.file) return;
+  unsigned char header[5];
+  unsigned char* p = header;
+  put<uint8_t>(p, type);
+  put<uint32_t>(p, static_cast<uint32_t>((time - recorder.startTime) * 1.0e6));
+  std::fwrite(header, 1, sizeof(header), recorder.file);
+  std::fwrite(payload, 1, size, recorder.file);
+}
+
+}
+
+void handleKey(int key, int action, int)
+{
+  const bool press = action != GLFW_RELEASE;
+  if (key == GLFW_KEY_W)
+  {
+    cameraMovement.forward = press;
+  }
+  if (key == GLFW_KEY_S)
+  {
+    cameraMovement.backward = press;
+  }
+  if (key == GLFW_KEY_A)
+  {
+    cameraMovement.left = press;
+  }
+  if (key == GLFW_KEY_D)
+  {
+    cameraMovement.right = press;
+  }
+  if (key == GLFW_KEY_1)
+  {
+    cameraMovement.up = press;
+  }
+  if (key == GLFW_KEY_2)
+  {
+    cameraMovement.down = press;
+  }
+  if (key == GLFW_MOD_SHIFT)
+  {
+    cameraMovement.fastSpeed = press;
+  }
+  if (key == GLFW_KEY_SPACE)
+  {
+    cameraMovement.resetUp = press;
+  }
+}
+
+void handleCursorPos(const glm::vec2& pos)
+{
+  mouseState.pos = pos;
+}
+
+void handleMouseButton(int button, int action, int)
+{
+  if (button == GLFW_MOUSE_BUTTON_LEFT)
+  {
+    mouseState.pressedLeft = action == GLFW_PRESS;
+  }
+}
+
+bool openInputRecording(InputRecorder& recorder, const std::string& path, double startTime)
+{
+  recorder.file = std::fopen(path.c_str(), "wb");
+  if (!recorder.file)
+  {
+    std::printf("Unable to open %s for recording\n", path.c_str());
+    return false;
+  }
+  recorder.startTime = startTime;
+  recorder.frames = 0;
+  std::fwrite(kMagic, 1, sizeof(kMagic), recorder.file);
+  std::fwrite(&kVersion, sizeof(kVersion), 1, recorder.file);
+  return true;
+}
+
+void closeInputRecording(InputRecorder& recorder)
+{
+  if (!recorder.file) return;
+  std::fclose(recorder.file);
+  std::printf("Recorded %u frames of input\n", recorder.frames);
+  recorder = InputRecorder{};
+}
+
+void recordKey(InputRecorder& recorder, double time, int key, int action, int mods)
+{
+  unsigned char payload[4];
+  unsigned char* p = payload;
+  put<int16_t>(p, static_cast<int16_t>(key));
+  put<uint8_t>(p, static_cast<uint8_t>(action));
+  put<uint8_t>(p, static_cast<uint8_t>(mods));
+  writeRecord(recorder, RecordKey, time, payload, sizeof(payload));
+}
+
+void recordCursorPos(InputRecorder& recorder, double time, const glm::vec2& pos)
+{
+  unsigned char payload[8];
+  unsigned char* p = payload;
+  put<float>(p, pos.x);
+  put<float>(p, pos.y);
+  writeRecord(recorder, RecordCursorPos, time, payload, sizeof(payload));
+}
+
+void recordMouseButton(InputRecorder& recorder, double time, int button, int action, int mods)
+{
+  unsigned char payload[3];
+  unsigned char* p = payload;
+  put<uint8_t>(p, static_cast<uint8_t>(button));
+  put<uint8_t>(p, static_cast<uint8_t>(action));
+  put<uint8_t>(p, static_cast<uint8_t>(mods));
+  writeRecord(recorder, RecordMouseButton, time, payload, sizeof(payload));
+}
+
+void recordFrame(InputRecorder& recorder, double time, double deltaSeconds)
+{
+  unsigned char payload[8];
+  unsigned char* p = payload;
+  put<double>(p, deltaSeconds);
+  writeRecord(recorder, RecordFrame, time, payload, sizeof(payload));
+  ++recorder.frames;
+}
+
+bool loadInputReplay(InputReplay& replay, const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+  {
+    std::printf("Unable to open input recording %s\n", path.c_str());
+    return false;
+  }
+  replay.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  uint32_t version = 0;
+  size_t offset = sizeof(kMagic);
+  if (replay.data.size() < sizeof(kMagic) || std::memcmp(replay.data.data(), kMagic, sizeof(kMagic)) != 0
+      || !get(replay, offset, version) || version != kVersion)
+  {
+    std::printf("%s is not an input recording\n", path.c_str());
+    return false;
+  }
+  replay.cursor = offset;
+
+  // Count frames up front so callers can size their runs.
+  replay.frames = 0;
+  while (offset < replay.data.size())
+  {
+    const uint8_t type = replay.data[offset];
+    const size_t sizes[] = {0, 4, 8, 3, 8};
+    if (type < RecordKey || type > RecordFrame) break;
+    offset += 5 + sizes[type];
+    if (type == RecordFrame && offset <= replay.data.size()) ++replay.frames;
+  }
+  std::printf("Replaying %u frames of input from %s\n", replay.frames, path.c_str());
+  return true;
+}
+
+bool replayNextFrame(InputReplay& replay, double& deltaSeconds)
+{
+  size_t offset = replay.cursor;
+  while (true)
+  {
+    uint8_t type;
+    uint32_t timeUs;
+    if (!get(replay, offset, type) || !get(replay, offset, timeUs)) return false;
+
+    switch (type)
+    {
+      case RecordKey:
+      {
+        int16_t key;
+        uint8_t action, mods;
+        if (!get(replay, offset, key) || !get(replay, offset, action) || !get(replay, offset, mods)) return false;
+        handleKey(key, action, mods);
+        break;
+      }
+      case RecordCursorPos:
+      {
+        glm::vec2 pos;
+        if (!get(replay, offset, pos.x) || !get(replay, offset, pos.y)) return false;
+        handleCursorPos(pos);
+        break;
+      }
+      case RecordMouseButton:
+      {
+        uint8_t button, action, mods;
+        if (!get(replay, offset, button) || !get(replay, offset, action) || !get(replay, offset, mods)) return false;
+        handleMouseButton(button, action, mods);
+        break;
+      }
+      case RecordFrame:
+      {
+        if (!get(replay, offset, deltaSeconds)) return false;
+        replay.cursor = offset;
+        return true;
+      }
+      default:
+        std::printf("Corrupt input recording at byte %zu\n", offset);
+        return false;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Everything that feeds mouseState and cameraMovement goes through these, so
+// live GLFW callbacks and replayed recordings take the same path.
+void handleKey(int key, int action, int mods);
+// Cursor position already divided by the framebuffer width.
+void handleCursorPos(const glm::vec2& pos);
+void handleMouseButton(int button, int action, int mods);
+
+// Records the input stream to a compact binary log. Each record is a type
+// byte, a microsecond timestamp since the start of the recording and a small
+// payload. A frame record closes the events consumed by one frame and stores
+// the exact delta time that frame used, so replays are frame-exact.
+struct InputRecorder {
+  std::FILE* file = nullptr;
+  double startTime = 0.0;
+  uint32_t frames = 0;
+};
+
+bool openInputRecording(InputRecorder& recorder, const std::string& path, double startTime);
+void closeInputRecording(InputRecorder& recorder);
+void recordKey(InputRecorder& recorder, double time, int key, int action, int mods);
+void recordCursorPos(InputRecorder& recorder, double time, const glm::vec2& pos);
+void recordMouseButton(InputRecorder& recorder, double time, int button, int action, int mods);
+void recordFrame(InputRecorder& recorder, double time, double deltaSeconds);
+
+struct InputReplay {
+  std::vector<unsigned char> data;
+  size_t cursor = 0;
+  uint32_t frames = 0;
+};
+
+bool loadInputReplay(InputReplay& replay, const std::string& path);
+
+// Applies the events of the next recorded frame through the handle* functions
+// and returns that frame's delta time. Returns false once the log is exhausted.
+bool replayNextFrame(InputReplay& replay, double& deltaSeconds);
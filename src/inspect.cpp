@@ -0,0 +1,311 @@
+#include "inspect.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gltf_file.h"
+#include "stb_image.h"
+
+namespace {
+
+// Most image headers fit in the first read. JPEG's can sit behind large
+// metadata segments, so a prefix stb_image cannot parse grows, up to the
+// whole image.
+const uint64_t kImageHeaderBytes = 4 * 1024;
+const uint64_t kImageHeaderGrowth = 16;
+
+size_t arraySize(const nlohmann::json& json, const char* key)
+{
+  return json.contains(key) && json[key].is_array() ? json[key].size() : 0;
+}
+
+const nlohmann::json& element(const nlohmann::json& json, const char* key, int index)
+{
+  static const nlohmann::json empty = nlohmann::json::object();
+  if (index < 0 || static_cast<size_t>(index) >= arraySize(json, key)) return empty;
+  const nlohmann::json& value = json[key][index];
+  return value.is_object() ? value : empty;
+}
+
+int intValue(const nlohmann::json& object, const char* key, int fallback)
+{
+  return object.contains(key) && object[key].is_number_integer() ? object[key].get<int>() : fallback;
+}
+
+int componentBytes(int componentType)
+{
+  switch (componentType)
+  {
+    case 5120: case 5121: return 1;  // BYTE, UNSIGNED_BYTE
+    case 5122: case 5123: return 2;  // SHORT, UNSIGNED_SHORT
+    case 5125: case 5126: return 4;  // UNSIGNED_INT, FLOAT
+    default: return 0;
+  }
+}
+
+int componentCount(const std::string& type)
+{
+  if (type == "SCALAR") return 1;
+  if (type == "VEC2") return 2;
+  if (type == "VEC3") return 3;
+  if (type == "VEC4" || type == "MAT2") return 4;
+  if (type == "MAT3") return 9;
+  if (type == "MAT4") return 16;
+  return 0;
+}
+
+uint64_t accessorCount(const nlohmann::json& json, int accessor)
+{
+  const nlohmann::json& value = element(json, "accessors", accessor);
+  return value.contains("count") && value["count"].is_number_unsigned() ? value["count"].get<uint64_t>() : 0;
+}
+
+uint64_t accessorBytes(const nlohmann::json& json, int accessor)
+{
+  const nlohmann::json& value = element(json, "accessors", accessor);
+  const std::string type = value.contains("type") && value["type"].is_string() ? value["type"].get<std::string>() : "";
+  return accessorCount(json, accessor) * componentBytes(intValue(value, "componentType", 0)) * componentCount(type);
+}
+
+struct MeshStats {
+  uint64_t triangles = 0;
+  uint64_t vertices = 0;
+};
+
+// Triangles drawn by a primitive of count vertices (or indices) in mode.
+uint64_t triangleCount(int mode, uint64_t count)
+{
+  if (mode == 4) return count / 3;  // TRIANGLES
+  if (mode == 5 || mode == 6) return count >= 3 ? count - 2 : 0;  // TRIANGLE_STRIP, TRIANGLE_FAN
+  return 0;
+}
+
+// Adds the bytes of accessor to total unless an earlier user counted it.
+void countAccessor(const nlohmann::json& json, int accessor, std::vector<bool>& counted, uint64_t& total)
+{
+  if (accessor < 0 || static_cast<size_t>(accessor) >= counted.size() || counted[accessor]) return;
+  counted[accessor] = true;
+  total += accessorBytes(json, accessor);
+}
+
+std::vector<MeshStats> inspectMeshes(const nlohmann::json& json, ModelInfo& info, std::vector<bool>& counted)
+{
+  std::vector<MeshStats> meshes(info.meshes);
+  for (size_t m = 0; m < info.meshes; ++m)
+  {
+    const nlohmann::json& mesh = element(json, "meshes", static_cast<int>(m));
+    const size_t primitiveCount = arraySize(mesh, "primitives");
+    info.primitives += primitiveCount;
+    for (size_t p = 0; p < primitiveCount; ++p)
+    {
+      const nlohmann::json& primitive = mesh["primitives"][p];
+      if (!primitive.is_object()) continue;
+      int position = -1;
+      if (primitive.contains("attributes") && primitive["attributes"].is_object())
+      {
+        for (const auto& [semantic, accessor] : primitive["attributes"].items())
+        {
+          if (!accessor.is_number_integer()) continue;
+          if (semantic == "POSITION") position = accessor.get<int>();
+          countAccessor(json, accessor.get<int>(), counted, info.attributeBytes[semantic]);
+        }
+      }
+      const int indices = intValue(primitive, "indices", -1);
+      countAccessor(json, indices, counted, info.indexBytes);
+      for (size_t t = 0; t < arraySize(primitive, "targets"); ++t)
+      {
+        if (!primitive["targets"][t].is_object()) continue;
+        for (const auto& [semantic, accessor] : primitive["targets"][t].items())
+        {
+          if (accessor.is_number_integer()) countAccessor(json, accessor.get<int>(), counted, info.morphTargetBytes);
+        }
+      }
+
+      const uint64_t vertices = accessorCount(json, position);
+      meshes[m].vertices += vertices;
+      meshes[m].triangles += triangleCount(intValue(primitive, "mode", 4), indices >= 0 ? accessorCount(json, indices) : vertices);
+    }
+    info.triangles += meshes[m].triangles;
+    info.vertices += meshes[m].vertices;
+  }
+  return meshes;
+}
+
+// Counts the mesh nodes of the default scene (or scene 0), each time a
+// node is reached, which is once in a valid tree.
+void inspectScene(const nlohmann::json& json, const std::vector<MeshStats>& meshes, ModelInfo& info)
+{
+  const nlohmann::json& scene = element(json, "scenes", intValue(json, "scene", 0));
+  std::vector<int> stack;
+  for (size_t i = 0; i < arraySize(scene, "nodes"); ++i)
+  {
+    if (scene["nodes"][i].is_number_integer()) stack.push_back(scene["nodes"][i].get<int>());
+  }
+  std::vector<bool> visited(info.nodes, false);
+  while (!stack.empty())
+  {
+    const int index = stack.back();
+    stack.pop_back();
+    if (index < 0 || static_cast<size_t>(index) >= info.nodes || visited[index]) continue;
+    visited[index] = true;
+
+    const nlohmann::json& node = element(json, "nodes", index);
+    const int mesh = intValue(node, "mesh", -1);
+    if (mesh >= 0 && static_cast<size_t>(mesh) < meshes.size())
+    {
+      ++info.sceneMeshNodes;
+      info.sceneTriangles += meshes[mesh].triangles;
+      info.sceneVertices += meshes[mesh].vertices;
+    }
+    for (size_t i = 0; i < arraySize(node, "children"); ++i)
+    {
+      if (node["children"][i].is_number_integer()) stack.push_back(node["children"][i].get<int>());
+    }
+  }
+}
+
+void inspectImages(GltfFile& file, ModelInfo& info)
+{
+  info.images.resize(arraySize(file.json, "images"));
+  std::vector<unsigned char> prefix;
+  for (size_t i = 0; i < info.images.size(); ++i)
+  {
+    ImageInfo& image = info.images[i];
+    const nlohmann::json& source = element(file.json, "images", static_cast<int>(i));
+    if (source.contains("mimeType") && source["mimeType"].is_string()) image.mimeType = source["mimeType"].get<std::string>();
+
+    uint64_t maxBytes = kImageHeaderBytes;
+    while (readImagePrefix(file, static_cast<int>(i), maxBytes, prefix, image.encodedBytes, image.error))
+    {
+      if (stbi_info_from_memory(prefix.data(), static_cast<int>(prefix.size()), &image.width, &image.height, &image.components))
+      {
+        break;
+      }
+      image.width = image.height = image.components = 0;
+      if (prefix.size() >= image.encodedBytes)
+      {
+        image.error = stbi_failure_reason() ? stbi_failure_reason() : "unknown image format";
+        break;
+      }
+      maxBytes *= kImageHeaderGrowth;
+    }
+    info.decodedImageBytes += static_cast<uint64_t>(image.width) * image.height * 4;
+  }
+}
+
+nlohmann::json stringList(const nlohmann::json& json, const char* key)
+{
+  nlohmann::json list = nlohmann::json::array();
+  for (size_t i = 0; i < arraySize(json, key); ++i)
+  {
+    if (json[key][i].is_string()) list.push_back(json[key][i]);
+  }
+  return list;
+}
+
+}
+
+bool inspectModel(const std::string& path, ModelInfo& info, std::string& error)
+{
+  GltfFile file;
+  if (!openGltfFile(file, path, error)) return false;
+  const nlohmann::json& json = file.json;
+
+  info = ModelInfo{};
+  info.path = path;
+  info.binary = file.hasBinChunk || (path.size() >= 4 && path.compare(path.size() - 4, 4, ".glb") == 0);
+  info.fileBytes = file.fileBytes;
+  const nlohmann::json& asset = json.contains("asset") && json["asset"].is_object() ? json["asset"] : nlohmann::json::object();
+  if (asset.contains("generator") && asset["generator"].is_string()) info.generator = asset["generator"].get<std::string>();
+
+  info.scenes = arraySize(json, "scenes");
+  info.nodes = arraySize(json, "nodes");
+  info.meshes = arraySize(json, "meshes");
+  info.materials = arraySize(json, "materials");
+  info.textures = arraySize(json, "textures");
+  info.animations = arraySize(json, "animations");
+  info.skins = arraySize(json, "skins");
+  info.cameras = arraySize(json, "cameras");
+  info.accessors = arraySize(json, "accessors");
+  info.bufferViews = arraySize(json, "bufferViews");
+  info.buffers = arraySize(json, "buffers");
+
+  std::vector<bool> counted(info.accessors, false);
+  const std::vector<MeshStats> meshes = inspectMeshes(json, info, counted);
+  inspectScene(json, meshes, info);
+
+  for (size_t a = 0; a < info.animations; ++a)
+  {
+    const nlohmann::json& animation = element(json, "animations", static_cast<int>(a));
+    for (size_t s = 0; s < arraySize(animation, "samplers"); ++s)
+    {
+      const nlohmann::json& sampler = animation["samplers"][s];
+      if (!sampler.is_object()) continue;
+      countAccessor(json, intValue(sampler, "input", -1), counted, info.animationBytes);
+      countAccessor(json, intValue(sampler, "output", -1), counted, info.animationBytes);
+    }
+  }
+  for (size_t s = 0; s < info.skins; ++s)
+  {
+    countAccessor(json, intValue(element(json, "skins", static_cast<int>(s)), "inverseBindMatrices", -1), counted,
+                  info.skinBytes);
+  }
+  for (size_t b = 0; b < info.buffers; ++b)
+  {
+    const nlohmann::json& buffer = element(json, "buffers", static_cast<int>(b));
+    if (buffer.contains("byteLength") && buffer["byteLength"].is_number_unsigned()) info.bufferBytes += buffer["byteLength"].get<uint64_t>();
+  }
+
+  inspectImages(file, info);
+  for (const nlohmann::json& name : stringList(json, "extensionsUsed")) info.extensionsUsed.push_back(name.get<std::string>());
+  for (const nlohmann::json& name : stringList(json, "extensionsRequired")) info.extensionsRequired.push_back(name.get<std::string>());
+
+  info.bytesRead = file.bytesRead;
+  closeGltfFile(file);
+  return true;
+}
+
+nlohmann::json modelInfoJson(const ModelInfo& info)
+{
+  nlohmann::json images = nlohmann::json::array();
+  for (const ImageInfo& image : info.images)
+  {
+    nlohmann::json value = { { "encodedBytes", image.encodedBytes } };
+    if (!image.mimeType.empty()) value["mimeType"] = image.mimeType;
+    if (image.width > 0)
+    {
+      value["width"] = image.width;
+      value["height"] = image.height;
+      value["components"] = image.components;
+    }
+    if (!image.error.empty()) value["error"] = image.error;
+    images.push_back(value);
+  }
+
+  uint64_t attributeTotal = 0;
+  for (const auto& [semantic, bytes] : info.attributeBytes) attributeTotal += bytes;
+
+  return {
+    { "path", info.path },
+    { "format", info.binary ? "glb" : "gltf" },
+    { "fileBytes", info.fileBytes },
+    { "bytesRead", info.bytesRead },
+    { "generator", info.generator },
+    { "counts",
+      { { "scenes", info.scenes }, { "nodes", info.nodes }, { "meshes", info.meshes }, { "primitives", info.primitives },
+        { "materials", info.materials }, { "textures", info.textures }, { "images", info.images.size() },
+        { "animations", info.animations }, { "skins", info.skins }, { "cameras", info.cameras },
+        { "accessors", info.accessors }, { "bufferViews", info.bufferViews }, { "buffers", info.buffers } } },
+    { "geometry",
+      { { "triangles", info.triangles }, { "vertices", info.vertices }, { "sceneMeshNodes", info.sceneMeshNodes },
+        { "sceneTriangles", info.sceneTriangles }, { "sceneVertices", info.sceneVertices } } },
+    { "memory",
+      { { "attributes", info.attributeBytes }, { "attributeBytes", attributeTotal }, { "indexBytes", info.indexBytes },
+        { "morphTargetBytes", info.morphTargetBytes }, { "animationBytes", info.animationBytes },
+        { "skinBytes", info.skinBytes }, { "bufferBytes", info.bufferBytes },
+        { "decodedImageBytes", info.decodedImageBytes } } },
+    { "images", images },
+    { "extensionsUsed", info.extensionsUsed },
+    { "extensionsRequired", info.extensionsRequired },
+  };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+// Statistics of a glTF model read from its JSON alone: the GLB binary
+// chunk, external buffers and images are never loaded or decoded. Image
+// sizes come from the first few kilobytes of each encoded image.
+
+struct ImageInfo {
+  std::string mimeType;
+  uint64_t encodedBytes = 0;
+  // Zero when the header is not one stb_image understands, e.g. KTX2.
+  int width = 0;
+  int height = 0;
+  int components = 0;
+  std::string error;
+};
+
+struct ModelInfo {
+  std::string path;
+  bool binary = false;
+  uint64_t fileBytes = 0;
+  // Bytes actually read to inspect the model: the JSON and image headers.
+  uint64_t bytesRead = 0;
+
+  std::string generator;
+  size_t scenes = 0, nodes = 0, meshes = 0, primitives = 0, materials = 0, textures = 0, animations = 0, skins = 0,
+         cameras = 0, accessors = 0, bufferViews = 0, buffers = 0;
+
+  // Over every mesh once, and over the mesh nodes of the default scene.
+  uint64_t triangles = 0, vertices = 0;
+  uint64_t sceneTriangles = 0, sceneVertices = 0, sceneMeshNodes = 0;
+
+  // Tightly packed accessor sizes; an accessor shared by several users
+  // counts once, for the first.
+  std::map<std::string, uint64_t> attributeBytes;
+  uint64_t indexBytes = 0, morphTargetBytes = 0, animationBytes = 0, skinBytes = 0;
+  uint64_t bufferBytes = 0;
+
+  std::vector<ImageInfo> images;
+  // Sum of the images decoded to RGBA8, as the loader does.
+  uint64_t decodedImageBytes = 0;
+
+  std::vector<std::string> extensionsUsed;
+  std::vector<std::string> extensionsRequired;
+};
+
+// error says what is wrong when the file cannot be read as glTF at all.
+bool inspectModel(const std::string& path, ModelInfo& info, std::string& error);
+
+nlohmann::json modelInfoJson(const ModelInfo& info);
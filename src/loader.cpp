@@ -0,0 +1,97 @@
+#include "loader.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "tiny_gltf.h"
+
+static bool hasExtension(const std::string& path, const char* ext)
+{
+  const std::string e = ext;
+  return path.size() >= e.size() && path.compare(path.size() - e.size(), e.size(), e) == 0;
+}
+
+// Prints what tinygltf reported and checks the model has something to draw.
+static bool checkLoaded(const tinygltf::Model& model, const std::string& path, bool loaded, const std::string& err,
+                        const std::string& warn)
+{
+  if (!warn.empty())
+  {
+    std::printf("Warn: %s\n", warn.c_str());
+  }
+
+  if (!err.empty())
+  {
+    std::printf("Err: %s\n", err.c_str());
+  }
+
+  if (!loaded)
+  {
+    std::printf("Unable to load gltf\n");
+    return false;
+  }
+
+  if (model.meshes.empty() || model.meshes[0].primitives.empty())
+  {
+    std::printf("Model %s has no meshes\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool loadModel(tinygltf::Model& model, const std::string& path)
+{
+  tinygltf::TinyGLTF loader;
+  std::string err;
+  std::string warn;
+  const bool load_success = hasExtension(path, ".glb")
+    ? loader.LoadBinaryFromFile(&model, &err, &warn, path)
+    : loader.LoadASCIIFromFile(&model, &err, &warn, path);
+  return checkLoaded(model, path, load_success, err, warn);
+}
+
+// Image loader callback that keeps the encoded bytes instead of decoding.
+static bool deferImage(tinygltf::Image*, const int index, std::string*, std::string*, int, int, const unsigned char* bytes,
+                       int size, void* user_data)
+{
+  std::vector<DeferredImage>& images = *static_cast<std::vector<DeferredImage>*>(user_data);
+  DeferredImage& image = images.emplace_back();
+  image.index = index;
+  image.bytes.assign(bytes, bytes + size);
+  return true;
+}
+
+bool parseModel(tinygltf::Model& model, const std::vector<unsigned char>& data, const std::string& path,
+                std::vector<DeferredImage>& images)
+{
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(deferImage, &images);
+  const size_t slash = path.find_last_of("/\\");
+  const std::string baseDir = slash == std::string::npos ? std::string() : path.substr(0, slash);
+  std::string err;
+  std::string warn;
+  const bool binary = data.size() >= 4 && std::memcmp(data.data(), "glTF", 4) == 0;
+  const bool load_success = binary
+    ? loader.LoadBinaryFromMemory(&model, &err, &warn, data.data(), static_cast<unsigned int>(data.size()), baseDir)
+    : loader.LoadASCIIFromString(&model, &err, &warn, reinterpret_cast<const char*>(data.data()),
+                                 static_cast<unsigned int>(data.size()), baseDir);
+  return checkLoaded(model, path, load_success, err, warn);
+}
+
+bool decodeImage(tinygltf::Model& model, const DeferredImage& image)
+{
+  tinygltf::Image& target = model.images[image.index];
+  std::string err;
+  std::string warn;
+  if (!tinygltf::LoadImageData(&target, image.index, &err, &warn, 0, 0, image.bytes.data(),
+                               static_cast<int>(image.bytes.size()), nullptr))
+  {
+    std::printf("Err: %s\n", err.c_str());
+    return false;
+  }
+  return true;
+}
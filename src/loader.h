@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tiny_gltf.h"
+
+// Loads a .gltf or .glb file, picking the parser from the file extension.
+// Warnings and errors are printed; returns false if the model is unusable.
+bool loadModel(tinygltf::Model& model, const std::string& path);
+
+// Encoded bytes of an image whose decoding parseModel() left for later.
+struct DeferredImage {
+  int index = -1;
+  std::vector<unsigned char> bytes;
+};
+
+// Parses a .gltf or .glb file already read into memory, telling GLB by its
+// magic; path resolves external files. Images are not decoded: their encoded
+// bytes are returned in images so the caller can decode them in parallel with
+// decodeImage().
+bool parseModel(tinygltf::Model& model, const std::vector<unsigned char>& data, const std::string& path,
+                std::vector<DeferredImage>& images);
+
+// Decodes one deferred image into model.images, exactly as loadModel() would
+// have. Safe to call for different images from different threads.
+bool decodeImage(tinygltf::Model& model, const DeferredImage& image);
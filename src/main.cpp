@@ -1,4 +1,10 @@
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <glad/gl.h>
 
@@ -8,149 +14,288 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "tiny_gltf.h"
+#include "asset_pipeline.h"
+#include "batch.h"
+#include "camera.h"
+#include "frame_capture.h"
+#include "frame_pacer.h"
+#include "headless.h"
+#include "input.h"
+#include "inspect.h"
+#include "parallel.h"
+#include "renderer.h"
+#include "softraster.h"
+#include "sort_last.h"
+#include "thumbnail_server.h"
 
 const GLuint WIDTH = 800, HEIGHT = 600;
 
-void message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const* message, void const* user_param) {
-  auto const src_str = [source]() {
-    switch (source)
-    {
-      case GL_DEBUG_SOURCE_API: return "API";
-      case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "WINDOW SYSTEM";
-      case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER COMPILER";
-      case GL_DEBUG_SOURCE_THIRD_PARTY: return "THIRD PARTY";
-      case GL_DEBUG_SOURCE_APPLICATION: return "APPLICATION";
-      case GL_DEBUG_SOURCE_OTHER: return "OTHER";
-      default: return "UNKNOWN";
-    }
-  }();
-
-  auto const type_str = [type]() {
-    switch (type)
-    {
-      case GL_DEBUG_TYPE_ERROR: return "ERROR";
-      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "DEPRECATED_BEHAVIOR";
-      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "UNDEFINED_BEHAVIOR";
-      case GL_DEBUG_TYPE_PORTABILITY: return "PORTABILITY";
-      case GL_DEBUG_TYPE_PERFORMANCE: return "PERFORMANCE";
-      case GL_DEBUG_TYPE_MARKER: return "MARKER";
-      case GL_DEBUG_TYPE_OTHER: return "OTHER";
-      default: return "UNKNOWN";
-    }
-  }();
-
-  auto const severity_str = [severity]() {
-    switch (severity) {
-      case GL_DEBUG_SEVERITY_NOTIFICATION: return "NOTIFICATION";
-      case GL_DEBUG_SEVERITY_LOW: return "LOW";
-      case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
-      case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
-      default: return "UNKNOWN";
-    }
-  }();
-
-  std::printf("%s, %s, %s, %d: %s\n", src_str, type_str, severity_str, id, message);
+// Longest the on-demand loop sleeps without an event.
+const double kIdleWaitSeconds = 0.5;
+
+static InputRecorder inputRecorder;
+static bool replaying = false;
+// Set by input, resize and expose events; cleared when a frame is drawn.
+static bool redrawRequested = true;
+static bool framebufferResized = false;
+// Time of the oldest input event not yet drawn, or negative.
+static double pendingInputTime = -1.0;
+// F12 saves the next frame drawn.
+static bool screenshotRequested = false;
+
+static void noteInput()
+{
+  if (pendingInputTime < 0.0) pendingInputTime = glfwGetTime();
 }
 
-struct Camera {
-  glm::vec3 pos;
-  glm::quat orientation;
+struct Options {
+  std::string modelPath = "resources/triangle.gltf";
+  // Every model named on the command line, for --inspect.
+  std::vector<std::string> modelPaths;
+  bool inspect = false;
+  std::string recordPath;
+  std::string replayPath;
+  bool headless = false;
+  bool onDemand = false;
+  int framesInFlight = 2;
+  std::string latencyLogPath;
+  std::string capturePath;
+  HeadlessOptions headlessOptions;
+  BatchOptions batchOptions;
+  ServerOptions serverOptions;
+  JobOptions jobOptions;
+  // Set in the worker processes runSortLast() starts.
+  std::string sortLastShared;
+  int sortLastRank = -1;
 };
 
-struct MouseState {
-  glm::vec2 pos {0.0f};
-  bool pressedLeft = false;
-} mouseState;
-
-struct CameraMovement {
-  bool forward = false;
-  bool backward = false;
-  bool left = false;
-  bool right = false;
-  bool up = false;
-  bool down = false;
-  bool fastSpeed = false;
-  bool resetUp = false;
-  float lookSpeed = 4.0f;
-  float acceleration = 150.0f;
-  float damping = 0.2f;
-  float maxSpeed = 10.0f;
-  float fastCoef = 10.0f;
-  glm::vec3 moveSpeed {0.0f};
-} cameraMovement;
-
-glm::mat4 getViewMatrix(const Camera& camera)
+static void printUsage(const char* program)
 {
-  const glm::mat4 t = glm::translate(glm::mat4{1.0f}, -camera.pos);
-  const glm::mat4 r = glm::mat4_cast(camera.orientation);
-  return r * t;
+  std::printf(
+    "Usage: %s [options] [model.gltf|model.glb]\n"
+    "  --headless          render offscreen through EGL, no window needed\n"
+    "  --software          render headless on the CPU, no GL driver needed\n"
+    "  --frames N          number of frames to render headless (default 1)\n"
+    "  --size WxH          headless framebuffer size (default %ux%u)\n"
+    "  --output FILE.png   headless output, PNG or .qoi; a printf pattern or, with EGL, FILE.y4m writes every frame\n"
+    "  --png-level N       PNG compression, 0 (none) to 9 (smallest), default %d\n"
+    "  --sort-last N       render headless in N processes, each drawing part of the model, and depth-composite\n"
+    "  --batch FILE        render every job in a JSON Lines file headless, reusing loaded models\n"
+    "  --cache-scenes N    models a batch or server keeps loaded between jobs (default 4)\n"
+    "  --serve SOCKET      render thumbnail requests from a Unix socket until SIGINT or SIGTERM\n"
+    "  --thumbnail-cache DIR  where --serve keeps its images (default thumbnails)\n"
+    "  --scene N           load only scene N of the model\n"
+    "  --node PATH         load only the subtree under a node, by names or #index from a scene root, e.g. Car/#3\n"
+    "  --inspect           print statistics of each model as a JSON line, reading only its JSON and image headers\n"
+    "  --record FILE       record keyboard and mouse input to FILE\n"
+    "  --replay FILE       replay recorded input with its recorded frame timing\n"
+    "  --capture FILE      record every frame as FILE.y4m video or a printf pattern of PNGs\n"
+    "  --on-demand         redraw only on input, animation, loading or resize; idle otherwise\n"
+    "  --frames-in-flight N  frames the GPU may queue, 1 to 3 (default 2); 1 is lowest latency\n"
+    "  --latency-log FILE  write per-frame input, submit, present and GPU completion times as CSV\n"
+    "  --threads N         worker threads, the main thread included (default: one per core)\n"
+    "  --pin-threads       pin each worker thread to its own core\n",
+    program, WIDTH, HEIGHT, kDefaultPngLevel);
 }
 
-void setUpVector(Camera& camera, const glm::vec3& up)
+// Inspects the models in parallel and prints their statistics in order.
+static int runInspect(const std::vector<std::string>& paths)
 {
-  const glm::mat4 view = getViewMatrix(camera);
-  const glm::vec3 dir = -glm::vec3(view[0][2], view[1][2], view[2][2]);
-  camera.orientation = glm::lookAt(camera.pos, camera.pos + dir, up);
+  std::vector<nlohmann::json> results(paths.size());
+  parallelFor(paths.size(), [&](size_t i) {
+    ModelInfo info;
+    std::string error;
+    results[i] = inspectModel(paths[i], info, error) ? modelInfoJson(info) : nlohmann::json{ { "path", paths[i] }, { "error", error } };
+  });
+
+  int failures = 0;
+  for (const nlohmann::json& result : results)
+  {
+    if (result.contains("error")) ++failures;
+    std::printf("%s\n", result.dump().c_str());
+  }
+  return failures == 0 ? 0 : -1;
 }
 
-void resetMousePosition(MouseState& ms, const glm::vec2& p)
+// Image outputs name each frame through expandFramePattern(); Y4M paths are
+// opened as they are.
+static bool checkFramePattern(const char* option, const std::string& path)
 {
-  ms.pos = p;
+  std::string expanded;
+  const bool y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+  if (y4m || expandFramePattern(path, 0, expanded)) return true;
+  std::printf("%s %s: the path may hold one %%d frame number and no other %% conversion\n", option, path.c_str());
+  return false;
 }
 
-void updateCamera(Camera& camera, double deltaSeconds, const MouseState& newState, MouseState& oldState, const CameraMovement& movement)
+static bool parseArgs(int argc, char** argv, Options& options)
 {
-  if (cameraMovement.resetUp) setUpVector(camera, glm::vec3{0.0f, 1.0f, 0.0f});
+  options.headlessOptions.width = WIDTH;
+  options.headlessOptions.height = HEIGHT;
 
-  if (mouseState.pressedLeft)
-  {
-    const glm::vec2 delta = newState.pos - oldState.pos;
-    const glm::quat deltaQuat = glm::quat(glm::vec3(movement.lookSpeed * delta.y, movement.lookSpeed * delta.x, 0.0f));
-    camera.orientation = glm::normalize(deltaQuat * camera.orientation);
-  }
-  oldState = newState;
-
-  const glm::mat4 v = glm::mat4_cast(camera.orientation);
-  const glm::vec3 forward = -glm::vec3(v[0][2], v[1][2], v[2][2]);
-  const glm::vec3 right = glm::vec3(v[0][0], v[1][0], v[2][0]);
-  const glm::vec3 up = glm::cross(right, forward);
-
-  glm::vec3 accel {0.0f};
-  if (cameraMovement.forward) accel += forward;
-  if (cameraMovement.backward) accel -= forward;
-  if (cameraMovement.left) accel -= right;
-  if (cameraMovement.right) accel += right;
-  if (cameraMovement.up) accel += up;
-  if (cameraMovement.down) accel -= up;
-  if (cameraMovement.fastSpeed) accel *= cameraMovement.fastCoef;
-
-  if (accel == glm::zero<glm::vec3>())
-  {
-    cameraMovement.moveSpeed -= cameraMovement.moveSpeed * std::min((1.0f / cameraMovement.damping) * static_cast<float>(deltaSeconds), 1.0f);
-  }
-  else
+  for (int i = 1; i < argc; ++i)
   {
-    cameraMovement.moveSpeed += accel * cameraMovement.acceleration * static_cast<float>(deltaSeconds);
-    const float maxSpeed = cameraMovement.fastSpeed ? cameraMovement.maxSpeed * cameraMovement.fastCoef : cameraMovement.maxSpeed;
-    if (glm::length(cameraMovement.moveSpeed) > maxSpeed)
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--headless") == 0)
     {
-      cameraMovement.moveSpeed = glm::normalize(cameraMovement.moveSpeed) * maxSpeed;
+      options.headless = true;
+    }
+    else if (std::strcmp(arg, "--software") == 0)
+    {
+      options.headless = true;
+      options.headlessOptions.software = true;
+    }
+    else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+    {
+      options.headlessOptions.frames = std::atoi(argv[++i]);
+    }
+    else if (std::strcmp(arg, "--size") == 0 && hasValue)
+    {
+      if (std::sscanf(argv[++i], "%dx%d", &options.headlessOptions.width, &options.headlessOptions.height) != 2)
+      {
+        std::printf("Invalid size: %s\n", argv[i]);
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--png-level") == 0 && hasValue)
+    {
+      options.headlessOptions.pngLevel = std::clamp(std::atoi(argv[++i]), 0, 9);
+    }
+    else if (std::strcmp(arg, "--output") == 0 && hasValue)
+    {
+      options.headlessOptions.outputPath = argv[++i];
+      if (!checkFramePattern(arg, options.headlessOptions.outputPath)) return false;
+    }
+    else if (std::strcmp(arg, "--batch") == 0 && hasValue)
+    {
+      options.batchOptions.jobsPath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--cache-scenes") == 0 && hasValue)
+    {
+      options.batchOptions.cachedScenes = std::max(1, std::atoi(argv[++i]));
+      options.serverOptions.cachedScenes = options.batchOptions.cachedScenes;
+    }
+    else if (std::strcmp(arg, "--serve") == 0 && hasValue)
+    {
+      options.serverOptions.socketPath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--thumbnail-cache") == 0 && hasValue)
+    {
+      options.serverOptions.cacheDir = argv[++i];
+    }
+    else if (std::strcmp(arg, "--scene") == 0 && hasValue)
+    {
+      options.headlessOptions.subset.scene = std::max(0, std::atoi(argv[++i]));
+    }
+    else if (std::strcmp(arg, "--node") == 0 && hasValue)
+    {
+      options.headlessOptions.subset.nodePath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--inspect") == 0)
+    {
+      options.inspect = true;
+    }
+    else if (std::strcmp(arg, "--sort-last") == 0 && hasValue)
+    {
+      options.headless = true;
+      options.headlessOptions.sortLastWorkers = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (std::strcmp(arg, "--sort-last-worker") == 0 && i + 2 < argc)
+    {
+      options.sortLastShared = argv[++i];
+      options.sortLastRank = std::atoi(argv[++i]);
+    }
+    else if (std::strcmp(arg, "--record") == 0 && hasValue)
+    {
+      options.recordPath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--replay") == 0 && hasValue)
+    {
+      options.replayPath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--capture") == 0 && hasValue)
+    {
+      options.capturePath = argv[++i];
+      if (!checkFramePattern(arg, options.capturePath)) return false;
+    }
+    else if (std::strcmp(arg, "--on-demand") == 0)
+    {
+      options.onDemand = true;
+    }
+    else if (std::strcmp(arg, "--frames-in-flight") == 0 && hasValue)
+    {
+      options.framesInFlight = std::atoi(argv[++i]);
+      if (options.framesInFlight < 1 || options.framesInFlight > kMaxFramesInFlight)
+      {
+        std::printf("--frames-in-flight must be between 1 and %d\n", kMaxFramesInFlight);
+        return false;
+      }
+    }
+    else if (std::strcmp(arg, "--latency-log") == 0 && hasValue)
+    {
+      options.latencyLogPath = argv[++i];
+    }
+    else if (std::strcmp(arg, "--threads") == 0 && hasValue)
+    {
+      options.jobOptions.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+    }
+    else if (std::strcmp(arg, "--pin-threads") == 0)
+    {
+      options.jobOptions.pinThreads = true;
+    }
+    else if (arg[0] == '-')
+    {
+      return false;
+    }
+    else
+    {
+      options.modelPath = arg;
+      options.modelPaths.push_back(arg);
     }
-
-    camera.pos += cameraMovement.moveSpeed * static_cast<float>(deltaSeconds);
   }
+
+  options.headlessOptions.modelPath = options.modelPath;
+  options.headlessOptions.replayPath = options.replayPath;
+  options.batchOptions.pngLevel = options.headlessOptions.pngLevel;
+  options.serverOptions.pngLevel = options.headlessOptions.pngLevel;
+  return true;
 }
 
 int main(int argc, char** argv)
 {
-  glm::vec3 camPos {-2.0f, 1.0f, 3.0f};
-  glm::vec3 target {0.5f, 0.5f, 0.0f};
-  glm::vec3 up {0.0f, 0.0f, 1.0f};
-  Camera camera { camPos, glm::lookAt(camPos, target, up) };
+  Options options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+  configureJobs(options.jobOptions);
+
+  if (options.sortLastRank >= 0)
+  {
+    return runSortLastWorker(options.sortLastShared, options.sortLastRank);
+  }
+  if (options.inspect)
+  {
+    return runInspect(options.modelPaths.empty() ? std::vector<std::string>{ options.modelPath } : options.modelPaths);
+  }
+  if (!options.batchOptions.jobsPath.empty())
+  {
+    return runBatch(options.batchOptions);
+  }
+  if (!options.serverOptions.socketPath.empty())
+  {
+    return runServer(options.serverOptions);
+  }
+  if (options.headless)
+  {
+    if (options.headlessOptions.software) return runSoftware(options.headlessOptions);
+    if (options.headlessOptions.sortLastWorkers > 0) return runSortLast(options.headlessOptions);
+    return runHeadless(options.headlessOptions);
+  }
+
+  Camera camera = makeDefaultCamera();
 
   MouseState oldMouseState;
 
@@ -173,58 +318,50 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
+  // While replaying, live input is ignored apart from Escape and F12.
   glfwSetCursorPosCallback(window, [] (GLFWwindow* window, double x, double y) {
+      if (replaying) return;
+      redrawRequested = true;
+      noteInput();
       int width, height;
       glfwGetFramebufferSize(window, &width, &height);
-      mouseState.pos.x = static_cast<float>(x / width);
-      mouseState.pos.y = static_cast<float>(y / width);
+      const glm::vec2 pos { static_cast<float>(x / width), static_cast<float>(y / width) };
+      recordCursorPos(inputRecorder, glfwGetTime(), pos);
+      handleCursorPos(pos);
   });
 
   glfwSetMouseButtonCallback(window, [] (GLFWwindow* window, int button, int action, int mods) {
-      if (button == GLFW_MOUSE_BUTTON_LEFT)
-      {
-        mouseState.pressedLeft = action == GLFW_PRESS;
-      }
+      if (replaying) return;
+      redrawRequested = true;
+      noteInput();
+      recordMouseButton(inputRecorder, glfwGetTime(), button, action, mods);
+      handleMouseButton(button, action, mods);
   });
 
   glfwSetKeyCallback(window, [] (GLFWwindow* window, int key, int scancode, int action, int mods) {
-      const bool press = action != GLFW_RELEASE;
       if (key == GLFW_KEY_ESCAPE)
       {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
       }
-      if (key == GLFW_KEY_W)
-      {
-        cameraMovement.forward = press;
-      }
-      if (key == GLFW_KEY_S)
-      {
-        cameraMovement.backward = press;
-      }
-      if (key == GLFW_KEY_A)
-      {
-        cameraMovement.left = press;
-      }
-      if (key == GLFW_KEY_D)
-      {
-        cameraMovement.right = press;
-      }
-      if (key == GLFW_KEY_1)
+      if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
       {
-        cameraMovement.up = press;
-      }
-      if (key == GLFW_KEY_2)
-      {
-        cameraMovement.down = press;
-      }
-      if (key == GLFW_MOD_SHIFT)
-      {
-        cameraMovement.fastSpeed = press;
-      }
-      if (key == GLFW_KEY_SPACE)
-      {
-        cameraMovement.resetUp = press;
+        screenshotRequested = true;
+        redrawRequested = true;
       }
+      if (replaying) return;
+      redrawRequested = true;
+      noteInput();
+      recordKey(inputRecorder, glfwGetTime(), key, action, mods);
+      handleKey(key, action, mods);
+  });
+
+  glfwSetFramebufferSizeCallback(window, [] (GLFWwindow* window, int width, int height) {
+      framebufferResized = true;
+      redrawRequested = true;
+  });
+
+  glfwSetWindowRefreshCallback(window, [] (GLFWwindow* window) {
+      redrawRequested = true;
   });
 
   glfwMakeContextCurrent(window);
@@ -236,159 +373,197 @@ int main(int argc, char** argv)
     return -1;
   }
   printf("GL %d.%d\n", GLAD_VERSION_MAJOR(version), GLAD_VERSION_MINOR(version));
-  glEnable(GL_DEBUG_OUTPUT);
-  glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
-  glDebugMessageCallback(message_callback, nullptr);
+  enableDebugOutput(false);
 
   glfwSwapInterval(1);
 
-  tinygltf::Model gltfmodel;
-  tinygltf::TinyGLTF loader;
-  std::string err;
-  std::string warn;
-  const bool load_success = loader.LoadASCIIFromFile(
-      &gltfmodel,
-      &err,
-      &warn,
-      "resources/triangle.gltf"
-  );
-
-  if (!warn.empty())
+  Renderer renderer;
+  if (!createRenderer(renderer))
   {
-    std::printf("Warn: %s\n", warn.c_str());
+    return -1;
   }
 
-  if (!err.empty())
+  FrameArena frameArena;
+  createFrameArena(frameArena, kFrameArenaBytes);
+  VisibilityCache visibility;
+  uint64_t frame = 0;
+  FramePacer pacer;
+  if (!createFramePacer(pacer, options.framesInFlight, glfwGetTime, options.latencyLogPath))
   {
-    std::printf("Err: %s\n", err.c_str());
+    return -1;
   }
-
-  if (!load_success)
+  FrameTimes frameTimes;
+
+  // Frames keep the window size they started with; a resize while recording
+  // crops or pads the recording.
+  int windowWidth, windowHeight;
+  glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+  FrameCapture recording;
+  int recordedFrames = 0;
+  if (!options.capturePath.empty() && !createFrameCapture(recording, options.capturePath, windowWidth, windowHeight, 60))
   {
-    std::printf("Unable to load gltf\n");
     return -1;
   }
-  
-  static const char* vSource = R"(
-#version 330 core
-layout (location = 0) in vec3 aPos;   // the position variable has attribute position 0
-
-uniform mat4 mvp;
-  
-void main()
-{
-    gl_Position = mvp * vec4(aPos, 1.0);
-}
-)";
+  recording.pngLevel = options.headlessOptions.pngLevel;
+  // Created at the first screenshot, and again after a resize.
+  std::unique_ptr<FrameCapture> screenshots;
+  int screenshotCount = 0;
 
-  static const char* fSource = R"(
-#version 330 core
-out vec4 FragColor;  
-  
-void main()
-{
-    FragColor = vec4(1.0, 0.0, 0.0, 1.0);
-}
-)";
-
-  GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vShader, 1, &vSource, nullptr);
-  glCompileShader(vShader);
-  int success;
-  glGetShaderiv(vShader, GL_COMPILE_STATUS, &success);
-  if (!success)
-  {
-    char infoLog[512];
-    glGetShaderInfoLog(vShader, 512, nullptr, infoLog);
-    std::printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n%s\n", infoLog);
-  }
+  glViewport(0, 0, WIDTH, HEIGHT);
 
-  GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fShader, 1, &fSource, nullptr);
-  glCompileShader(fShader);
-  glGetShaderiv(fShader, GL_COMPILE_STATUS, &success);
-  if (!success)
+  glm::mat4 proj = glm::perspectiveRH(45.0f, WIDTH / (float)HEIGHT, 1.0f, 100.0f);
+
+  InputReplay replay;
+  if (!options.replayPath.empty())
   {
-    char infoLog[512];
-    glGetShaderInfoLog(fShader, 512, nullptr, infoLog);
-    std::printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n%s\n", infoLog);
+    if (!loadInputReplay(replay, options.replayPath))
+    {
+      return -1;
+    }
+    replaying = true;
   }
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vShader);
-  glAttachShader(program, fShader);
-  glLinkProgram(program);
-  glGetProgramiv(program, GL_LINK_STATUS, &success);
-  if (!success)
+  if (!options.recordPath.empty() && !openInputRecording(inputRecorder, options.recordPath, glfwGetTime()))
   {
-    char infoLog[512];
-    glGetProgramInfoLog(program, 512, nullptr, infoLog);
-    std::printf("ERROR::PROGRAM::LINK_FAILED\n%s\n", infoLog);
+    return -1;
   }
 
-  tinygltf::Primitive triangles = gltfmodel.meshes[0].primitives[0];
-  const int positionAttr = triangles.attributes.find("POSITION")->second;
-  tinygltf::Accessor posAccessor = gltfmodel.accessors[positionAttr];
-  tinygltf::BufferView posBufView = gltfmodel.bufferViews[posAccessor.bufferView];
-  tinygltf::Buffer posBuf = gltfmodel.buffers[posBufView.buffer];
-  tinygltf::Accessor indAccessor = gltfmodel.accessors[triangles.indices];
-  tinygltf::BufferView indBufView = gltfmodel.bufferViews[indAccessor.bufferView];
-
-  GLint alignment = GL_NONE;
-  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
-
-  std::printf("OpenGL alignment: %d\n", alignment);
-
-  GLuint vao;
-  glCreateVertexArrays(1, &vao);
-
-  GLuint meshBuf;
-  glCreateBuffers(1, &meshBuf);
+  // The window keeps drawing (an empty scene) while the model loads; the load
+  // finishes on this thread at a runMainThreadTasks() call.
+  RuntimeScene scene;
+  // 0 while loading, 1 once the scene is ready, -1 if it failed to load.
+  int loadState = 0;
+  spawn([](RuntimeScene& target, std::string path, ModelSubset subset, int& state) -> Task<void> {
+    Task<bool> load = loadRuntimeSceneAsync(target, std::move(path), std::move(subset));
+    const bool loaded = co_await load;
+    co_await switchToMainThread();
+    state = loaded ? 1 : -1;
+  }(scene, options.modelPath, options.headlessOptions.subset, loadState));
 
-  glNamedBufferStorage(meshBuf, posBuf.data.size(), posBuf.data.data(), 0);
-
-  glVertexArrayVertexBuffer(vao, 0, meshBuf, posBufView.byteOffset, sizeof(glm::vec3));
-  glVertexArrayElementBuffer(vao, meshBuf);
-
-  glEnableVertexArrayAttrib(vao, 0);
-  glVertexArrayAttribFormat(vao, 0, 3, posAccessor.componentType, GL_FALSE, posAccessor.byteOffset);
-  glVertexArrayAttribBinding(vao, 0, 0);
-
-  glViewport(0, 0, WIDTH, HEIGHT);
-
-  glEnable(GL_DEPTH_TEST);
-
-  glm::mat4 model = glm::mat4(1.0f);
-  glm::mat4 proj = glm::perspectiveRH(45.0f, WIDTH / (float)HEIGHT, 1.0f, 100.0f);
-  GLint mvpLoc = glGetUniformLocation(program, "mvp");
+  std::vector<AnimationInstance> animations;
 
   double lastUpdate = 0.0;
 
+  // Replays stay frame-exact, so they always draw continuously.
+  const bool onDemand = options.onDemand && !replaying;
+  if (onDemand) setMainThreadWakeup(glfwPostEmptyEvent);
+
   while(!glfwWindowShouldClose(window))
   {
-    glfwPollEvents();
-    double currentUpdate = glfwGetTime();
-    double deltaSeconds = currentUpdate - lastUpdate;
-    lastUpdate = currentUpdate;
+    // Block on the GPU before polling, not after, so the frame is built from
+    // the newest input the queue limit allows.
+    waitForFrameSlot(pacer);
+    // Held keys and playing animations change the picture without events.
+    const bool changing = cameraMoving(cameraMovement) || animationsPlaying(animations, scene.animations);
+    if (onDemand && !changing && !redrawRequested)
+    {
+      // Nothing to draw until an event, a finished load step or the timeout.
+      glfwWaitEventsTimeout(kIdleWaitSeconds);
+      // Time spent idle does not move the camera.
+      lastUpdate = glfwGetTime();
+    }
+    else
+    {
+      glfwPollEvents();
+    }
+    frameTimes.input = pendingInputTime;
+    frameTimes.sampled = glfwGetTime();
+    if (runMainThreadTasks() > 0) redrawRequested = true;
+    if (loadState < 0)
+    {
+      return -1;
+    }
+    if (framebufferResized)
+    {
+      framebufferResized = false;
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      glViewport(0, 0, width, height);
+      if (width > 0 && height > 0) proj = glm::perspectiveRH(45.0f, width / (float)height, 1.0f, 100.0f);
+    }
+    if (onDemand && !changing && !redrawRequested)
+    {
+      continue;
+    }
+    redrawRequested = false;
+    pendingInputTime = -1.0;
+
+    if (loadState == 0)
+    {
+      // Replays and recordings start with the first frame of the loaded scene.
+      beginArenaFrame(frameArena, frame++);
+      updateVisibility(visibility, scene, getViewMatrix(camera), proj);
+      drawFrame(renderer, proj * getViewMatrix(camera), scene, visibility, frameArena);
+      frameTimes.submitted = glfwGetTime();
+      glfwSwapBuffers(window);
+      frameTimes.presented = glfwGetTime();
+      endFrame(pacer, frameTimes);
+      continue;
+    }
+    if (animations.empty() && !scene.animations.empty()) startAnimation(animations, scene.animations, 0);
+
+    double deltaSeconds;
+    if (replaying)
+    {
+      // Recorded deltas stand in for glfwGetTime so the replay is frame-exact.
+      if (!replayNextFrame(replay, deltaSeconds))
+      {
+        std::printf("Replay finished\n");
+        break;
+      }
+    }
+    else
+    {
+      double currentUpdate = glfwGetTime();
+      deltaSeconds = currentUpdate - lastUpdate;
+      lastUpdate = currentUpdate;
+      recordFrame(inputRecorder, currentUpdate, deltaSeconds);
+    }
 
     updateCamera(camera, deltaSeconds, mouseState, oldMouseState, cameraMovement);
+    animateScene(animations, scene.animations, scene.graph, deltaSeconds);
     glm::mat4 view = getViewMatrix(camera);
-    glm::mat4 mvp = proj * view * model;
 
-    const float color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    const float depth = 1.0f;
-    glClearBufferfv(GL_COLOR, 0, color);
-    glClearBufferfv(GL_DEPTH, 0, &depth);
-
-    glUseProgram(program);
-    glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
-    glBindVertexArray(vao);
-    glDrawElements(triangles.mode, indAccessor.count, indAccessor.componentType, (void *)(indBufView.byteOffset + indAccessor.byteOffset));
+    beginArenaFrame(frameArena, frame++);
+    updateVisibility(visibility, scene, view, proj);
+    drawFrame(renderer, proj * view, scene, visibility, frameArena);
+    if (!options.capturePath.empty()) captureFrame(recording, 0, recordedFrames++);
+    if (screenshotRequested)
+    {
+      screenshotRequested = false;
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      if (screenshots && (screenshots->width != width || screenshots->height != height))
+      {
+        destroyFrameCapture(*screenshots);
+        screenshots.reset();
+      }
+      if (!screenshots)
+      {
+        screenshots = std::make_unique<FrameCapture>();
+        if (createFrameCapture(*screenshots, "screenshot_%03d.png", width, height, 60))
+        {
+          screenshots->pngLevel = options.headlessOptions.pngLevel;
+        }
+        else
+        {
+          screenshots.reset();
+        }
+      }
+      if (screenshots) captureFrame(*screenshots, 0, screenshotCount++);
+    }
+    frameTimes.submitted = glfwGetTime();
     glfwSwapBuffers(window);
+    frameTimes.presented = glfwGetTime();
+    endFrame(pacer, frameTimes);
   }
 
   // Cleanup
+  destroyFramePacer(pacer);
+  if (!options.capturePath.empty()) destroyFrameCapture(recording);
+  if (screenshots) destroyFrameCapture(*screenshots);
+  closeInputRecording(inputRecorder);
+  destroyRenderer(renderer);
+  destroyRuntimeScene(scene);
   glfwTerminate();
   return 0;
 }
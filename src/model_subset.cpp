@@ -0,0 +1,573 @@
+#include "model_subset.h"
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+
+#include "gltf_file.h"
+
+namespace {
+
+using nlohmann::json;
+
+// Buffer ranges closer than this are read in one go, gap included.
+const uint64_t kMergeGap = 4096;
+
+size_t arraySize(const json& value, const char* key)
+{
+  return value.is_object() && value.contains(key) && value[key].is_array() ? value[key].size() : 0;
+}
+
+const json& element(const json& value, const char* key, int index)
+{
+  static const json empty = json::object();
+  if (index < 0 || static_cast<size_t>(index) >= arraySize(value, key)) return empty;
+  return value[key][index].is_object() ? value[key][index] : empty;
+}
+
+int indexOf(const json& value, const char* key)
+{
+  return value.is_object() && value.contains(key) && value[key].is_number_integer() ? value[key].get<int>() : -1;
+}
+
+std::vector<int> indicesOf(const json& value, const char* key)
+{
+  std::vector<int> indices;
+  for (size_t i = 0; i < arraySize(value, key); ++i)
+  {
+    if (value[key][i].is_number_integer()) indices.push_back(value[key][i].get<int>());
+  }
+  return indices;
+}
+
+// The objects of one top-level array the subset keeps, and their new
+// indices once numberSelection() has run.
+struct Selection {
+  std::vector<bool> kept;
+  std::vector<int> index;
+};
+
+// Keeps object i; false if it was already kept or does not exist.
+bool keep(Selection& selection, int i)
+{
+  if (i < 0 || static_cast<size_t>(i) >= selection.kept.size() || selection.kept[i]) return false;
+  selection.kept[i] = true;
+  return true;
+}
+
+bool kept(const Selection& selection, int i)
+{
+  return i >= 0 && static_cast<size_t>(i) < selection.kept.size() && selection.kept[i];
+}
+
+// Numbers the kept objects in their original order.
+void numberSelection(Selection& selection)
+{
+  selection.index.assign(selection.kept.size(), -1);
+  int next = 0;
+  for (size_t i = 0; i < selection.kept.size(); ++i)
+  {
+    if (selection.kept[i]) selection.index[i] = next++;
+  }
+}
+
+int remap(const Selection& selection, const json& value)
+{
+  return value.is_number_integer() && kept(selection, value.get<int>()) ? selection.index[value.get<int>()] : -1;
+}
+
+// The copies of the kept objects of source[key], for the new file.
+template <typename Fn>
+json selectedArray(const json& source, const char* key, const Selection& selection, Fn&& fix)
+{
+  json array = json::array();
+  for (size_t i = 0; i < selection.kept.size(); ++i)
+  {
+    if (!selection.kept[i]) continue;
+    json value = source[key][i];
+    fix(value, static_cast<int>(i));
+    array.push_back(std::move(value));
+  }
+  return array;
+}
+
+// The walks below call fn on each index of some kind an object holds, so
+// that one walk both finds what to keep and rewrites the kept copies.
+
+template <typename Json, typename Fn>
+void forEachPrimitiveAccessor(Json& primitive, Fn&& fn)
+{
+  if (primitive.contains("attributes") && primitive["attributes"].is_object())
+  {
+    for (auto& item : primitive["attributes"].items()) fn(item.value());
+  }
+  if (primitive.contains("indices")) fn(primitive["indices"]);
+  if (primitive.contains("targets") && primitive["targets"].is_array())
+  {
+    for (auto& target : primitive["targets"])
+    {
+      if (!target.is_object()) continue;
+      for (auto& item : target.items()) fn(item.value());
+    }
+  }
+}
+
+// The primitive's material and those its KHR_materials_variants mappings
+// switch to.
+template <typename Json, typename Fn>
+void forEachPrimitiveMaterial(Json& primitive, Fn&& fn)
+{
+  if (primitive.contains("material")) fn(primitive["material"]);
+  if (!primitive.contains("extensions") || !primitive["extensions"].is_object()) return;
+  auto& extensions = primitive["extensions"];
+  if (!extensions.contains("KHR_materials_variants") || arraySize(extensions["KHR_materials_variants"], "mappings") == 0)
+  {
+    return;
+  }
+  for (auto& mapping : extensions["KHR_materials_variants"]["mappings"])
+  {
+    if (mapping.is_object() && mapping.contains("material")) fn(mapping["material"]);
+  }
+}
+
+// Per-instance attributes of EXT_mesh_gpu_instancing.
+template <typename Json, typename Fn>
+void forEachNodeAccessor(Json& node, Fn&& fn)
+{
+  if (!node.contains("extensions") || !node["extensions"].is_object()) return;
+  auto& extensions = node["extensions"];
+  if (!extensions.contains("EXT_mesh_gpu_instancing") || !extensions["EXT_mesh_gpu_instancing"].is_object()) return;
+  auto& instancing = extensions["EXT_mesh_gpu_instancing"];
+  if (!instancing.contains("attributes") || !instancing["attributes"].is_object()) return;
+  for (auto& item : instancing["attributes"].items()) fn(item.value());
+}
+
+// Texture infos are the objects under keys ending in "Texture", in the
+// core material and in its extensions alike.
+template <typename Json, typename Fn>
+void forEachMaterialTexture(Json& value, Fn&& fn)
+{
+  if (value.is_object())
+  {
+    for (auto& item : value.items())
+    {
+      const std::string& key = item.key();
+      auto& child = item.value();
+      if (key.size() > 7 && key.compare(key.size() - 7, 7, "Texture") == 0 && child.is_object() && child.contains("index"))
+      {
+        fn(child["index"]);
+      }
+      forEachMaterialTexture(child, fn);
+    }
+  }
+  else if (value.is_array())
+  {
+    for (auto& child : value) forEachMaterialTexture(child, fn);
+  }
+}
+
+// The texture's image and the alternatives extensions such as
+// KHR_texture_basisu and EXT_texture_webp give.
+template <typename Json, typename Fn>
+void forEachTextureImage(Json& texture, Fn&& fn)
+{
+  if (texture.contains("source")) fn(texture["source"]);
+  if (!texture.contains("extensions") || !texture["extensions"].is_object()) return;
+  for (auto& item : texture["extensions"].items())
+  {
+    if (item.value().is_object() && item.value().contains("source")) fn(item.value()["source"]);
+  }
+}
+
+template <typename Json, typename Fn>
+void forEachAccessorView(Json& accessor, Fn&& fn)
+{
+  if (accessor.contains("bufferView")) fn(accessor["bufferView"]);
+  if (!accessor.contains("sparse") || !accessor["sparse"].is_object()) return;
+  for (const char* part : { "indices", "values" })
+  {
+    auto& sparse = accessor["sparse"];
+    if (sparse.contains(part) && sparse[part].is_object() && sparse[part].contains("bufferView")) fn(sparse[part]["bufferView"]);
+  }
+}
+
+// Follows path from the scene's root nodes.
+bool findNode(const json& source, std::vector<int> candidates, const std::string& path, int& node, std::string& error)
+{
+  node = -1;
+  for (size_t start = 0; start <= path.size();)
+  {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) end = path.size();
+    const std::string step = path.substr(start, end - start);
+    start = end + 1;
+    if (step.empty()) continue;
+
+    // "#3" is node 3; "#", "#x" and "#3x" are only names.
+    int wanted = -1;
+    if (step[0] == '#')
+    {
+      const char* last = step.data() + step.size();
+      unsigned index;
+      const auto [ptr, ec] = std::from_chars(step.data() + 1, last, index);
+      if (ec == std::errc() && ptr == last && index <= INT_MAX) wanted = static_cast<int>(index);
+    }
+    int found = -1;
+    for (int candidate : candidates)
+    {
+      const json& value = element(source, "nodes", candidate);
+      if (candidate == wanted || (value.contains("name") && value["name"] == step))
+      {
+        found = candidate;
+        break;
+      }
+    }
+    if (found < 0)
+    {
+      error = "no node " + step + (node < 0 ? " at the root of the scene" : " under node " + std::to_string(node));
+      return false;
+    }
+    node = found;
+    candidates = indicesOf(element(source, "nodes", node), "children");
+  }
+  if (node < 0) error = "empty node path";
+  return node >= 0;
+}
+
+void appendLe32(std::vector<unsigned char>& out, uint32_t value)
+{
+  for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<unsigned char>(value >> shift));
+}
+
+struct ViewRange {
+  int view;
+  int buffer;
+  uint64_t offset;
+  uint64_t length;
+};
+
+// Reads the kept buffer views into bin, one read per run of nearby ranges,
+// and sets their offsets in it. A run starts 4-byte aligned in its buffer,
+// so each view keeps its alignment.
+bool readViews(GltfFile& file, const Selection& views, std::vector<unsigned char>& bin, std::vector<uint64_t>& offsets,
+               std::string& error)
+{
+  std::vector<ViewRange> ranges;
+  for (size_t i = 0; i < views.kept.size(); ++i)
+  {
+    if (!views.kept[i]) continue;
+    ViewRange range;
+    range.view = static_cast<int>(i);
+    // Runs are merged on offset + length, so it must not wrap; the buffer
+    // read checks the range itself.
+    if (!readBufferView(file.json["bufferViews"][i], range.buffer, range.offset, range.length) ||
+        range.offset > UINT64_MAX - kMergeGap || range.length > UINT64_MAX - kMergeGap - range.offset)
+    {
+      error = "buffer view " + std::to_string(i) + " is invalid";
+      return false;
+    }
+    ranges.push_back(range);
+  }
+  std::sort(ranges.begin(), ranges.end(), [](const ViewRange& a, const ViewRange& b) {
+    return a.buffer != b.buffer ? a.buffer < b.buffer : a.offset < b.offset;
+  });
+
+  offsets.assign(views.kept.size(), 0);
+  std::vector<unsigned char> run;
+  for (size_t i = 0; i < ranges.size();)
+  {
+    const int buffer = ranges[i].buffer;
+    const uint64_t start = ranges[i].offset / 4 * 4;
+    uint64_t end = ranges[i].offset + ranges[i].length;
+    size_t last = i + 1;
+    for (; last < ranges.size() && ranges[last].buffer == buffer && ranges[last].offset <= end + kMergeGap; ++last)
+    {
+      end = std::max(end, ranges[last].offset + ranges[last].length);
+    }
+    if (!readBufferRange(file, buffer, start, end - start, run, error)) return false;
+
+    bin.resize((bin.size() + 3) / 4 * 4);
+    const uint64_t base = bin.size();
+    bin.insert(bin.end(), run.begin(), run.end());
+    for (; i < last; ++i) offsets[ranges[i].view] = base + ranges[i].offset - start;
+  }
+  return true;
+}
+
+bool buildSubset(GltfFile& file, const ModelSubset& subset, std::vector<unsigned char>& glb, std::string& error)
+{
+  const json& source = file.json;
+  const int sceneIndex = subset.scene >= 0 ? subset.scene : std::max(indexOf(source, "scene"), 0);
+  if (static_cast<size_t>(sceneIndex) >= arraySize(source, "scenes"))
+  {
+    error = "no scene " + std::to_string(sceneIndex);
+    return false;
+  }
+  const json& scene = element(source, "scenes", sceneIndex);
+  std::vector<int> roots = indicesOf(scene, "nodes");
+  if (!subset.nodePath.empty())
+  {
+    int node;
+    if (!findNode(source, roots, subset.nodePath, node, error)) return false;
+    roots = { node };
+  }
+
+  Selection nodes, meshes, skins, animations, materials, textures, images, accessors, views;
+  const size_t nodeCount = arraySize(source, "nodes");
+  nodes.kept.assign(nodeCount, false);
+  meshes.kept.assign(arraySize(source, "meshes"), false);
+  skins.kept.assign(arraySize(source, "skins"), false);
+  animations.kept.assign(arraySize(source, "animations"), false);
+  materials.kept.assign(arraySize(source, "materials"), false);
+  textures.kept.assign(arraySize(source, "textures"), false);
+  images.kept.assign(arraySize(source, "images"), false);
+  accessors.kept.assign(arraySize(source, "accessors"), false);
+  views.kept.assign(arraySize(source, "bufferViews"), false);
+  auto keepIn = [](Selection& selection) { return [&selection](const json& value) { if (value.is_number_integer()) keep(selection, value.get<int>()); }; };
+
+  std::vector<int> parents(nodeCount, -1);
+  for (size_t n = 0; n < nodeCount; ++n)
+  {
+    for (int child : indicesOf(element(source, "nodes", static_cast<int>(n)), "children"))
+    {
+      if (child >= 0 && static_cast<size_t>(child) < nodeCount) parents[child] = static_cast<int>(n);
+    }
+  }
+
+  // The subtree is drawn; nodes added later only carry joint transforms.
+  std::vector<int> stack = roots;
+  while (!stack.empty())
+  {
+    const int n = stack.back();
+    stack.pop_back();
+    if (!keep(nodes, n)) continue;
+    for (int child : indicesOf(element(source, "nodes", n), "children")) stack.push_back(child);
+  }
+  const std::vector<bool> drawn = nodes.kept;
+  // The selected roots stay scene roots even when a skin keeps their
+  // ancestors, so those ancestors' transforms never reach the subtree.
+  std::vector<bool> isRoot(nodeCount, false);
+  for (int root : roots)
+  {
+    if (kept(nodes, root)) isRoot[root] = true;
+  }
+
+  for (size_t n = 0; n < nodeCount; ++n)
+  {
+    if (!drawn[n]) continue;
+    const json& node = element(source, "nodes", static_cast<int>(n));
+    keep(meshes, indexOf(node, "mesh"));
+    forEachNodeAccessor(node, keepIn(accessors));
+    const int skin = indexOf(node, "skin");
+    if (!keep(skins, skin)) continue;
+    const json& value = element(source, "skins", skin);
+    keep(accessors, indexOf(value, "inverseBindMatrices"));
+    std::vector<int> joints = indicesOf(value, "joints");
+    joints.push_back(indexOf(value, "skeleton"));
+    for (int joint : joints)
+    {
+      for (int ancestor = joint; keep(nodes, ancestor); ancestor = parents[ancestor]) {}
+    }
+  }
+
+  for (size_t m = 0; m < meshes.kept.size(); ++m)
+  {
+    if (!meshes.kept[m]) continue;
+    const json& mesh = element(source, "meshes", static_cast<int>(m));
+    for (size_t p = 0; p < arraySize(mesh, "primitives"); ++p)
+    {
+      const json& primitive = mesh["primitives"][p];
+      if (!primitive.is_object()) continue;
+      forEachPrimitiveAccessor(primitive, keepIn(accessors));
+      forEachPrimitiveMaterial(primitive, keepIn(materials));
+    }
+  }
+
+  // Channels animating kept nodes; morph weights only where the mesh is kept.
+  auto keepsChannel = [&](const json& channel) {
+    const json& target = channel.is_object() && channel.contains("target") ? channel["target"] : channel;
+    const int node = indexOf(target, "node");
+    return kept(nodes, node) && (drawn[node] || !target.contains("path") || target["path"] != "weights");
+  };
+  std::vector<Selection> samplers(animations.kept.size());
+  for (size_t a = 0; a < animations.kept.size(); ++a)
+  {
+    const json& animation = element(source, "animations", static_cast<int>(a));
+    samplers[a].kept.assign(arraySize(animation, "samplers"), false);
+    for (size_t c = 0; c < arraySize(animation, "channels"); ++c)
+    {
+      const json& channel = animation["channels"][c];
+      if (!keepsChannel(channel)) continue;
+      const int sampler = indexOf(channel, "sampler");
+      if (!keep(samplers[a], sampler)) continue;
+      keep(animations, static_cast<int>(a));
+      const json& value = element(animation, "samplers", sampler);
+      keep(accessors, indexOf(value, "input"));
+      keep(accessors, indexOf(value, "output"));
+    }
+  }
+
+  for (size_t m = 0; m < materials.kept.size(); ++m)
+  {
+    if (materials.kept[m]) forEachMaterialTexture(source["materials"][m], keepIn(textures));
+  }
+  for (size_t t = 0; t < textures.kept.size(); ++t)
+  {
+    if (textures.kept[t]) forEachTextureImage(element(source, "textures", static_cast<int>(t)), keepIn(images));
+  }
+  for (size_t i = 0; i < images.kept.size(); ++i)
+  {
+    if (images.kept[i]) keep(views, indexOf(element(source, "images", static_cast<int>(i)), "bufferView"));
+  }
+  for (size_t a = 0; a < accessors.kept.size(); ++a)
+  {
+    if (accessors.kept[a]) forEachAccessorView(element(source, "accessors", static_cast<int>(a)), keepIn(views));
+  }
+
+  for (Selection* selection : { &nodes, &meshes, &skins, &animations, &materials, &textures, &images, &accessors, &views })
+  {
+    numberSelection(*selection);
+  }
+  for (Selection& selection : samplers) numberSelection(selection);
+  auto remapTo = [](const Selection& selection) { return [&selection](json& value) { value = remap(selection, value); }; };
+
+  std::vector<unsigned char> bin;
+  std::vector<uint64_t> offsets;
+  if (!readViews(file, views, bin, offsets, error)) return false;
+
+  json out = json::object();
+  for (const char* key : { "asset", "extensionsUsed", "extensionsRequired", "extensions", "extras", "samplers", "cameras" })
+  {
+    if (source.contains(key)) out[key] = source[key];
+  }
+
+  json sceneRoots = json::array();
+  for (size_t n = 0; n < nodeCount; ++n)
+  {
+    if (nodes.kept[n] && (isRoot[n] || !kept(nodes, parents[n]))) sceneRoots.push_back(nodes.index[n]);
+  }
+  json newScene = { { "nodes", sceneRoots } };
+  if (scene.contains("name")) newScene["name"] = scene["name"];
+  out["scenes"] = json::array({ newScene });
+  out["scene"] = 0;
+
+  out["nodes"] = selectedArray(source, "nodes", nodes, [&](json& node, int n) {
+    if (drawn[n])
+    {
+      if (node.contains("mesh")) node["mesh"] = remap(meshes, node["mesh"]);
+      if (node.contains("skin")) node["skin"] = remap(skins, node["skin"]);
+      forEachNodeAccessor(node, remapTo(accessors));
+    }
+    else
+    {
+      node.erase("mesh");
+      node.erase("skin");
+      node.erase("weights");
+      if (node.contains("extensions") && node["extensions"].is_object()) node["extensions"].erase("EXT_mesh_gpu_instancing");
+    }
+    json children = json::array();
+    for (int child : indicesOf(node, "children"))
+    {
+      if (kept(nodes, child) && !isRoot[child]) children.push_back(nodes.index[child]);
+    }
+    if (children.empty()) node.erase("children");
+    else node["children"] = children;
+  });
+  out["meshes"] = selectedArray(source, "meshes", meshes, [&](json& mesh, int) {
+    if (!mesh.contains("primitives") || !mesh["primitives"].is_array()) return;
+    for (json& primitive : mesh["primitives"])
+    {
+      if (!primitive.is_object()) continue;
+      forEachPrimitiveAccessor(primitive, remapTo(accessors));
+      forEachPrimitiveMaterial(primitive, remapTo(materials));
+    }
+  });
+  out["skins"] = selectedArray(source, "skins", skins, [&](json& skin, int) {
+    if (skin.contains("inverseBindMatrices")) skin["inverseBindMatrices"] = remap(accessors, skin["inverseBindMatrices"]);
+    if (skin.contains("skeleton")) skin["skeleton"] = remap(nodes, skin["skeleton"]);
+    if (skin.contains("joints") && skin["joints"].is_array())
+    {
+      for (json& joint : skin["joints"]) joint = remap(nodes, joint);
+    }
+  });
+  out["animations"] = selectedArray(source, "animations", animations, [&](json& animation, int a) {
+    json channels = json::array();
+    for (size_t c = 0; c < arraySize(animation, "channels"); ++c)
+    {
+      json channel = animation["channels"][c];
+      if (!keepsChannel(channel)) continue;
+      channel["sampler"] = remap(samplers[a], channel["sampler"]);
+      channel["target"]["node"] = remap(nodes, channel["target"]["node"]);
+      channels.push_back(std::move(channel));
+    }
+    animation["channels"] = std::move(channels);
+    animation["samplers"] = selectedArray(animation, "samplers", samplers[a], [&](json& sampler, int) {
+      sampler["input"] = remap(accessors, sampler["input"]);
+      sampler["output"] = remap(accessors, sampler["output"]);
+    });
+  });
+  out["materials"] = selectedArray(source, "materials", materials, [&](json& material, int) {
+    forEachMaterialTexture(material, remapTo(textures));
+  });
+  out["textures"] = selectedArray(source, "textures", textures, [&](json& texture, int) {
+    forEachTextureImage(texture, remapTo(images));
+  });
+  out["images"] = selectedArray(source, "images", images, [&](json& image, int) {
+    if (image.contains("bufferView")) image["bufferView"] = remap(views, image["bufferView"]);
+  });
+  out["accessors"] = selectedArray(source, "accessors", accessors, [&](json& accessor, int) {
+    forEachAccessorView(accessor, remapTo(views));
+  });
+  out["bufferViews"] = selectedArray(source, "bufferViews", views, [&](json& view, int v) {
+    view["buffer"] = 0;
+    view["byteOffset"] = offsets[v];
+  });
+  if (!bin.empty()) out["buffers"] = json::array({ { { "byteLength", bin.size() } } });
+  for (const char* key : { "nodes", "meshes", "skins", "animations", "materials", "textures", "images", "accessors", "bufferViews" })
+  {
+    if (out[key].empty()) out.erase(key);
+  }
+
+  std::string text = out.dump();
+  text.resize((text.size() + 3) / 4 * 4, ' ');
+  bin.resize((bin.size() + 3) / 4 * 4, 0);
+  const uint64_t total = 20 + text.size() + (bin.empty() ? 0 : 8 + bin.size());
+  if (total > UINT32_MAX)
+  {
+    error = "the subset is too large for a GLB";
+    return false;
+  }
+  glb.clear();
+  glb.reserve(total);
+  appendLe32(glb, kGlbMagic);
+  appendLe32(glb, 2);
+  appendLe32(glb, static_cast<uint32_t>(total));
+  appendLe32(glb, static_cast<uint32_t>(text.size()));
+  appendLe32(glb, kGlbChunkJson);
+  glb.insert(glb.end(), text.begin(), text.end());
+  if (!bin.empty())
+  {
+    appendLe32(glb, static_cast<uint32_t>(bin.size()));
+    appendLe32(glb, kGlbChunkBin);
+    glb.insert(glb.end(), bin.begin(), bin.end());
+  }
+  return true;
+}
+
+}
+
+bool isWholeModel(const ModelSubset& subset)
+{
+  return subset.scene < 0 && subset.nodePath.empty();
+}
+
+bool readModelSubset(const std::string& path, const ModelSubset& subset, std::vector<unsigned char>& glb,
+                     std::string& error)
+{
+  GltfFile file;
+  if (!openGltfFile(file, path, error)) return false;
+  const bool built = buildSubset(file, subset, glb, error);
+  closeGltfFile(file);
+  return built;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Part of a model to load: one scene, or the subtree under one node. Only
+// what that part draws is read from disk (its meshes, accessors, materials,
+// textures, images, skins and animation channels, with the buffer ranges
+// behind them), so loading a small piece of a large file costs about what
+// the piece would cost on its own.
+
+struct ModelSubset {
+  // Scene to load, or -1 for the default scene.
+  int scene = -1;
+  // Path from a root node of the scene to the node whose subtree to load,
+  // separated by '/'; each step is a node name or #index. A subtree loses
+  // the transforms of the node's ancestors. Empty loads the whole scene.
+  std::string nodePath;
+};
+
+// True when subset asks for the model as it is: no scene and no node.
+bool isWholeModel(const ModelSubset& subset);
+
+// Builds a GLB in memory with only the glTF objects subset needs, and a
+// binary chunk holding only the byte ranges of the buffers they use, read
+// with pread(). Nearby ranges are read together. Skinned meshes keep their
+// joints and the joints' ancestors, without those nodes' meshes. External
+// and data: URI images are kept as references. error says what is wrong on
+// failure.
+bool readModelSubset(const std::string& path, const ModelSubset& subset, std::vector<unsigned char>& glb,
+                     std::string& error);
@@ -0,0 +1,336 @@
+#include "morph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "accessor.h"
+#include "parallel.h"
+#include "runtime_scene.h"
+
+namespace {
+
+const GLuint kWorkgroupSize = 64;
+
+const char* kMorphSource = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+
+layout (std430, binding = 0) readonly buffer DeltaVertices { uint deltaVertices[]; };
+layout (std430, binding = 1) readonly buffer Deltas { vec4 deltas[]; };
+layout (std430, binding = 2) buffer Morphed { vec4 morphed[]; };
+
+uniform uint firstDelta;
+uniform uint deltaCount;
+uniform float weight;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= deltaCount)
+        return;
+
+    // A target lists each vertex once, so invocations never collide.
+    uint d = firstDelta + i;
+    uint v = deltaVertices[d];
+    morphed[2 * v] += weight * deltas[2 * d];
+    morphed[2 * v + 1] += weight * deltas[2 * d + 1];
+}
+)";
+
+int targetAttribute(const std::map<std::string, int>& target, const char* name)
+{
+  const auto it = target.find(name);
+  return it == target.end() ? -1 : it->second;
+}
+
+// One morphed primitive as read by prepareMorphPrimitive(), with its deltas
+// still local until they are appended to the shared arrays.
+struct PreparedMorph {
+  bool valid = false;
+  uint32_t vertexCount = 0;
+  std::vector<glm::vec4> base;
+  // Per target, the end of its deltas in deltaVertices.
+  std::vector<uint32_t> targetEnds;
+  std::vector<uint32_t> deltaVertices;
+  std::vector<glm::vec4> deltas;
+};
+
+// Reads the base vertices and sparse targets of one primitive. Leaves valid
+// false when it has no usable targets.
+void prepareMorphPrimitive(PreparedMorph& morph, const tinygltf::Model& gltfmodel, const tinygltf::Primitive& source)
+{
+  std::vector<glm::vec4> positions;
+  std::vector<glm::vec4> normals;
+  const int position = primitiveAttribute(source, kAttribPosition);
+  const int normal = primitiveAttribute(source, kAttribNormal);
+  if (position < 0 || !readAccessor(gltfmodel, position, positions, 1.0f)) return;
+  if (normal >= 0 && (!readAccessor(gltfmodel, normal, normals, 0.0f) || normals.size() < positions.size()))
+  {
+    normals.clear();
+  }
+
+  morph.vertexCount = static_cast<uint32_t>(positions.size());
+  std::vector<glm::vec4> positionDeltas;
+  std::vector<glm::vec4> normalDeltas;
+  for (const std::map<std::string, int>& target : source.targets)
+  {
+    const int positionTarget = targetAttribute(target, "POSITION");
+    const int normalTarget = normals.empty() ? -1 : targetAttribute(target, "NORMAL");
+    positionDeltas.clear();
+    normalDeltas.clear();
+    if ((positionTarget >= 0 && !readAccessor(gltfmodel, positionTarget, positionDeltas, 0.0f)) ||
+        (normalTarget >= 0 && !readAccessor(gltfmodel, normalTarget, normalDeltas, 0.0f)))
+    {
+      std::printf("Ignoring morph target with an unreadable accessor\n");
+      positionDeltas.clear();
+      normalDeltas.clear();
+    }
+    positionDeltas.resize(positions.size(), glm::vec4(0.0f));
+    normalDeltas.resize(positions.size(), glm::vec4(0.0f));
+
+    for (uint32_t v = 0; v < morph.vertexCount; ++v)
+    {
+      const glm::vec4 dp(glm::vec3(positionDeltas[v]), 0.0f);
+      const glm::vec4 dn(glm::vec3(normalDeltas[v]), 0.0f);
+      if (dp == glm::vec4(0.0f) && dn == glm::vec4(0.0f)) continue;
+      morph.deltaVertices.push_back(v);
+      morph.deltas.push_back(dp);
+      morph.deltas.push_back(dn);
+    }
+    morph.targetEnds.push_back(static_cast<uint32_t>(morph.deltaVertices.size()));
+  }
+
+  morph.base.resize(positions.size() * 2);
+  for (size_t v = 0; v < positions.size(); ++v)
+  {
+    morph.base[2 * v] = glm::vec4(glm::vec3(positions[v]), 1.0f);
+    morph.base[2 * v + 1] = normals.empty() ? glm::vec4(0.0f) : glm::vec4(glm::vec3(normals[v]), 0.0f);
+  }
+  morph.valid = true;
+}
+
+const tinygltf::Primitive& sourcePrimitive(const RuntimeScene& scene, const tinygltf::Model& gltfmodel, uint32_t mesh,
+                                           uint32_t primitive)
+{
+  return gltfmodel.meshes[mesh].primitives[scene.primitives[primitive].sourcePrimitive];
+}
+
+}
+
+bool prepareMorphs(RuntimeScene& scene, MorphUploads& uploads, const tinygltf::Model& gltfmodel)
+{
+  MorphData& morphs = scene.morphs;
+  const SceneGraph& graph = scene.graph;
+
+  // (mesh, runtime primitive) of every primitive with targets.
+  std::vector<std::pair<uint32_t, uint32_t>> sources;
+  for (uint32_t m = 0; m < scene.meshes.size(); ++m)
+  {
+    const RuntimeMesh& mesh = scene.meshes[m];
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      if (!sourcePrimitive(scene, gltfmodel, m, p).targets.empty()) sources.emplace_back(m, p);
+    }
+  }
+  std::vector<PreparedMorph> prepared(sources.size());
+  parallelFor(sources.size(), [&](size_t i) {
+    prepareMorphPrimitive(prepared[i], gltfmodel, sourcePrimitive(scene, gltfmodel, sources[i].first, sources[i].second));
+  });
+
+  morphs.primitiveMorph.assign(scene.primitives.size(), -1);
+  for (size_t i = 0; i < sources.size(); ++i)
+  {
+    PreparedMorph& morph = prepared[i];
+    if (!morph.valid) continue;
+    morphs.primitiveMorph[sources[i].second] = static_cast<int32_t>(morphs.primitives.size());
+    MorphPrimitive primitive;
+    primitive.firstTarget = static_cast<uint32_t>(morphs.targets.size());
+    primitive.targetCount = static_cast<uint32_t>(morph.targetEnds.size());
+    primitive.vertexCount = morph.vertexCount;
+    morphs.primitives.push_back(primitive);
+
+    const uint32_t firstDelta = static_cast<uint32_t>(uploads.deltaVertices.size());
+    uint32_t start = 0;
+    for (uint32_t end : morph.targetEnds)
+    {
+      morphs.targets.push_back(MorphTarget{ firstDelta + start, end - start });
+      start = end;
+    }
+    uploads.deltaVertices.insert(uploads.deltaVertices.end(), morph.deltaVertices.begin(), morph.deltaVertices.end());
+    uploads.deltas.insert(uploads.deltas.end(), morph.deltas.begin(), morph.deltas.end());
+    uploads.base.push_back(std::move(morph.base));
+  }
+  if (morphs.primitives.empty()) return true;
+
+  morphs.nodeFirstDraw.assign(nodeCount(graph), -1);
+  for (uint32_t i = 0; i < nodeCount(graph); ++i)
+  {
+    const int32_t meshIndex = graph.mesh[i];
+    if (meshIndex < 0 || graph.weightCount[i] == 0) continue;
+    const RuntimeMesh& mesh = scene.meshes[meshIndex];
+    const auto first = morphs.primitiveMorph.begin() + mesh.firstPrimitive;
+    if (std::all_of(first, first + mesh.primitiveCount, [](int32_t morph) { return morph < 0; })) continue;
+
+    MorphedNode node;
+    node.node = i;
+    node.firstDraw = static_cast<uint32_t>(morphs.draws.size());
+    node.drawCount = mesh.primitiveCount;
+    morphs.nodeFirstDraw[i] = static_cast<int32_t>(node.firstDraw);
+    morphs.nodes.push_back(node);
+
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      MorphedDraw draw;
+      draw.primitive = morphs.primitiveMorph[p];
+      morphs.draws.push_back(draw);
+    }
+  }
+
+  // NaN never compares equal, so every node is built on the first pass.
+  morphs.appliedWeights.assign(graph.weights.size(), std::nanf(""));
+  return true;
+}
+
+void uploadMorphs(RuntimeScene& scene, MorphUploads& uploads, const tinygltf::Model& gltfmodel)
+{
+  MorphData& morphs = scene.morphs;
+  for (size_t i = 0; i < morphs.primitives.size(); ++i)
+  {
+    const std::vector<glm::vec4>& base = uploads.base[i];
+    glCreateBuffers(1, &morphs.primitives[i].base);
+    glNamedBufferStorage(morphs.primitives[i].base, base.size() * sizeof(glm::vec4), base.data(), 0);
+  }
+
+  if (!uploads.deltaVertices.empty())
+  {
+    glCreateBuffers(1, &morphs.deltaVertexBuffer);
+    glCreateBuffers(1, &morphs.deltaBuffer);
+    glNamedBufferStorage(morphs.deltaVertexBuffer, uploads.deltaVertices.size() * sizeof(uint32_t),
+                         uploads.deltaVertices.data(), 0);
+    glNamedBufferStorage(morphs.deltaBuffer, uploads.deltas.size() * sizeof(glm::vec4), uploads.deltas.data(), 0);
+  }
+
+  for (const MorphedNode& node : morphs.nodes)
+  {
+    const uint32_t meshIndex = static_cast<uint32_t>(scene.graph.mesh[node.node]);
+    const RuntimeMesh& mesh = scene.meshes[meshIndex];
+    for (uint32_t d = 0; d < node.drawCount; ++d)
+    {
+      MorphedDraw& draw = morphs.draws[node.firstDraw + d];
+      if (draw.primitive < 0) continue;
+      const MorphPrimitive& morph = morphs.primitives[draw.primitive];
+      const uint32_t p = mesh.firstPrimitive + d;
+      glCreateBuffers(1, &draw.output);
+      glNamedBufferStorage(draw.output, size_t(morph.vertexCount) * 2 * sizeof(glm::vec4), nullptr, 0);
+      draw.vao = createDeformedVao(scene, gltfmodel, sourcePrimitive(scene, gltfmodel, meshIndex, p), scene.primitives[p],
+                                   draw.output);
+    }
+  }
+}
+
+void destroyMorphs(MorphData& morphs)
+{
+  for (const MorphedDraw& draw : morphs.draws)
+  {
+    glDeleteVertexArrays(1, &draw.vao);
+    glDeleteBuffers(1, &draw.output);
+  }
+  for (const MorphPrimitive& primitive : morphs.primitives)
+  {
+    glDeleteBuffers(1, &primitive.base);
+  }
+  glDeleteBuffers(1, &morphs.deltaVertexBuffer);
+  glDeleteBuffers(1, &morphs.deltaBuffer);
+  morphs = MorphData{};
+}
+
+bool createMorphProgram(MorphProgram& morph)
+{
+  GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(shader, 1, &kMorphSource, nullptr);
+  glCompileShader(shader);
+  int success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+    std::printf("ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n%s\n", infoLog);
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetProgramInfoLog(program, 512, nullptr, infoLog);
+    std::printf("ERROR::PROGRAM::LINK_FAILED\n%s\n", infoLog);
+  }
+  glDeleteShader(shader);
+
+  morph.program = program;
+  morph.firstDeltaLoc = glGetUniformLocation(program, "firstDelta");
+  morph.deltaCountLoc = glGetUniformLocation(program, "deltaCount");
+  morph.weightLoc = glGetUniformLocation(program, "weight");
+  return success;
+}
+
+void runMorphPass(const MorphProgram& program, RuntimeScene& scene)
+{
+  MorphData& morphs = scene.morphs;
+  const SceneGraph& graph = scene.graph;
+  bool programBound = false;
+  for (const MorphedNode& node : morphs.nodes)
+  {
+    const uint32_t firstWeight = graph.firstWeight[node.node];
+    const uint32_t weightCount = graph.weightCount[node.node];
+    const float* weights = graph.weights.data() + firstWeight;
+    float* applied = morphs.appliedWeights.data() + firstWeight;
+    if (std::equal(weights, weights + weightCount, applied)) continue;
+    std::copy(weights, weights + weightCount, applied);
+
+    morphs.activeTargets.clear();
+    for (uint32_t t = 0; t < weightCount; ++t)
+    {
+      if (weights[t] != 0.0f) morphs.activeTargets.push_back(t);
+    }
+
+    if (!programBound)
+    {
+      // The copies below overwrite outputs that earlier passes wrote from
+      // the shader, which buffer updates do not wait for on their own.
+      glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+      glUseProgram(program.program);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, morphs.deltaVertexBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, morphs.deltaBuffer);
+      programBound = true;
+    }
+    for (uint32_t d = node.firstDraw; d < node.firstDraw + node.drawCount; ++d)
+    {
+      const MorphedDraw& draw = morphs.draws[d];
+      if (draw.primitive < 0) continue;
+      const MorphPrimitive& morph = morphs.primitives[draw.primitive];
+      glCopyNamedBufferSubData(morph.base, draw.output, 0, 0, size_t(morph.vertexCount) * 2 * sizeof(glm::vec4));
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, draw.output);
+
+      bool written = false;
+      for (uint32_t t : morphs.activeTargets)
+      {
+        if (t >= morph.targetCount) break;
+        const MorphTarget& target = morphs.targets[morph.firstTarget + t];
+        if (target.deltaCount == 0) continue;
+        // Targets may move the same vertices, so each one waits for the last.
+        if (written) glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1ui(program.firstDeltaLoc, target.firstDelta);
+        glUniform1ui(program.deltaCountLoc, target.deltaCount);
+        glUniform1f(program.weightLoc, weights[t]);
+        glDispatchCompute((target.deltaCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+        written = true;
+      }
+    }
+  }
+  if (programBound) glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
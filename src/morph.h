@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "tiny_gltf.h"
+
+struct RuntimeScene;
+
+// Morph targets. Each target is stored sparsely, as the vertices it actually
+// moves with their position and normal deltas, since most targets of facial
+// or configurator rigs touch a small part of the mesh. Every frame a node
+// whose weights changed has its active (non-zero) targets compacted, and a
+// compute pass starts from the base vertices and adds one target at a time,
+// so the cost follows the displaced vertices of the active targets only.
+// The result feeds the skinning pre-pass when the node is skinned too.
+
+struct MorphTarget {
+  // Range in the delta buffers.
+  uint32_t firstDelta = 0;
+  uint32_t deltaCount = 0;
+};
+
+struct MorphPrimitive {
+  uint32_t firstTarget = 0;
+  uint32_t targetCount = 0;
+  uint32_t vertexCount = 0;
+  // Unmorphed position and normal per vertex, 32 bytes apart.
+  GLuint base = 0;
+};
+
+struct MorphedNode {
+  uint32_t node = 0;  // flat scene graph index
+  // One MorphedDraw per primitive of the node's mesh, starting here.
+  uint32_t firstDraw = 0;
+  uint32_t drawCount = 0;
+};
+
+struct MorphedDraw {
+  int32_t primitive = -1;  // MorphData::primitives index, -1 when unmorphed
+  // Morphed position and normal per vertex, 32 bytes apart.
+  GLuint output = 0;
+  // Draws output in place of the primitive's own VAO when the node is not
+  // skinned.
+  GLuint vao = 0;
+};
+
+struct MorphData {
+  std::vector<MorphPrimitive> primitives;
+  // Per runtime primitive, its MorphPrimitive or -1.
+  std::vector<int32_t> primitiveMorph;
+  std::vector<MorphTarget> targets;
+  std::vector<MorphedNode> nodes;
+  std::vector<MorphedDraw> draws;
+  // Per flat node, the first of its MorphedDraws or -1.
+  std::vector<int32_t> nodeFirstDraw;
+  // Vertex index and (position, normal) delta pair of every sparse delta.
+  GLuint deltaVertexBuffer = 0;
+  GLuint deltaBuffer = 0;
+  // Weights the outputs were last built with, parallel to SceneGraph::weights.
+  std::vector<float> appliedWeights;
+  // Scratch list of the targets with a non-zero weight.
+  std::vector<uint32_t> activeTargets;
+};
+
+// Vertex data prepareMorphs() leaves for uploadMorphs().
+struct MorphUploads {
+  // Per MorphPrimitive, its base vertices.
+  std::vector<std::vector<glm::vec4>> base;
+  // Vertex index and (position, normal) delta pair of every sparse delta.
+  std::vector<uint32_t> deltaVertices;
+  std::vector<glm::vec4> deltas;
+};
+
+// CPU half: reads the targets of every morphed primitive in parallel and
+// lists the morphed nodes. Runs after the primitives are prepared; no GL.
+bool prepareMorphs(RuntimeScene& scene, MorphUploads& uploads, const tinygltf::Model& gltfmodel);
+
+// GL half: creates the buffers and deformed VAOs. Runs after the primitives
+// are uploaded and before uploadSkins().
+void uploadMorphs(RuntimeScene& scene, MorphUploads& uploads, const tinygltf::Model& gltfmodel);
+
+void destroyMorphs(MorphData& morphs);
+
+struct MorphProgram {
+  GLuint program = 0;
+  GLint firstDeltaLoc = -1;
+  GLint deltaCountLoc = -1;
+  GLint weightLoc = -1;
+};
+
+bool createMorphProgram(MorphProgram& morph);
+
+// Rebuilds the outputs of nodes whose weights changed since the last call.
+// Call after animation and before the skinning pre-pass.
+void runMorphPass(const MorphProgram& program, RuntimeScene& scene);
@@ -0,0 +1,321 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Spins before an idle worker goes to sleep.
+const int kIdleSpins = 256;
+// parallelFor aims for this many pieces per worker.
+const size_t kPiecesPerWorker = 4;
+// Jobs a worker's queue holds; pushing onto a full queue runs the job inline.
+const size_t kQueueCapacity = 1024;
+
+struct Job {
+  void (*run)(const Job& job) = nullptr;
+  const void* data = nullptr;
+  size_t begin = 0;
+  size_t end = 0;
+  JobCounter* counter = nullptr;
+};
+
+// Fixed ring of jobs, so queueing never allocates. The owner works at the
+// back, thieves take from the front.
+struct alignas(64) WorkerQueue {
+  std::mutex mutex;
+  Job jobs[kQueueCapacity];
+  size_t front = 0;
+  size_t size = 0;
+};
+
+JobOptions options;
+std::atomic<bool> started {false};
+
+thread_local unsigned queueIndex = 0;
+thread_local uint32_t stealSeed = 0;
+
+void pinCurrentThread(unsigned core)
+{
+#if defined(__linux__)
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % cores, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+  {
+    std::printf("Could not pin thread to core %u\n", core % cores);
+  }
+#else
+  (void)core;
+#endif
+}
+
+struct Scheduler {
+  std::vector<std::thread> threads;
+  std::unique_ptr<WorkerQueue[]> queues;
+  unsigned queueCount = 1;
+  std::atomic<size_t> queued {0};
+  std::atomic<unsigned> sleepers {0};
+  std::atomic<bool> quit {false};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+
+  Scheduler()
+  {
+    started = true;
+    const unsigned n = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    queueCount = n;
+    queues.reset(new WorkerQueue[n]);
+    if (options.pinThreads) pinCurrentThread(0);
+    for (unsigned i = 1; i < n; ++i)
+    {
+      threads.emplace_back([this, i] { workerLoop(i); });
+    }
+  }
+
+  ~Scheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+  }
+
+  void push(const Job& job)
+  {
+    WorkerQueue& queue = queues[queueIndex];
+    bool stored = false;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.size < kQueueCapacity)
+      {
+        queue.jobs[(queue.front + queue.size++) % kQueueCapacity] = job;
+        stored = true;
+      }
+    }
+    if (!stored)
+    {
+      execute(job);
+      return;
+    }
+    queued.fetch_add(1);
+    if (sleepers.load() > 0)
+    {
+      // Taking the lock orders this with a worker between its last check
+      // and its wait, so the wakeup cannot be lost.
+      { std::lock_guard<std::mutex> lock(sleepMutex); }
+      wake.notify_one();
+    }
+  }
+
+  bool pop(Job& job)
+  {
+    if (queued.load(std::memory_order_relaxed) == 0) return false;
+    {
+      WorkerQueue& own = queues[queueIndex];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (own.size > 0)
+      {
+        job = own.jobs[(own.front + --own.size) % kQueueCapacity];
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+
+    // Steal the oldest job, which tends to be the largest piece of a split
+    // range, starting at a random victim.
+    stealSeed = stealSeed * 1664525u + 1013904223u;
+    const unsigned first = (stealSeed >> 16) % queueCount;
+    for (unsigned k = 0; k < queueCount; ++k)
+    {
+      const unsigned victim = (first + k) % queueCount;
+      if (victim == queueIndex) continue;
+      WorkerQueue& queue = queues[victim];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.size > 0)
+      {
+        job = queue.jobs[queue.front];
+        queue.front = (queue.front + 1) % kQueueCapacity;
+        --queue.size;
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workerLoop(unsigned index)
+  {
+    queueIndex = index;
+    stealSeed = index * 2654435761u;
+    if (options.pinThreads) pinCurrentThread(index);
+    Job job;
+    while (!quit.load(std::memory_order_relaxed))
+    {
+      if (pop(job))
+      {
+        execute(job);
+        continue;
+      }
+      bool found = false;
+      for (int spin = 0; spin < kIdleSpins && !found; ++spin)
+      {
+        found = queued.load(std::memory_order_relaxed) > 0;
+        if (!found) std::this_thread::yield();
+      }
+      if (found) continue;
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      sleepers.fetch_add(1);
+      wake.wait(lock, [&] { return quit.load() || queued.load() > 0; });
+      sleepers.fetch_sub(1);
+    }
+  }
+
+  static void execute(const Job& job)
+  {
+    job.run(job);
+    if (job.counter) finish(*job.counter);
+  }
+
+  // A waiter may free the counter once its state reads zero, so that store
+  // is the last touch of it outside the mutex.
+  static void finish(JobCounter& counter);
+};
+
+Scheduler& scheduler()
+{
+  static Scheduler instance;
+  return instance;
+}
+
+void runFunction(const Job& job)
+{
+  std::unique_ptr<std::function<void()>> fn(static_cast<std::function<void()>*>(const_cast<void*>(job.data)));
+  (*fn)();
+}
+
+void queueFunction(std::function<void()> fn, JobCounter* counter)
+{
+  scheduler().push(Job{ runFunction, new std::function<void()>(std::move(fn)), 0, 0, counter });
+}
+
+void Scheduler::finish(JobCounter& counter)
+{
+  const uint32_t before = counter.state.fetch_sub(1, std::memory_order_acq_rel);
+  if (before != (kJobCounterDependents | 1)) return;
+
+  // Last job out with jobs parked: release them. The flag is cleared under
+  // the mutex, which waitForCounter() takes before returning.
+  std::vector<std::pair<std::function<void()>, JobCounter*>> released;
+  {
+    std::lock_guard<std::mutex> lock(counter.mutex);
+    released.swap(counter.dependents);
+    counter.state.fetch_and(~kJobCounterDependents, std::memory_order_acq_rel);
+  }
+  for (auto& dependent : released) queueFunction(std::move(dependent.first), dependent.second);
+}
+
+struct ForTask {
+  void (*fn)(void* context, size_t i);
+  void* context;
+  size_t grain;
+};
+
+void runRange(const Job& job)
+{
+  const ForTask& task = *static_cast<const ForTask*>(job.data);
+  size_t end = job.end;
+  while (end - job.begin > task.grain)
+  {
+    const size_t mid = job.begin + (end - job.begin) / 2;
+    job.counter->state.fetch_add(1, std::memory_order_relaxed);
+    scheduler().push(Job{ runRange, job.data, mid, end, job.counter });
+    end = mid;
+  }
+  for (size_t i = job.begin; i < end; ++i) task.fn(task.context, i);
+}
+
+}
+
+void configureJobs(const JobOptions& jobOptions)
+{
+  if (started)
+  {
+    std::printf("Job system already running, options ignored\n");
+    return;
+  }
+  options = jobOptions;
+}
+
+unsigned workerCount()
+{
+  return scheduler().queueCount;
+}
+
+void submitJob(std::function<void()> fn, JobCounter* counter)
+{
+  if (counter) counter->state.fetch_add(1, std::memory_order_relaxed);
+  queueFunction(std::move(fn), counter);
+}
+
+void submitJobAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter)
+{
+  if (counter) counter->state.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(dependency.mutex);
+    uint32_t state = dependency.state.load(std::memory_order_acquire);
+    while ((state & ~kJobCounterDependents) != 0)
+    {
+      if (dependency.state.compare_exchange_weak(state, state | kJobCounterDependents, std::memory_order_acq_rel))
+      {
+        dependency.dependents.emplace_back(std::move(fn), counter);
+        return;
+      }
+    }
+  }
+  queueFunction(std::move(fn), counter);
+}
+
+void waitForCounter(JobCounter& counter)
+{
+  Scheduler& pool = scheduler();
+  Job job;
+  while (counter.state.load(std::memory_order_acquire) != 0)
+  {
+    if (pool.pop(job)) Scheduler::execute(job);
+    else std::this_thread::yield();
+  }
+  // Wait out a finish() still releasing parked jobs.
+  std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void parallelFor(size_t count, void (*fn)(void* context, size_t i), void* context)
+{
+  if (count == 0) return;
+  const unsigned workers = workerCount();
+  if (count == 1 || workers == 1)
+  {
+    for (size_t i = 0; i < count; ++i) fn(context, i);
+    return;
+  }
+
+  const ForTask task { fn, context, std::max<size_t>(1, count / (workers * kPiecesPerWorker)) };
+  JobCounter counter;
+  counter.state = 1;
+  Scheduler::execute(Job{ runRange, &task, 0, count, &counter });
+  waitForCounter(counter);
+}
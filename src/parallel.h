@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Work-stealing job system, the one place threads are created. Every worker
+// owns a deque: it pushes and pops its own jobs at the back, and a worker that
+// runs dry steals from the front of another's. Threads that are not workers
+// share deque 0. A thread waiting for jobs runs queued jobs in the meantime,
+// so waiting from inside a job does not deadlock.
+
+struct JobOptions {
+  // Threads running jobs, the calling thread included; 0 for one per core.
+  unsigned threads = 0;
+  // Pins worker i to core i, and the thread that starts the pool to core 0.
+  bool pinThreads = false;
+};
+
+// Only takes effect when called before the first job is submitted.
+void configureJobs(const JobOptions& options);
+
+// Threads parallelFor spreads work over, the calling thread included.
+unsigned workerCount();
+
+// Jobs submitted with a counter and not finished yet. Jobs submitted after
+// the counter are parked on it and queued by whichever job brings it to zero.
+struct JobCounter {
+  // Unfinished jobs, with kJobCounterDependents set while jobs are parked.
+  std::atomic<uint32_t> state {0};
+  std::mutex mutex;
+  std::vector<std::pair<std::function<void()>, JobCounter*>> dependents;
+};
+
+const uint32_t kJobCounterDependents = 1u << 31;
+
+// Queues fn. When counter is given it is incremented now and decremented
+// once fn has returned.
+void submitJob(std::function<void()> fn, JobCounter* counter = nullptr);
+
+// Like submitJob(), but fn starts only after dependency has reached zero.
+void submitJobAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter = nullptr);
+
+// Runs queued jobs until counter reaches zero and no jobs are parked on it,
+// after which the counter may be destroyed. With a single thread this is
+// where submitted jobs run.
+void waitForCounter(JobCounter& counter);
+
+// Calls fn(context, i) for every i in [0, count) and returns once all calls
+// have finished. The range is split in halves down to a grain picked from
+// count and the number of workers, so idle workers steal large pieces first.
+// Calls made from inside fn spread over the workers too. Never allocates.
+void parallelFor(size_t count, void (*fn)(void* context, size_t i), void* context);
+
+// parallelFor() taking any callable, e.g. a lambda, by reference.
+template <typename Fn>
+void parallelFor(size_t count, Fn&& fn)
+{
+  using Callable = std::remove_reference_t<Fn>;
+  parallelFor(count, [](void* context, size_t i) { (*static_cast<Callable*>(context))(i); },
+              const_cast<void*>(static_cast<const void*>(std::addressof(fn))));
+}
@@ -0,0 +1,178 @@
+#include "render_job.h"
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "asset_pipeline.h"
+#include "camera_path.h"
+
+namespace {
+
+// Largest width or height a job may ask for; a job line must not be able to
+// make the renderer allocate an arbitrarily large framebuffer.
+const int64_t kMaxJobSize = 8192;
+
+// Suspends an acquireScene() call until the load of its scene finishes.
+struct SceneLoadAwaiter {
+  CachedScene& cached;
+
+  bool await_ready() const noexcept { return !cached.loading; }
+  void await_suspend(std::coroutine_handle<> handle) { cached.waiting.push_back(handle); }
+  void await_resume() const noexcept {}
+};
+
+}
+
+bool readRenderJob(const nlohmann::json& value, RenderJob& job, std::string& error)
+{
+  if (!value.is_object())
+  {
+    error = "not a JSON object";
+    return false;
+  }
+  if (!value.contains("model") || !value["model"].is_string())
+  {
+    error = "needs a model path";
+    return false;
+  }
+  job.model = value["model"].get<std::string>();
+
+  if (value.contains("size"))
+  {
+    const nlohmann::json& size = value["size"];
+    if (!size.is_array() || size.size() != 2 || !size[0].is_number_integer() || !size[1].is_number_integer())
+    {
+      error = "size must be [width, height]";
+      return false;
+    }
+    if (size[0].get<int64_t>() <= 0 || size[1].get<int64_t>() <= 0 || size[0].get<int64_t>() > kMaxJobSize ||
+        size[1].get<int64_t>() > kMaxJobSize)
+    {
+      error = "size must be between 1 and " + std::to_string(kMaxJobSize);
+      return false;
+    }
+    job.width = size[0].get<int>();
+    job.height = size[1].get<int>();
+  }
+
+  job.camera = makeDefaultCamera();
+  if (value.contains("camera") && !readCamera(value["camera"], job.camera))
+  {
+    error = "camera needs pos and either orientation or target";
+    return false;
+  }
+
+  if (value.contains("variant"))
+  {
+    const nlohmann::json& variant = value["variant"];
+    if (variant.is_string()) job.variant = variant.get<std::string>();
+    else if (variant.is_number_integer()) job.variantIndex = variant.get<int>();
+    else
+    {
+      error = "variant must be a name or an index";
+      return false;
+    }
+  }
+
+  if (value.contains("time") && !value["time"].is_number())
+  {
+    error = "time must be a number";
+    return false;
+  }
+  job.time = value.value("time", 0.0);
+  return true;
+}
+
+Task<CachedScene*> acquireScene(SceneCache& cache, std::string path, uint64_t version, bool* loaded)
+{
+  if (loaded) *loaded = false;
+  ++cache.clock;
+  for (std::unique_ptr<CachedScene>& entry : cache.entries)
+  {
+    if (entry->path != path || entry->version != version || entry->failed) continue;
+    CachedScene* cached = entry.get();
+    cached->lastUsed = cache.clock;
+    ++cached->users;
+    co_await SceneLoadAwaiter{ *cached };
+    if (cached->failed)
+    {
+      --cached->users;
+      co_return nullptr;
+    }
+    co_return cached;
+  }
+
+  if (cache.entries.size() >= cache.capacity)
+  {
+    auto oldest = cache.entries.end();
+    for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it)
+    {
+      if ((*it)->users > 0 || (*it)->loading) continue;
+      if (oldest == cache.entries.end() || (*it)->lastUsed < (*oldest)->lastUsed) oldest = it;
+    }
+    // With every scene in use the cache grows past capacity for a while.
+    if (oldest != cache.entries.end())
+    {
+      destroyRuntimeScene((*oldest)->scene);
+      cache.entries.erase(oldest);
+    }
+  }
+
+  cache.entries.push_back(std::make_unique<CachedScene>());
+  CachedScene* cached = cache.entries.back().get();
+  cached->path = path;
+  cached->version = version;
+  cached->lastUsed = cache.clock;
+  cached->users = 1;
+  Task<bool> load = loadRuntimeSceneAsync(cached->scene, path);
+  const bool ok = co_await load;
+
+  cached->loading = false;
+  cached->failed = !ok;
+  // Waiters resume here, on the main thread, and are done with a failed
+  // entry before it is erased below.
+  const std::vector<std::coroutine_handle<>> waiting = std::move(cached->waiting);
+  for (std::coroutine_handle<> handle : waiting) handle.resume();
+
+  if (!ok)
+  {
+    destroyRuntimeScene(cached->scene);
+    cache.entries.erase(std::find_if(cache.entries.begin(), cache.entries.end(),
+                                     [cached](const auto& entry) { return entry.get() == cached; }));
+    co_return nullptr;
+  }
+  if (loaded) *loaded = true;
+  co_return cached;
+}
+
+void releaseScene(CachedScene& cached)
+{
+  --cached.users;
+}
+
+void destroySceneCache(SceneCache& cache)
+{
+  for (std::unique_ptr<CachedScene>& entry : cache.entries) destroyRuntimeScene(entry->scene);
+  cache.entries.clear();
+}
+
+bool drawRenderJob(Renderer& renderer, CachedScene& cached, const RenderJob& job,
+                   std::vector<AnimationInstance>& animations, FrameArena& arena, uint64_t frame)
+{
+  RuntimeScene& scene = cached.scene;
+  int variant = job.variantIndex;
+  if (!job.variant.empty()) variant = findMaterialVariant(scene, job.variant);
+  selectMaterialVariant(scene, variant);
+
+  animations.clear();
+  if (!scene.animations.empty()) startAnimation(animations, scene.animations, 0);
+  animateScene(animations, scene.animations, scene.graph, job.time);
+
+  const glm::mat4 proj = glm::perspectiveRH(45.0f, job.width / (float)job.height, 1.0f, 100.0f);
+  const glm::mat4 view = getViewMatrix(job.camera);
+  beginArenaFrame(arena, frame);
+  updateVisibility(cached.visibility, scene, view, proj);
+  drawFrame(renderer, proj * view, scene, cached.visibility, arena);
+  return job.variant.empty() || variant >= 0;
+}
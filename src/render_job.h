@@ -0,0 +1,79 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "animation.h"
+#include "camera.h"
+#include "frame_arena.h"
+#include "json.hpp"
+#include "renderer.h"
+#include "runtime_scene.h"
+#include "task.h"
+#include "visibility.h"
+
+// One offscreen image of a model, as --batch and --serve describe it in
+// JSON, and the cache of compiled scenes both keep between jobs.
+
+const int kDefaultJobWidth = 800;
+const int kDefaultJobHeight = 600;
+
+struct RenderJob {
+  std::string model;
+  int width = kDefaultJobWidth;
+  int height = kDefaultJobHeight;
+  Camera camera;
+  // Variant name, or empty with variantIndex for an index or -1 for none.
+  std::string variant;
+  int variantIndex = -1;
+  double time = 0.0;
+};
+
+// Reads "model", "size", "camera", "variant" and "time" from a job object;
+// any other keys are the caller's. Widths and heights above 8192 are
+// rejected. error says what is wrong on failure.
+bool readRenderJob(const nlohmann::json& value, RenderJob& job, std::string& error);
+
+struct CachedScene {
+  std::string path;
+  // Tells apart loads of a file that changed, e.g. by its content hash.
+  uint64_t version = 0;
+  RuntimeScene scene;
+  VisibilityCache visibility;
+  uint64_t lastUsed = 0;
+  // Jobs between acquireScene() and releaseScene(); only unused scenes are
+  // evicted.
+  int users = 0;
+  bool loading = true;
+  bool failed = false;
+  // acquireScene() calls waiting for the load another one started.
+  std::vector<std::coroutine_handle<>> waiting;
+};
+
+// Least-recently-used compiled scenes, owned by the main thread.
+struct SceneCache {
+  size_t capacity = 4;
+  uint64_t clock = 0;
+  std::vector<std::unique_ptr<CachedScene>> entries;
+};
+
+// Main thread. The cached scene for path and version, loaded with
+// loadRuntimeSceneAsync() and evicting the least recently used unused scene
+// if it is not cached. Scenes of other versions age out like any other.
+// Concurrent calls for one path share a single load. Null if the model fails
+// to load; otherwise pair with releaseScene(). loaded, if given, is set when
+// this call did the load.
+Task<CachedScene*> acquireScene(SceneCache& cache, std::string path, uint64_t version = 0, bool* loaded = nullptr);
+void releaseScene(CachedScene& cached);
+void destroySceneCache(SceneCache& cache);
+
+// Selects the job's variant, poses animation 0 at the job's time and draws
+// into the bound framebuffer, whose viewport the caller has set. Cached
+// scenes keep the pose and materials of their last job, so every job sets
+// both. Returns false if a named variant does not exist, after drawing with
+// the default materials.
+bool drawRenderJob(Renderer& renderer, CachedScene& cached, const RenderJob& job,
+                   std::vector<AnimationInstance>& animations, FrameArena& arena, uint64_t frame);
@@ -0,0 +1,242 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <glm/gtc/type_ptr.hpp>
+
+void message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const* message, void const* user_param) {
+  auto const src_str = [source]() {
+    switch (source)
+    {
+      case GL_DEBUG_SOURCE_API: return "API";
+      case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "WINDOW SYSTEM";
+      case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER COMPILER";
+      case GL_DEBUG_SOURCE_THIRD_PARTY: return "THIRD PARTY";
+      case GL_DEBUG_SOURCE_APPLICATION: return "APPLICATION";
+      case GL_DEBUG_SOURCE_OTHER: return "OTHER";
+      default: return "UNKNOWN";
+    }
+  }();
+
+  auto const type_str = [type]() {
+    switch (type)
+    {
+      case GL_DEBUG_TYPE_ERROR: return "ERROR";
+      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "DEPRECATED_BEHAVIOR";
+      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "UNDEFINED_BEHAVIOR";
+      case GL_DEBUG_TYPE_PORTABILITY: return "PORTABILITY";
+      case GL_DEBUG_TYPE_PERFORMANCE: return "PERFORMANCE";
+      case GL_DEBUG_TYPE_MARKER: return "MARKER";
+      case GL_DEBUG_TYPE_OTHER: return "OTHER";
+      default: return "UNKNOWN";
+    }
+  }();
+
+  auto const severity_str = [severity]() {
+    switch (severity) {
+      case GL_DEBUG_SEVERITY_NOTIFICATION: return "NOTIFICATION";
+      case GL_DEBUG_SEVERITY_LOW: return "LOW";
+      case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
+      case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
+      default: return "UNKNOWN";
+    }
+  }();
+
+  std::printf("%s, %s, %s, %d: %s\n", src_str, type_str, severity_str, id, message);
+}
+
+void enableDebugOutput(bool synchronous)
+{
+  glEnable(GL_DEBUG_OUTPUT);
+  if (synchronous) glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  else glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+  glDebugMessageCallback(message_callback, nullptr);
+}
+
+bool createRenderer(Renderer& renderer)
+{
+  static const char* vSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;   // the position variable has attribute position 0
+
+uniform mat4 mvp;
+  
+void main()
+{
+    gl_Position = mvp * vec4(aPos, 1.0);
+}
+)";
+
+  static const char* fSource = R"(
+#version 330 core
+out vec4 FragColor;  
+  
+void main()
+{
+    FragColor = vec4(1.0, 0.0, 0.0, 1.0);
+}
+)";
+
+  GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(vShader, 1, &vSource, nullptr);
+  glCompileShader(vShader);
+  int success;
+  glGetShaderiv(vShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetShaderInfoLog(vShader, 512, nullptr, infoLog);
+    std::printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n%s\n", infoLog);
+  }
+
+  GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fShader, 1, &fSource, nullptr);
+  glCompileShader(fShader);
+  glGetShaderiv(fShader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetShaderInfoLog(fShader, 512, nullptr, infoLog);
+    std::printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n%s\n", infoLog);
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vShader);
+  glAttachShader(program, fShader);
+  glLinkProgram(program);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetProgramInfoLog(program, 512, nullptr, infoLog);
+    std::printf("ERROR::PROGRAM::LINK_FAILED\n%s\n", infoLog);
+  }
+
+  GLint alignment = GL_NONE;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+  std::printf("OpenGL alignment: %d\n", alignment);
+
+  glEnable(GL_DEPTH_TEST);
+
+  renderer.program = program;
+  renderer.mvpLoc = glGetUniformLocation(program, "mvp");
+  success = success && createMorphProgram(renderer.morph) && createSkinningProgram(renderer.skinning);
+
+  glDeleteShader(vShader);
+  glDeleteShader(fShader);
+  return success;
+}
+
+void destroyRenderer(Renderer& renderer)
+{
+  glDeleteProgram(renderer.program);
+  glDeleteProgram(renderer.morph.program);
+  glDeleteProgram(renderer.skinning.program);
+  renderer = Renderer{};
+}
+
+namespace {
+
+// One primitive of one node, sorted by key before drawing so that draws
+// sharing a material and VAO are submitted back to back.
+struct DrawItem {
+  uint64_t key;
+  uint32_t node;
+  uint32_t primitive;
+  GLuint vao;
+};
+
+GLuint drawVao(const RuntimeScene& scene, uint32_t node, const RuntimeMesh& mesh, uint32_t p)
+{
+  const int32_t firstSkinned = scene.skinning.nodeFirstDraw[node];
+  if (firstSkinned >= 0)
+  {
+    const GLuint vao = scene.skinning.draws[firstSkinned + (p - mesh.firstPrimitive)].vao;
+    if (vao) return vao;
+  }
+  const int32_t firstMorphed = scene.morphs.nodeFirstDraw.empty() ? -1 : scene.morphs.nodeFirstDraw[node];
+  if (firstMorphed >= 0)
+  {
+    const GLuint vao = scene.morphs.draws[firstMorphed + (p - mesh.firstPrimitive)].vao;
+    if (vao) return vao;
+  }
+  return scene.primitives[p].vao;
+}
+
+}
+
+void drawFrame(const Renderer& renderer, const glm::mat4& viewProj, RuntimeScene& scene,
+               const VisibilityCache& visibility, FrameArena& arena, DrawStats* stats)
+{
+  runMorphPass(renderer.morph, scene);
+  runSkinningPass(renderer.skinning, scene);
+
+  const float color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+  const float depth = 1.0f;
+  glClearBufferfv(GL_COLOR, 0, color);
+  glClearBufferfv(GL_DEPTH, 0, &depth);
+
+  // Stage the matrices and the draw list in the frame arena.
+  const SceneGraph& graph = scene.graph;
+  const size_t nodes = nodeCount(graph);
+  glm::mat4* mvps = arenaArray<glm::mat4>(arena, nodes);
+  size_t itemCount = 0;
+  for (uint32_t i : visibility.visibleNodes)
+  {
+    itemCount += scene.meshes[graph.mesh[i]].primitiveCount;
+  }
+  DrawItem* items = arenaArray<DrawItem>(arena, itemCount);
+  size_t n = 0;
+  for (uint32_t i : visibility.visibleNodes)
+  {
+    mvps[i] = viewProj * graph.world[i];
+    const RuntimeMesh& mesh = scene.meshes[graph.mesh[i]];
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      const GLuint vao = drawVao(scene, i, mesh, p);
+      const uint64_t material = static_cast<uint32_t>(scene.primitives[p].material + 1);
+      items[n++] = DrawItem{ material << 32 | vao, i, p, vao };
+    }
+  }
+  std::sort(items, items + n, [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+  glUseProgram(renderer.program);
+  uint32_t drawCalls = 0;
+  uint64_t triangles = 0;
+  GLuint boundVao = 0;
+  uint32_t boundNode = UINT32_MAX;
+  for (size_t d = 0; d < n; ++d)
+  {
+    const DrawItem& item = items[d];
+    if (item.node != boundNode)
+    {
+      glUniformMatrix4fv(renderer.mvpLoc, 1, GL_FALSE, glm::value_ptr(mvps[item.node]));
+      boundNode = item.node;
+    }
+    if (item.vao != boundVao)
+    {
+      glBindVertexArray(item.vao);
+      boundVao = item.vao;
+    }
+    const RuntimePrimitive& primitive = scene.primitives[item.primitive];
+    if (primitive.indexType)
+    {
+      glDrawElements(primitive.mode, primitive.count, primitive.indexType, (void *)primitive.indexOffset);
+    }
+    else
+    {
+      glDrawArrays(primitive.mode, 0, primitive.count);
+    }
+    ++drawCalls;
+    triangles += primitive.mode == GL_TRIANGLES ? primitive.count / 3 : 0;
+  }
+
+  if (stats)
+  {
+    stats->drawCalls += drawCalls;
+    stats->triangles += triangles;
+  }
+}
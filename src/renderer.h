@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "frame_arena.h"
+#include "runtime_scene.h"
+#include "visibility.h"
+
+struct Renderer {
+  GLuint program = 0;
+  GLint mvpLoc = -1;
+  MorphProgram morph;
+  SkinningProgram skinning;
+};
+
+struct DrawStats {
+  uint32_t drawCalls = 0;
+  uint64_t triangles = 0;
+};
+
+void message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const* message, void const* user_param);
+
+// Turns on GL debug output routed through message_callback. Needs a current
+// context. Synchronous output pins messages to the offending call but makes
+// the driver finish each call before returning, so the interactive viewer
+// turns it off.
+void enableDebugOutput(bool synchronous = true);
+
+bool createRenderer(Renderer& renderer);
+void destroyRenderer(Renderer& renderer);
+
+// Runs the morph and skinning pre-passes, then clears the bound framebuffer and draws
+// every primitive of every node in visibility's visible list, placed by the
+// node's world matrix. The draw list is built in arena, which must have begun
+// the frame, and sorted by material and VAO. Does not present. Adds what was
+// submitted to stats when given.
+void drawFrame(const Renderer& renderer, const glm::mat4& viewProj, RuntimeScene& scene,
+               const VisibilityCache& visibility, FrameArena& arena, DrawStats* stats = nullptr);
@@ -0,0 +1,324 @@
+#include "runtime_scene.h"
+
+#include <cfloat>
+#include <cstdio>
+
+#include "accessor.h"
+#include "loader.h"
+#include "parallel.h"
+
+static const char* const kAttributeNames[kAttribCount] = {
+  "POSITION", "NORMAL", "TEXCOORD_0", "COLOR_0", "TANGENT", "JOINTS_0", "WEIGHTS_0",
+};
+
+int primitiveAttribute(const tinygltf::Primitive& source, AttributeSlot slot)
+{
+  const auto it = source.attributes.find(kAttributeNames[slot]);
+  return it == source.attributes.end() ? -1 : it->second;
+}
+
+uint32_t bindPrimitiveAttributes(GLuint vao, const RuntimeScene& scene, const tinygltf::Model& gltfmodel,
+                                 const tinygltf::Primitive& source, uint32_t skipMask)
+{
+  uint32_t mask = 0;
+  AccessorData position;
+  if (!findAccessorData(gltfmodel, primitiveAttribute(source, kAttribPosition), position)) return mask;
+  for (int slot = 0; slot < kAttribCount; ++slot)
+  {
+    // Every vertex the draw can fetch must lie inside the accessor.
+    AccessorData data;
+    if (!findAccessorData(gltfmodel, primitiveAttribute(source, static_cast<AttributeSlot>(slot)), data) ||
+        data.accessor->count < position.accessor->count)
+    {
+      continue;
+    }
+    const tinygltf::Accessor& accessor = *data.accessor;
+    mask |= 1u << slot;
+    if (skipMask & (1u << slot)) continue;
+
+    // The accessor offset goes into the binding, not the relative offset,
+    // which GL limits to 2047 bytes.
+    glVertexArrayVertexBuffer(vao, slot, scene.buffers[data.view->buffer], data.view->byteOffset + accessor.byteOffset, data.stride);
+    glEnableVertexArrayAttrib(vao, slot);
+    const GLint components = tinygltf::GetNumComponentsInType(accessor.type);
+    if (slot == kAttribJoints0)
+    {
+      glVertexArrayAttribIFormat(vao, slot, components, accessor.componentType, 0);
+    }
+    else
+    {
+      glVertexArrayAttribFormat(vao, slot, components, accessor.componentType, accessor.normalized, 0);
+    }
+    glVertexArrayAttribBinding(vao, slot, slot);
+  }
+  return mask;
+}
+
+GLuint createDeformedVao(const RuntimeScene& scene, const tinygltf::Model& gltfmodel, const tinygltf::Primitive& source,
+                         const RuntimePrimitive& primitive, GLuint output)
+{
+  const uint32_t deformed = (1u << kAttribPosition) | (1u << kAttribNormal);
+  GLuint vao;
+  glCreateVertexArrays(1, &vao);
+  const uint32_t mask = bindPrimitiveAttributes(vao, scene, gltfmodel, source, deformed);
+  for (uint32_t slot : { kAttribPosition, kAttribNormal })
+  {
+    if (!(mask & (1u << slot))) continue;
+    glVertexArrayVertexBuffer(vao, slot, output, slot == kAttribNormal ? sizeof(glm::vec4) : 0, 2 * sizeof(glm::vec4));
+    glEnableVertexArrayAttrib(vao, slot);
+    glVertexArrayAttribFormat(vao, slot, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(vao, slot, slot);
+  }
+  if (primitive.indexType) glVertexArrayElementBuffer(vao, primitive.indexBuffer);
+  return vao;
+}
+
+// Validates a primitive and fills in everything but its GL names.
+static bool preparePrimitive(const tinygltf::Model& gltfmodel, const tinygltf::Primitive& source,
+                             RuntimePrimitive& primitive)
+{
+  AccessorData position;
+  if (!findAccessorData(gltfmodel, primitiveAttribute(source, kAttribPosition), position))
+  {
+    std::printf("Skipping primitive without a readable POSITION accessor\n");
+    return false;
+  }
+
+  primitive.mode = source.mode >= 0 ? source.mode : GL_TRIANGLES;
+  primitive.material = source.material;
+  primitive.defaultMaterial = source.material;
+  if (source.indices >= 0)
+  {
+    AccessorData indices;
+    if (!findAccessorData(gltfmodel, source.indices, indices))
+    {
+      std::printf("Skipping primitive with unreadable indices\n");
+      return false;
+    }
+    primitive.count = static_cast<GLsizei>(indices.accessor->count);
+    primitive.indexType = indices.accessor->componentType;
+    primitive.indexOffset = indices.view->byteOffset + indices.accessor->byteOffset;
+  }
+  else
+  {
+    primitive.count = static_cast<GLsizei>(position.accessor->count);
+  }
+  return true;
+}
+
+static void computeMeshBounds(const tinygltf::Model& gltfmodel, const tinygltf::Mesh& source,
+                              const std::vector<RuntimePrimitive>& primitives, RuntimeMesh& mesh)
+{
+  mesh.bounded = !primitives.empty();
+  mesh.boundsMin = glm::vec3(FLT_MAX);
+  mesh.boundsMax = glm::vec3(-FLT_MAX);
+  for (const RuntimePrimitive& primitive : primitives)
+  {
+    const tinygltf::Accessor& position =
+      gltfmodel.accessors[primitiveAttribute(source.primitives[primitive.sourcePrimitive], kAttribPosition)];
+    if (position.minValues.size() != 3 || position.maxValues.size() != 3)
+    {
+      mesh.bounded = false;
+      break;
+    }
+    mesh.boundsMin = glm::min(mesh.boundsMin, glm::vec3(position.minValues[0], position.minValues[1], position.minValues[2]));
+    mesh.boundsMax = glm::max(mesh.boundsMax, glm::vec3(position.maxValues[0], position.maxValues[1], position.maxValues[2]));
+  }
+  if (!mesh.bounded)
+  {
+    mesh.boundsMin = glm::vec3(0.0f);
+    mesh.boundsMax = glm::vec3(0.0f);
+  }
+}
+
+static void prepareMaterial(const tinygltf::Material& source, RuntimeMaterial& material)
+{
+  const std::vector<double>& factor = source.pbrMetallicRoughness.baseColorFactor;
+  if (factor.size() == 4) material.baseColorFactor = glm::vec4(factor[0], factor[1], factor[2], factor[3]);
+  material.baseColorTexture = source.pbrMetallicRoughness.baseColorTexture.index;
+  material.alphaCutoff = static_cast<float>(source.alphaCutoff);
+  material.alphaMode = source.alphaMode == "MASK" ? 1 : source.alphaMode == "BLEND" ? 2 : 0;
+  material.doubleSided = source.doubleSided;
+}
+
+// Reads KHR_materials_variants from the model and its primitives. Mappings
+// to missing materials or variants are ignored.
+static void prepareMaterialVariants(RuntimeScene& scene, const tinygltf::Model& gltfmodel)
+{
+  const auto root = gltfmodel.extensions.find("KHR_materials_variants");
+  if (root == gltfmodel.extensions.end() || !root->second.Get("variants").IsArray()) return;
+  const tinygltf::Value& variants = root->second.Get("variants");
+  for (size_t v = 0; v < variants.ArrayLen(); ++v)
+  {
+    const tinygltf::Value& name = variants.Get(static_cast<int>(v)).Get("name");
+    scene.variants.push_back(name.IsString() ? name.Get<std::string>() : std::string());
+  }
+
+  const size_t variantCount = scene.variants.size();
+  scene.variantMaterials.assign(scene.primitives.size() * variantCount, -1);
+  for (size_t m = 0; m < scene.meshes.size(); ++m)
+  {
+    const RuntimeMesh& mesh = scene.meshes[m];
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      const tinygltf::Primitive& source = gltfmodel.meshes[m].primitives[scene.primitives[p].sourcePrimitive];
+      const auto extension = source.extensions.find("KHR_materials_variants");
+      if (extension == source.extensions.end()) continue;
+      const tinygltf::Value& mappings = extension->second.Get("mappings");
+      for (size_t i = 0; mappings.IsArray() && i < mappings.ArrayLen(); ++i)
+      {
+        const tinygltf::Value& mapping = mappings.Get(static_cast<int>(i));
+        const int material = mapping.Get("material").IsNumber() ? mapping.Get("material").GetNumberAsInt() : -1;
+        const tinygltf::Value& mapped = mapping.Get("variants");
+        if (material < 0 || material >= (int)scene.materials.size() || !mapped.IsArray()) continue;
+        for (size_t k = 0; k < mapped.ArrayLen(); ++k)
+        {
+          const int variant = mapped.Get(static_cast<int>(k)).GetNumberAsInt();
+          if (variant >= 0 && variant < (int)variantCount) scene.variantMaterials[p * variantCount + variant] = material;
+        }
+      }
+    }
+  }
+}
+
+bool prepareRuntimeScene(PreparedScene& prepared, const tinygltf::Model& gltfmodel)
+{
+  prepared = PreparedScene{};
+  RuntimeScene& scene = prepared.scene;
+
+  // The scene graph and animations are one job; materials and meshes spread
+  // over the remaining workers meanwhile.
+  JobCounter graphDone;
+  bool graphBuilt = false;
+  submitJob([&] {
+    graphBuilt = buildSceneGraph(scene.graph, gltfmodel) && compileAnimations(scene.animations, gltfmodel, scene.graph);
+  }, &graphDone);
+
+  scene.materials.resize(gltfmodel.materials.size());
+  parallelFor(scene.materials.size(), [&](size_t i) { prepareMaterial(gltfmodel.materials[i], scene.materials[i]); });
+
+  std::vector<std::vector<RuntimePrimitive>> meshPrimitives(gltfmodel.meshes.size());
+  scene.meshes.resize(meshPrimitives.size());
+  parallelFor(meshPrimitives.size(), [&](size_t m) {
+    const std::vector<tinygltf::Primitive>& sources = gltfmodel.meshes[m].primitives;
+    for (size_t p = 0; p < sources.size(); ++p)
+    {
+      RuntimePrimitive primitive;
+      primitive.sourcePrimitive = static_cast<uint32_t>(p);
+      if (!preparePrimitive(gltfmodel, sources[p], primitive)) continue;
+      if (primitive.material >= (int)scene.materials.size()) primitive.material = primitive.defaultMaterial = -1;
+      meshPrimitives[m].push_back(primitive);
+    }
+    computeMeshBounds(gltfmodel, gltfmodel.meshes[m], meshPrimitives[m], scene.meshes[m]);
+  });
+  waitForCounter(graphDone);
+  if (!graphBuilt) return false;
+
+  for (size_t m = 0; m < meshPrimitives.size(); ++m)
+  {
+    scene.meshes[m].firstPrimitive = static_cast<uint32_t>(scene.primitives.size());
+    scene.meshes[m].primitiveCount = static_cast<uint32_t>(meshPrimitives[m].size());
+    scene.primitives.insert(scene.primitives.end(), meshPrimitives[m].begin(), meshPrimitives[m].end());
+  }
+  prepareMaterialVariants(scene, gltfmodel);
+
+  // Nodes pointing at missing meshes draw nothing.
+  for (int32_t& mesh : scene.graph.mesh)
+  {
+    if (mesh >= (int32_t)scene.meshes.size()) mesh = -1;
+  }
+
+  // Morph targets and skin vertices only read the primitives, so they are
+  // prepared side by side.
+  JobCounter morphsDone;
+  bool morphsPrepared = false;
+  submitJob([&] { morphsPrepared = prepareMorphs(scene, prepared.morphs, gltfmodel); }, &morphsDone);
+  const bool skinsPrepared = prepareSkins(scene, prepared.skins, gltfmodel);
+  waitForCounter(morphsDone);
+  return morphsPrepared && skinsPrepared;
+}
+
+void uploadRuntimeScene(RuntimeScene& scene, PreparedScene& prepared, const tinygltf::Model& gltfmodel)
+{
+  scene = std::move(prepared.scene);
+  scene.buffers.resize(gltfmodel.buffers.size());
+  if (!scene.buffers.empty())
+  {
+    glCreateBuffers(static_cast<GLsizei>(scene.buffers.size()), scene.buffers.data());
+  }
+  for (size_t i = 0; i < scene.buffers.size(); ++i)
+  {
+    const std::vector<unsigned char>& data = gltfmodel.buffers[i].data;
+    if (!data.empty()) glNamedBufferStorage(scene.buffers[i], data.size(), data.data(), 0);
+  }
+
+  for (size_t m = 0; m < scene.meshes.size(); ++m)
+  {
+    const RuntimeMesh& mesh = scene.meshes[m];
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      RuntimePrimitive& primitive = scene.primitives[p];
+      const tinygltf::Primitive& source = gltfmodel.meshes[m].primitives[primitive.sourcePrimitive];
+      glCreateVertexArrays(1, &primitive.vao);
+      primitive.attributeMask = bindPrimitiveAttributes(primitive.vao, scene, gltfmodel, source, 0);
+      if (primitive.indexType)
+      {
+        primitive.indexBuffer = scene.buffers[gltfmodel.bufferViews[gltfmodel.accessors[source.indices].bufferView].buffer];
+        glVertexArrayElementBuffer(primitive.vao, primitive.indexBuffer);
+      }
+    }
+  }
+
+  uploadMorphs(scene, prepared.morphs, gltfmodel);
+  uploadSkins(scene, prepared.skins, gltfmodel);
+  prepared = PreparedScene{};
+}
+
+bool compileRuntimeScene(RuntimeScene& scene, const tinygltf::Model& gltfmodel)
+{
+  PreparedScene prepared;
+  if (!prepareRuntimeScene(prepared, gltfmodel)) return false;
+  uploadRuntimeScene(scene, prepared, gltfmodel);
+  return true;
+}
+
+bool loadRuntimeScene(RuntimeScene& scene, const std::string& path)
+{
+  tinygltf::Model gltfmodel;
+  return loadModel(gltfmodel, path) && compileRuntimeScene(scene, gltfmodel);
+}
+
+void destroyRuntimeScene(RuntimeScene& scene)
+{
+  destroySkins(scene.skinning);
+  destroyMorphs(scene.morphs);
+  for (const RuntimePrimitive& primitive : scene.primitives)
+  {
+    glDeleteVertexArrays(1, &primitive.vao);
+  }
+  if (!scene.buffers.empty())
+  {
+    glDeleteBuffers(static_cast<GLsizei>(scene.buffers.size()), scene.buffers.data());
+  }
+  scene = RuntimeScene{};
+}
+
+int findMaterialVariant(const RuntimeScene& scene, const std::string& name)
+{
+  for (size_t v = 0; v < scene.variants.size(); ++v)
+  {
+    if (scene.variants[v] == name) return static_cast<int>(v);
+  }
+  return -1;
+}
+
+void selectMaterialVariant(RuntimeScene& scene, int variant)
+{
+  const size_t variantCount = scene.variants.size();
+  for (size_t p = 0; p < scene.primitives.size(); ++p)
+  {
+    RuntimePrimitive& primitive = scene.primitives[p];
+    const int32_t mapped = variant >= 0 && variant < (int)variantCount ? scene.variantMaterials[p * variantCount + variant] : -1;
+    primitive.material = mapped >= 0 ? mapped : primitive.defaultMaterial;
+  }
+}
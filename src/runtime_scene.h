@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "animation.h"
+#include "morph.h"
+#include "scene_graph.h"
+#include "skinning.h"
+#include "tiny_gltf.h"
+
+// Compact form of a glTF model that the per-frame code runs on. Compiling
+// resolves every accessor, buffer view and attribute name once, uploads the
+// buffers and builds one VAO per primitive, so the tinygltf::Model can be
+// dropped afterwards. Everything here is flat arrays of plain structs.
+
+// Fixed vertex attribute locations, shared by every shader.
+enum AttributeSlot {
+  kAttribPosition,
+  kAttribNormal,
+  kAttribTexcoord0,
+  kAttribColor0,
+  kAttribTangent,
+  kAttribJoints0,
+  kAttribWeights0,
+  kAttribCount
+};
+
+struct RuntimePrimitive {
+  GLuint vao = 0;
+  GLenum mode = GL_TRIANGLES;
+  // Index count, or vertex count when indexType is 0.
+  GLsizei count = 0;
+  GLenum indexType = 0;
+  GLuint indexBuffer = 0;
+  size_t indexOffset = 0;
+  int32_t material = -1;
+  // The glTF material, which material returns to when no variant is active.
+  int32_t defaultMaterial = -1;
+  // Bit i is set when slot i has data.
+  uint32_t attributeMask = 0;
+  // Index into the glTF mesh's primitives.
+  uint32_t sourcePrimitive = 0;
+};
+
+struct RuntimeMesh {
+  uint32_t firstPrimitive = 0;
+  uint32_t primitiveCount = 0;
+  // Local bounds of every primitive's POSITION min/max; bounded is false
+  // when a primitive does not give them.
+  glm::vec3 boundsMin {0.0f};
+  glm::vec3 boundsMax {0.0f};
+  bool bounded = false;
+};
+
+struct RuntimeMaterial {
+  glm::vec4 baseColorFactor {1.0f};
+  int32_t baseColorTexture = -1;
+  float alphaCutoff = 0.5f;
+  uint8_t alphaMode = 0;  // 0 opaque, 1 mask, 2 blend
+  uint8_t doubleSided = 0;
+};
+
+struct RuntimeScene {
+  std::vector<GLuint> buffers;  // one per glTF buffer
+  std::vector<RuntimeMesh> meshes;
+  std::vector<RuntimePrimitive> primitives;
+  std::vector<RuntimeMaterial> materials;
+  SceneGraph graph;
+  std::vector<AnimationClip> animations;
+  MorphData morphs;
+  SkinningData skinning;
+  // KHR_materials_variants names, and each primitive's material under each
+  // variant, primitive-major; -1 where the variant keeps the default.
+  std::vector<std::string> variants;
+  std::vector<int32_t> variantMaterials;
+};
+
+// Needs a current GL 4.5 context. Primitives that cannot be drawn (missing
+// POSITION, sparse-only accessors) are skipped with a message. Same as
+// prepareRuntimeScene() followed by uploadRuntimeScene().
+bool compileRuntimeScene(RuntimeScene& scene, const tinygltf::Model& gltfmodel);
+
+// A scene compiled up to its GL calls.
+struct PreparedScene {
+  // Complete apart from GL names, which are all 0.
+  RuntimeScene scene;
+  MorphUploads morphs;
+  SkinUploads skins;
+};
+
+// CPU half of compileRuntimeScene(). The scene graph, materials, meshes,
+// morph targets and skin vertices are converted in parallel on the job
+// system. Makes no GL calls, so it can run on any thread.
+bool prepareRuntimeScene(PreparedScene& prepared, const tinygltf::Model& gltfmodel);
+
+// GL half: uploads the buffers, builds the VAOs and moves the result into
+// scene. Needs a current GL 4.5 context and the model that was prepared.
+void uploadRuntimeScene(RuntimeScene& scene, PreparedScene& prepared, const tinygltf::Model& gltfmodel);
+
+// Index of the KHR_materials_variants variant called name, or -1.
+int findMaterialVariant(const RuntimeScene& scene, const std::string& name);
+
+// Switches every primitive to its material for variant, or back to the glTF
+// material for -1.
+void selectMaterialVariant(RuntimeScene& scene, int variant);
+
+// Accessor index of a primitive attribute, -1 when it has none.
+int primitiveAttribute(const tinygltf::Primitive& source, AttributeSlot slot);
+
+// Points the slots of vao at the primitive's attribute data, leaving out the
+// slots in skipMask. Returns the slots that have data, skipped or not; an
+// attribute whose accessor overruns its buffer view, or has fewer elements
+// than POSITION, has none.
+uint32_t bindPrimitiveAttributes(GLuint vao, const RuntimeScene& scene, const tinygltf::Model& gltfmodel,
+                                 const tinygltf::Primitive& source, uint32_t skipMask);
+
+// VAO for a primitive whose positions and normals are written by a compute
+// pass into output, as vec4 pairs; the other slots and the indices still come
+// from the primitive's own data.
+GLuint createDeformedVao(const RuntimeScene& scene, const tinygltf::Model& gltfmodel, const tinygltf::Primitive& source,
+                         const RuntimePrimitive& primitive, GLuint output);
+
+// loadModel() followed by compileRuntimeScene(); the model is freed before
+// returning.
+bool loadRuntimeScene(RuntimeScene& scene, const std::string& path);
+
+void destroyRuntimeScene(RuntimeScene& scene);
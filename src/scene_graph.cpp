@@ -0,0 +1,288 @@
+#include "scene_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "parallel.h"
+
+// Levels smaller than this are updated on the calling thread.
+const size_t kParallelLevelSize = 4096;
+const size_t kNodesPerJob = 1024;
+
+static glm::mat4 composeTrs(const glm::vec3& t, const glm::quat& r, const glm::vec3& s)
+{
+  const glm::mat3 rotation = glm::mat3_cast(r);
+  glm::mat4 m(1.0f);
+  m[0] = glm::vec4(rotation[0] * s.x, 0.0f);
+  m[1] = glm::vec4(rotation[1] * s.y, 0.0f);
+  m[2] = glm::vec4(rotation[2] * s.z, 0.0f);
+  m[3] = glm::vec4(t, 1.0f);
+  return m;
+}
+
+static void addNode(SceneGraph& graph, int32_t parent, int32_t source, const tinygltf::Model& gltfmodel)
+{
+  glm::vec3 t(0.0f);
+  glm::quat r(1.0f, 0.0f, 0.0f, 0.0f);
+  glm::vec3 s(1.0f);
+  glm::mat4 matrix(1.0f);
+  bool useMatrix = false;
+  int32_t mesh = 0;
+  int32_t skin = -1;
+  std::vector<double> weights;
+  if (source >= 0)
+  {
+    const tinygltf::Node& node = gltfmodel.nodes[source];
+    if (node.translation.size() == 3) t = glm::make_vec3(node.translation.data());
+    if (node.rotation.size() == 4) r = glm::make_quat(node.rotation.data());
+    if (node.scale.size() == 3) s = glm::make_vec3(node.scale.data());
+    if (node.matrix.size() == 16)
+    {
+      matrix = glm::make_mat4(node.matrix.data());
+      useMatrix = true;
+    }
+    mesh = node.mesh;
+    skin = node.skin;
+    weights = node.weights;
+  }
+  if (mesh >= 0 && mesh < (int)gltfmodel.meshes.size())
+  {
+    const tinygltf::Mesh& source = gltfmodel.meshes[mesh];
+    size_t targets = source.weights.size();
+    for (const tinygltf::Primitive& primitive : source.primitives) targets = std::max(targets, primitive.targets.size());
+    if (weights.size() != targets) weights = source.weights;
+    weights.resize(targets, 0.0);
+  }
+  else
+  {
+    weights.clear();
+  }
+
+  graph.parent.push_back(parent);
+  graph.firstChild.push_back(-1);
+  graph.childCount.push_back(0);
+  graph.mesh.push_back(mesh);
+  graph.skin.push_back(skin);
+  graph.sourceNode.push_back(source);
+  graph.translation.push_back(t);
+  graph.rotation.push_back(r);
+  graph.scale.push_back(s);
+  graph.useMatrix.push_back(useMatrix);
+  graph.local.push_back(useMatrix ? matrix : composeTrs(t, r, s));
+  graph.world.push_back(glm::mat4(1.0f));
+  graph.firstWeight.push_back(static_cast<uint32_t>(graph.weights.size()));
+  graph.weightCount.push_back(static_cast<uint32_t>(weights.size()));
+  graph.weights.insert(graph.weights.end(), weights.begin(), weights.end());
+}
+
+bool buildSceneGraph(SceneGraph& graph, const tinygltf::Model& gltfmodel)
+{
+  graph = SceneGraph{};
+  const int32_t gltfNodes = static_cast<int32_t>(gltfmodel.nodes.size());
+  graph.flatIndex.assign(gltfNodes, -1);
+
+  std::vector<int32_t> roots;
+  if (!gltfmodel.scenes.empty())
+  {
+    const int scene = gltfmodel.defaultScene >= 0 && gltfmodel.defaultScene < (int)gltfmodel.scenes.size() ? gltfmodel.defaultScene : 0;
+    roots = gltfmodel.scenes[scene].nodes;
+  }
+  else
+  {
+    std::vector<uint8_t> isChild(gltfNodes, 0);
+    for (const tinygltf::Node& node : gltfmodel.nodes)
+    {
+      for (int child : node.children)
+      {
+        if (child >= 0 && child < gltfNodes) isChild[child] = 1;
+      }
+    }
+    for (int32_t i = 0; i < gltfNodes; ++i)
+    {
+      if (!isChild[i]) roots.push_back(i);
+    }
+  }
+
+  if (gltfNodes == 0)
+  {
+    addNode(graph, -1, -1, gltfmodel);
+    graph.levelStart = { 0, 1 };
+  }
+  else
+  {
+    // Breadth first: a node's children are appended together, right after
+    // everything on the previous level.
+    for (int32_t root : roots)
+    {
+      if (root < 0 || root >= gltfNodes || graph.flatIndex[root] >= 0)
+      {
+        std::printf("Scene references invalid or repeated root node %d\n", root);
+        return false;
+      }
+      graph.flatIndex[root] = static_cast<int32_t>(graph.parent.size());
+      addNode(graph, -1, root, gltfmodel);
+    }
+    graph.levelStart.push_back(0);
+    size_t levelBegin = 0;
+    while (levelBegin < graph.parent.size())
+    {
+      const size_t levelEnd = graph.parent.size();
+      graph.levelStart.push_back(static_cast<uint32_t>(levelEnd));
+      for (size_t i = levelBegin; i < levelEnd; ++i)
+      {
+        const tinygltf::Node& node = gltfmodel.nodes[graph.sourceNode[i]];
+        graph.firstChild[i] = static_cast<int32_t>(graph.parent.size());
+        for (int child : node.children)
+        {
+          if (child < 0 || child >= gltfNodes || graph.flatIndex[child] >= 0)
+          {
+            std::printf("Node %d has an invalid or repeated child %d\n", graph.sourceNode[i], child);
+            return false;
+          }
+          graph.flatIndex[child] = static_cast<int32_t>(graph.parent.size());
+          addNode(graph, static_cast<int32_t>(i), child, gltfmodel);
+        }
+        graph.childCount[i] = static_cast<int32_t>(graph.parent.size()) - graph.firstChild[i];
+      }
+      levelBegin = levelEnd;
+    }
+  }
+
+  graph.queuedEpoch.assign(graph.parent.size(), 0);
+  graph.dirty.resize(graph.parent.size());
+  for (size_t i = 0; i < graph.dirty.size(); ++i) graph.dirty[i] = static_cast<uint32_t>(i);
+  updateWorldTransforms(graph);
+  return true;
+}
+
+size_t nodeCount(const SceneGraph& graph)
+{
+  return graph.parent.size();
+}
+
+void setNodeTranslation(SceneGraph& graph, uint32_t node, const glm::vec3& translation)
+{
+  graph.translation[node] = translation;
+  graph.useMatrix[node] = 0;
+  graph.dirty.push_back(node);
+}
+
+void setNodeRotation(SceneGraph& graph, uint32_t node, const glm::quat& rotation)
+{
+  graph.rotation[node] = rotation;
+  graph.useMatrix[node] = 0;
+  graph.dirty.push_back(node);
+}
+
+void setNodeScale(SceneGraph& graph, uint32_t node, const glm::vec3& scale)
+{
+  graph.scale[node] = scale;
+  graph.useMatrix[node] = 0;
+  graph.dirty.push_back(node);
+}
+
+void setNodeMatrix(SceneGraph& graph, uint32_t node, const glm::mat4& matrix)
+{
+  graph.local[node] = matrix;
+  graph.useMatrix[node] = 1;
+  graph.dirty.push_back(node);
+}
+
+void setNodeWeights(SceneGraph& graph, uint32_t node, uint32_t first, const float* weights, uint32_t count)
+{
+  const uint32_t available = graph.weightCount[node];
+  if (first >= available) return;
+  std::copy(weights, weights + std::min(count, available - first), graph.weights.begin() + graph.firstWeight[node] + first);
+}
+
+static void updateWorld(SceneGraph& graph, uint32_t i)
+{
+  const int32_t parent = graph.parent[i];
+  graph.world[i] = parent < 0 ? graph.local[i] : graph.world[parent] * graph.local[i];
+}
+
+size_t updateWorldTransforms(SceneGraph& graph)
+{
+  if (graph.dirty.empty()) return 0;
+
+  if (++graph.epoch == 0)
+  {
+    std::fill(graph.queuedEpoch.begin(), graph.queuedEpoch.end(), 0);
+    graph.epoch = 1;
+  }
+  const uint32_t epoch = graph.epoch;
+
+  // Flat order is level order, so sorting groups the dirty nodes by level.
+  std::vector<uint32_t>& dirty = graph.dirty;
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+  for (uint32_t node : dirty)
+  {
+    if (!graph.useMatrix[node]) graph.local[node] = composeTrs(graph.translation[node], graph.rotation[node], graph.scale[node]);
+  }
+
+  std::vector<uint32_t>& frontier = graph.frontier;
+  std::vector<uint32_t>& next = graph.nextFrontier;
+  frontier.clear();
+  size_t updated = 0;
+  size_t d = 0;
+  size_t level = 0;
+  const size_t levels = graph.levelStart.size() - 1;
+  while (level < levels && (d < dirty.size() || !frontier.empty()))
+  {
+    // Skip clean levels without touching them.
+    if (frontier.empty())
+    {
+      level = std::upper_bound(graph.levelStart.begin(), graph.levelStart.end(), dirty[d]) - graph.levelStart.begin() - 1;
+    }
+    const uint32_t levelEnd = graph.levelStart[level + 1];
+    for (; d < dirty.size() && dirty[d] < levelEnd; ++d)
+    {
+      if (graph.queuedEpoch[dirty[d]] != epoch)
+      {
+        graph.queuedEpoch[dirty[d]] = epoch;
+        frontier.push_back(dirty[d]);
+      }
+    }
+
+    if (frontier.size() >= kParallelLevelSize)
+    {
+      parallelFor((frontier.size() + kNodesPerJob - 1) / kNodesPerJob, [&](size_t job) {
+        const size_t end = std::min(frontier.size(), (job + 1) * kNodesPerJob);
+        for (size_t i = job * kNodesPerJob; i < end; ++i) updateWorld(graph, frontier[i]);
+      });
+    }
+    else
+    {
+      for (uint32_t node : frontier) updateWorld(graph, node);
+    }
+    updated += frontier.size();
+
+    next.clear();
+    for (uint32_t node : frontier)
+    {
+      const int32_t first = graph.firstChild[node];
+      for (int32_t child = first; child < first + graph.childCount[node]; ++child)
+      {
+        graph.queuedEpoch[child] = epoch;
+        next.push_back(child);
+      }
+    }
+    frontier.swap(next);
+    ++level;
+  }
+
+  dirty.clear();
+  return updated;
+}
+
+void collectMeshInstances(const SceneGraph& graph, int mesh, std::vector<glm::mat4>& worlds)
+{
+  worlds.clear();
+  for (size_t i = 0; i < graph.mesh.size(); ++i)
+  {
+    if (graph.mesh[i] == mesh) worlds.push_back(graph.world[i]);
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "tiny_gltf.h"
+
+// Runtime node hierarchy of one glTF scene. Nodes are stored breadth first, so
+// parents come before their children, every depth level is a contiguous range
+// and the children of a node are contiguous too. Per-node data is kept in
+// parallel arrays indexed by that flat order.
+//
+// Changing a local transform marks the node dirty; updateWorldTransforms()
+// then recomputes only the dirty nodes and their descendants, one level at a
+// time with each level spread over the worker threads.
+struct SceneGraph {
+  std::vector<int32_t> parent;      // -1 for roots
+  std::vector<int32_t> firstChild;
+  std::vector<int32_t> childCount;
+  std::vector<int32_t> mesh;        // glTF mesh index, -1 when none
+  std::vector<int32_t> skin;        // glTF skin index, -1 when none
+  std::vector<int32_t> sourceNode;  // glTF node index, -1 for a synthesized node
+
+  std::vector<glm::vec3> translation;
+  std::vector<glm::quat> rotation;
+  std::vector<glm::vec3> scale;
+  // Nodes given as a matrix keep it as their local transform until a TRS
+  // value is set.
+  std::vector<uint8_t> useMatrix;
+  std::vector<glm::mat4> local;
+  std::vector<glm::mat4> world;
+
+  // Morph target weights of node i are weights[firstWeight[i]] onwards,
+  // weightCount[i] of them. Nodes start with their own weights, else their
+  // mesh's, else zeros.
+  std::vector<uint32_t> firstWeight;
+  std::vector<uint32_t> weightCount;
+  std::vector<float> weights;
+
+  // levelStart[l]..levelStart[l + 1] is depth level l.
+  std::vector<uint32_t> levelStart;
+  // Flat index of each glTF node, -1 when it is not part of the scene.
+  std::vector<int32_t> flatIndex;
+
+  // Nodes whose local transform changed since the last update.
+  std::vector<uint32_t> dirty;
+  // Per-node epoch stamp that keeps a node from being queued twice.
+  std::vector<uint32_t> queuedEpoch;
+  uint32_t epoch = 0;
+  // Scratch frontiers reused between updates.
+  std::vector<uint32_t> frontier;
+  std::vector<uint32_t> nextFrontier;
+};
+
+// Builds the graph for the default scene (the first one when none is set).
+// Models without scenes use every node that has no parent; models without
+// nodes get a single node showing mesh 0 so they still draw.
+// World transforms are up to date on return.
+bool buildSceneGraph(SceneGraph& graph, const tinygltf::Model& gltfmodel);
+
+size_t nodeCount(const SceneGraph& graph);
+
+void setNodeTranslation(SceneGraph& graph, uint32_t node, const glm::vec3& translation);
+void setNodeRotation(SceneGraph& graph, uint32_t node, const glm::quat& rotation);
+void setNodeScale(SceneGraph& graph, uint32_t node, const glm::vec3& scale);
+void setNodeMatrix(SceneGraph& graph, uint32_t node, const glm::mat4& matrix);
+// Sets count weights starting at target first; targets past the node's
+// weight count are ignored.
+void setNodeWeights(SceneGraph& graph, uint32_t node, uint32_t first, const float* weights, uint32_t count);
+
+// Recomputes world matrices of dirty nodes and everything below them.
+// Returns the number of nodes updated.
+size_t updateWorldTransforms(SceneGraph& graph);
+
+// World matrices of every node that shows the given mesh, in flat order.
+void collectMeshInstances(const SceneGraph& graph, int mesh, std::vector<glm::mat4>& worlds);
@@ -0,0 +1,342 @@
+#include "skinning.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "accessor.h"
+#include "parallel.h"
+#include "runtime_scene.h"
+
+namespace {
+
+const GLuint kWorkgroupSize = 64;
+// Below this many palette matrices the palette is built on one thread.
+const size_t kParallelPaletteSize = 4096;
+
+const char* kSkinningSource = R"(
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct SkinVertex {
+  vec4 position;
+  vec4 normal;
+  uvec4 joints;
+  vec4 weights;
+};
+
+layout (std430, binding = 0) readonly buffer Vertices { SkinVertex vertices[]; };
+layout (std430, binding = 1) readonly buffer Palette { mat4 palette[]; };
+layout (std430, binding = 2) writeonly buffer Skinned { vec4 skinned[]; };
+layout (std430, binding = 3) readonly buffer Morphed { vec4 morphed[]; };
+
+uniform uint vertexCount;
+uniform uint paletteOffset;
+uniform uint jointCount;
+uniform bool useMorphed;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= vertexCount)
+        return;
+
+    // Several skins may share the vertices, so joints are clamped to this one.
+    SkinVertex v = vertices[i];
+    uvec4 joints = paletteOffset + min(v.joints, uvec4(jointCount - 1u));
+    mat4 m = v.weights.x * palette[joints.x]
+           + v.weights.y * palette[joints.y]
+           + v.weights.z * palette[joints.z]
+           + v.weights.w * palette[joints.w];
+    vec4 position = useMorphed ? morphed[2 * i] : v.position;
+    // Normals take the inverse transpose, so joints with non-uniform scale
+    // keep them perpendicular to the surface. The cofactor matrix is that
+    // times the determinant; its sign keeps mirrored joints facing out and
+    // normalize() drops the rest, with no division by a tiny determinant.
+    mat3 l = mat3(m);
+    mat3 cofactor = mat3(cross(l[1], l[2]), cross(l[2], l[0]), cross(l[0], l[1]));
+    vec3 normal = sign(determinant(l)) * (cofactor * (useMorphed ? morphed[2 * i + 1].xyz : v.normal.xyz));
+    skinned[2 * i] = vec4((m * vec4(position.xyz, 1.0)).xyz, 1.0);
+    skinned[2 * i + 1] = vec4(dot(normal, normal) > 0.0 ? normalize(normal) : normal, 0.0);
+}
+)";
+
+bool readInverseBindMatrices(const tinygltf::Model& gltfmodel, int accessorIndex, size_t count, std::vector<glm::mat4>& out)
+{
+  out.assign(count, glm::mat4(1.0f));
+  if (accessorIndex < 0) return true;
+  AccessorData data;
+  if (!findAccessorData(gltfmodel, accessorIndex, data)) return false;
+  const tinygltf::Accessor& accessor = *data.accessor;
+  if (accessor.type != TINYGLTF_TYPE_MAT4 || accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.count < count)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i)
+  {
+    for (int c = 0; c < 16; ++c)
+    {
+      out[i][c / 4][c % 4] = readComponent(data.base + i * data.stride + c * sizeof(float), accessor.componentType);
+    }
+  }
+  return true;
+}
+
+// Packs what the compute shader reads; leaves packed empty when the primitive
+// lacks the attributes.
+void packSkinVertices(const tinygltf::Model& gltfmodel, const tinygltf::Primitive& source,
+                      std::vector<PackedSkinVertex>& packed)
+{
+  std::vector<glm::vec4> positions;
+  std::vector<glm::vec4> normals;
+  std::vector<glm::uvec4> joints;
+  std::vector<glm::vec4> weights;
+  const int position = primitiveAttribute(source, kAttribPosition);
+  const int normal = primitiveAttribute(source, kAttribNormal);
+  const int joint = primitiveAttribute(source, kAttribJoints0);
+  const int weight = primitiveAttribute(source, kAttribWeights0);
+  if (position < 0 || joint < 0 || weight < 0 ||
+      !readAccessor(gltfmodel, position, positions, 1.0f) ||
+      !readAccessorUint(gltfmodel, joint, joints) ||
+      !readAccessor(gltfmodel, weight, weights, 0.0f) ||
+      joints.size() < positions.size() || weights.size() < positions.size())
+  {
+    return;
+  }
+  if (normal >= 0 && (!readAccessor(gltfmodel, normal, normals, 0.0f) || normals.size() < positions.size()))
+  {
+    normals.clear();
+  }
+
+  packed.resize(positions.size());
+  for (size_t i = 0; i < packed.size(); ++i)
+  {
+    PackedSkinVertex& v = packed[i];
+    v.position = positions[i];
+    v.normal = normals.empty() ? glm::vec4(0.0f) : normals[i];
+    v.joints = joints[i];
+    v.weights = weights[i];
+  }
+}
+
+}
+
+bool prepareSkins(RuntimeScene& scene, SkinUploads& uploads, const tinygltf::Model& gltfmodel)
+{
+  SkinningData& skinning = scene.skinning;
+  const SceneGraph& graph = scene.graph;
+  skinning.skins.resize(gltfmodel.skins.size());
+  std::vector<glm::mat4> inverseBind;
+  for (size_t s = 0; s < gltfmodel.skins.size(); ++s)
+  {
+    const tinygltf::Skin& source = gltfmodel.skins[s];
+    RuntimeSkin& skin = skinning.skins[s];
+    skin.firstJoint = static_cast<uint32_t>(skinning.joints.size());
+
+    bool valid = readInverseBindMatrices(gltfmodel, source.inverseBindMatrices, source.joints.size(), inverseBind);
+    for (int joint : source.joints)
+    {
+      valid = valid && joint >= 0 && joint < (int)graph.flatIndex.size() && graph.flatIndex[joint] >= 0;
+    }
+    if (!valid)
+    {
+      std::printf("Ignoring skin %zu: joints outside the scene or bad inverseBindMatrices\n", s);
+      continue;
+    }
+    for (int joint : source.joints) skinning.joints.push_back(static_cast<uint32_t>(graph.flatIndex[joint]));
+    skinning.inverseBind.insert(skinning.inverseBind.end(), inverseBind.begin(), inverseBind.end());
+    skin.jointCount = static_cast<uint32_t>(source.joints.size());
+  }
+
+  // List the nodes first, then pack each skinned primitive once, in parallel.
+  skinning.nodeFirstDraw.assign(nodeCount(graph), -1);
+  std::vector<uint32_t> skinnedPrimitives;
+  std::vector<uint32_t> primitiveMesh(scene.primitives.size(), 0);
+  std::vector<bool> listed(scene.primitives.size(), false);
+  uint32_t paletteSize = 0;
+  for (uint32_t i = 0; i < nodeCount(graph); ++i)
+  {
+    const int32_t skinIndex = graph.skin[i];
+    const int32_t meshIndex = graph.mesh[i];
+    if (skinIndex < 0 || skinIndex >= (int)skinning.skins.size() || meshIndex < 0) continue;
+    const RuntimeSkin& skin = skinning.skins[skinIndex];
+    if (skin.jointCount == 0) continue;
+
+    const RuntimeMesh& mesh = scene.meshes[meshIndex];
+    SkinnedNode node;
+    node.node = i;
+    node.skin = static_cast<uint32_t>(skinIndex);
+    node.paletteOffset = paletteSize;
+    node.firstDraw = static_cast<uint32_t>(skinning.draws.size());
+    node.drawCount = mesh.primitiveCount;
+    paletteSize += skin.jointCount;
+    skinning.nodeFirstDraw[i] = static_cast<int32_t>(node.firstDraw);
+    skinning.nodes.push_back(node);
+    skinning.draws.resize(skinning.draws.size() + mesh.primitiveCount);
+
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      if (listed[p]) continue;
+      listed[p] = true;
+      primitiveMesh[p] = static_cast<uint32_t>(meshIndex);
+      skinnedPrimitives.push_back(p);
+    }
+  }
+
+  uploads.vertices.resize(scene.primitives.size());
+  parallelFor(skinnedPrimitives.size(), [&](size_t i) {
+    const uint32_t p = skinnedPrimitives[i];
+    const tinygltf::Primitive& source = gltfmodel.meshes[primitiveMesh[p]].primitives[scene.primitives[p].sourcePrimitive];
+    packSkinVertices(gltfmodel, source, uploads.vertices[p]);
+  });
+
+  for (const SkinnedNode& node : skinning.nodes)
+  {
+    const RuntimeMesh& mesh = scene.meshes[graph.mesh[node.node]];
+    for (uint32_t d = 0; d < node.drawCount; ++d)
+    {
+      skinning.draws[node.firstDraw + d].vertexCount =
+        static_cast<uint32_t>(uploads.vertices[mesh.firstPrimitive + d].size());
+    }
+  }
+  skinning.palette.resize(paletteSize);
+  return true;
+}
+
+void uploadSkins(RuntimeScene& scene, SkinUploads& uploads, const tinygltf::Model& gltfmodel)
+{
+  SkinningData& skinning = scene.skinning;
+  skinning.vertexBuffers.assign(scene.primitives.size(), 0);
+  for (size_t p = 0; p < uploads.vertices.size(); ++p)
+  {
+    const std::vector<PackedSkinVertex>& packed = uploads.vertices[p];
+    if (packed.empty()) continue;
+    glCreateBuffers(1, &skinning.vertexBuffers[p]);
+    glNamedBufferStorage(skinning.vertexBuffers[p], packed.size() * sizeof(PackedSkinVertex), packed.data(), 0);
+  }
+
+  for (const SkinnedNode& node : skinning.nodes)
+  {
+    const uint32_t meshIndex = static_cast<uint32_t>(scene.graph.mesh[node.node]);
+    const RuntimeMesh& mesh = scene.meshes[meshIndex];
+    const int32_t firstMorphed = scene.morphs.nodeFirstDraw.empty() ? -1 : scene.morphs.nodeFirstDraw[node.node];
+    for (uint32_t d = 0; d < node.drawCount; ++d)
+    {
+      SkinnedDraw& draw = skinning.draws[node.firstDraw + d];
+      const uint32_t p = mesh.firstPrimitive + d;
+      if (!skinning.vertexBuffers[p]) continue;
+      const RuntimePrimitive& primitive = scene.primitives[p];
+      const tinygltf::Primitive& source = gltfmodel.meshes[meshIndex].primitives[primitive.sourcePrimitive];
+      draw.vertices = skinning.vertexBuffers[p];
+      glCreateBuffers(1, &draw.output);
+      glNamedBufferStorage(draw.output, size_t(draw.vertexCount) * 2 * sizeof(glm::vec4), nullptr, 0);
+      draw.vao = createDeformedVao(scene, gltfmodel, source, primitive, draw.output);
+      if (firstMorphed >= 0) draw.morphed = scene.morphs.draws[firstMorphed + d].output;
+    }
+  }
+
+  if (!skinning.palette.empty())
+  {
+    glCreateBuffers(1, &skinning.paletteBuffer);
+    glNamedBufferStorage(skinning.paletteBuffer, skinning.palette.size() * sizeof(glm::mat4), nullptr,
+                         GL_DYNAMIC_STORAGE_BIT);
+  }
+}
+
+void destroySkins(SkinningData& skinning)
+{
+  for (const SkinnedDraw& draw : skinning.draws)
+  {
+    glDeleteVertexArrays(1, &draw.vao);
+    glDeleteBuffers(1, &draw.output);
+  }
+  for (GLuint buffer : skinning.vertexBuffers)
+  {
+    glDeleteBuffers(1, &buffer);
+  }
+  glDeleteBuffers(1, &skinning.paletteBuffer);
+  skinning = SkinningData{};
+}
+
+bool createSkinningProgram(SkinningProgram& skinning)
+{
+  GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(shader, 1, &kSkinningSource, nullptr);
+  glCompileShader(shader);
+  int success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+    std::printf("ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n%s\n", infoLog);
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    char infoLog[512];
+    glGetProgramInfoLog(program, 512, nullptr, infoLog);
+    std::printf("ERROR::PROGRAM::LINK_FAILED\n%s\n", infoLog);
+  }
+  glDeleteShader(shader);
+
+  skinning.program = program;
+  skinning.vertexCountLoc = glGetUniformLocation(program, "vertexCount");
+  skinning.paletteOffsetLoc = glGetUniformLocation(program, "paletteOffset");
+  skinning.jointCountLoc = glGetUniformLocation(program, "jointCount");
+  skinning.useMorphedLoc = glGetUniformLocation(program, "useMorphed");
+  return success;
+}
+
+void runSkinningPass(const SkinningProgram& program, RuntimeScene& scene)
+{
+  SkinningData& skinning = scene.skinning;
+  if (skinning.nodes.empty()) return;
+
+  // palette = inverse(node world) * joint world * inverse bind, so the
+  // vertex shader can keep applying the node's own world matrix.
+  const SceneGraph& graph = scene.graph;
+  auto buildPalette = [&](size_t n) {
+    const SkinnedNode& node = skinning.nodes[n];
+    const RuntimeSkin& skin = skinning.skins[node.skin];
+    const glm::mat4 toNode = glm::inverse(graph.world[node.node]);
+    for (uint32_t j = 0; j < skin.jointCount; ++j)
+    {
+      const uint32_t joint = skin.firstJoint + j;
+      skinning.palette[node.paletteOffset + j] = toNode * graph.world[skinning.joints[joint]] * skinning.inverseBind[joint];
+    }
+  };
+  if (skinning.palette.size() >= kParallelPaletteSize)
+  {
+    parallelFor(skinning.nodes.size(), buildPalette);
+  }
+  else
+  {
+    for (size_t n = 0; n < skinning.nodes.size(); ++n) buildPalette(n);
+  }
+  glNamedBufferSubData(skinning.paletteBuffer, 0, skinning.palette.size() * sizeof(glm::mat4), skinning.palette.data());
+
+  glUseProgram(program.program);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, skinning.paletteBuffer);
+  for (const SkinnedNode& node : skinning.nodes)
+  {
+    glUniform1ui(program.paletteOffsetLoc, node.paletteOffset);
+    glUniform1ui(program.jointCountLoc, skinning.skins[node.skin].jointCount);
+    for (uint32_t d = node.firstDraw; d < node.firstDraw + node.drawCount; ++d)
+    {
+      const SkinnedDraw& draw = skinning.draws[d];
+      if (!draw.vao) continue;
+      glUniform1ui(program.vertexCountLoc, draw.vertexCount);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, draw.vertices);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, draw.output);
+      // Binding 3 is left pointing at a valid buffer even when unread.
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, draw.morphed ? draw.morphed : draw.vertices);
+      glUniform1i(program.useMorphedLoc, draw.morphed != 0);
+      glDispatchCompute((draw.vertexCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+    }
+  }
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "tiny_gltf.h"
+
+struct RuntimeScene;
+
+// GPU skinning. Every frame the joint matrices of all skinned nodes are
+// computed on the CPU from the scene graph and uploaded to one palette SSBO,
+// then a compute pre-pass writes skinned positions and normals into a vertex
+// buffer per (node, primitive). Every pass drawn after that reads the skinned
+// buffer through its own VAO, so vertices are skinned once per frame however
+// many passes draw them.
+
+struct RuntimeSkin {
+  // Range in SkinningData::joints and inverseBind.
+  uint32_t firstJoint = 0;
+  uint32_t jointCount = 0;
+};
+
+struct SkinnedNode {
+  uint32_t node = 0;  // flat scene graph index
+  uint32_t skin = 0;
+  uint32_t paletteOffset = 0;
+  // One SkinnedDraw per primitive of the node's mesh, starting here.
+  uint32_t firstDraw = 0;
+  uint32_t drawCount = 0;
+};
+
+struct SkinnedDraw {
+  uint32_t vertexCount = 0;
+  // Packed input vertices, shared by every node that skins the primitive.
+  GLuint vertices = 0;
+  // Skinned position and normal per vertex, 32 bytes apart.
+  GLuint output = 0;
+  // Output of the morph pass to skin instead of the packed input positions
+  // and normals, 0 when the node has no morph targets.
+  GLuint morphed = 0;
+  // Draws output in place of the primitive's own VAO; 0 when the primitive
+  // has no JOINTS_0/WEIGHTS_0 and is drawn unskinned.
+  GLuint vao = 0;
+};
+
+struct SkinningData {
+  std::vector<RuntimeSkin> skins;
+  std::vector<uint32_t> joints;  // flat scene graph indices
+  std::vector<glm::mat4> inverseBind;
+  std::vector<SkinnedNode> nodes;
+  std::vector<SkinnedDraw> draws;
+  // Per flat node, the first of its SkinnedDraws or -1.
+  std::vector<int32_t> nodeFirstDraw;
+  // Per runtime primitive, its packed input vertices once a node skins it.
+  std::vector<GLuint> vertexBuffers;
+  GLuint paletteBuffer = 0;
+  // CPU side of the palette, rebuilt every frame.
+  std::vector<glm::mat4> palette;
+};
+
+// Input vertex of the compute pre-pass; matches SkinVertex in the shader
+// (std430).
+struct PackedSkinVertex {
+  glm::vec4 position;
+  glm::vec4 normal;
+  glm::uvec4 joints;
+  glm::vec4 weights;
+};
+
+// Vertex data prepareSkins() leaves for uploadSkins().
+struct SkinUploads {
+  // Per runtime primitive, its packed vertices; empty unless a node skins it.
+  std::vector<std::vector<PackedSkinVertex>> vertices;
+};
+
+// CPU half: resolves the skins and packs the vertices of every skinned
+// primitive in parallel. Runs after the primitives are prepared; no GL. Skins
+// whose joints are not all in the scene are ignored and their nodes drawn
+// unskinned.
+bool prepareSkins(RuntimeScene& scene, SkinUploads& uploads, const tinygltf::Model& gltfmodel);
+
+// GL half: creates the buffers and deformed VAOs. Runs after uploadMorphs().
+void uploadSkins(RuntimeScene& scene, SkinUploads& uploads, const tinygltf::Model& gltfmodel);
+
+void destroySkins(SkinningData& skinning);
+
+struct SkinningProgram {
+  GLuint program = 0;
+  GLint vertexCountLoc = -1;
+  GLint paletteOffsetLoc = -1;
+  GLint jointCountLoc = -1;
+  GLint useMorphedLoc = -1;
+};
+
+bool createSkinningProgram(SkinningProgram& skinning);
+
+// Updates the palette from the current world matrices and dispatches the
+// compute pre-pass. Call after world transforms are updated and before the
+// first pass that draws skinned meshes.
+void runSkinningPass(const SkinningProgram& program, RuntimeScene& scene);
@@ -0,0 +1,587 @@
+#include "softraster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "accessor.h"
+#include "camera.h"
+#include "headless.h"
+#include "image_encode.h"
+#include "loader.h"
+#include "parallel.h"
+#include "scene_graph.h"
+
+namespace {
+
+const int kTileSize = 64;
+const int kBlockSize = 8;
+const int kSubpixels = 16;
+const int kMaxSize = 8192;
+const uint32_t kClearColor = 0xffffffffu;
+// Matches the constant FragColor of the GL fragment shader.
+const glm::vec4 kBaseColor {1.0f, 0.0f, 0.0f, 1.0f};
+
+struct ClipVertex {
+  glm::vec4 pos;
+};
+
+uint32_t packColor(const glm::vec4& c)
+{
+  auto channel = [](float v) { return static_cast<uint32_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); };
+  return channel(c.x) | channel(c.y) << 8 | channel(c.z) << 16 | channel(c.w) << 24;
+}
+
+int64_t floorDiv(int64_t a, int64_t b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Sutherland-Hodgman against one homogeneous plane: keeps dot(plane, pos) >= 0.
+int clipAgainstPlane(const ClipVertex* in, int count, ClipVertex* out, const glm::vec4& plane)
+{
+  int n = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    const ClipVertex& a = in[i];
+    const ClipVertex& b = in[(i + 1) % count];
+    const float da = glm::dot(plane, a.pos);
+    const float db = glm::dot(plane, b.pos);
+    if (da >= 0.0f) out[n++] = a;
+    if ((da >= 0.0f) != (db >= 0.0f))
+    {
+      const float t = da / (da - db);
+      out[n++] = ClipVertex { glm::mix(a.pos, b.pos, t) };
+    }
+  }
+  return n;
+}
+
+// Fills a plane equation q = a*x + b*y + c in pixel coordinates through three vertices.
+void planeThrough(double plane[3], const double x[3], const double y[3], const double q[3], double invArea)
+{
+  const double a = ((q[1] - q[0]) * (y[2] - y[0]) - (q[2] - q[0]) * (y[1] - y[0])) * invArea;
+  const double b = ((q[2] - q[0]) * (x[1] - x[0]) - (q[1] - q[0]) * (x[2] - x[0])) * invArea;
+  plane[0] = a;
+  plane[1] = b;
+  plane[2] = q[0] - a * x[0] - b * y[0];
+}
+
+bool setupTriangle(const SoftRasterizer& raster, const ClipVertex* v, SoftTriangle& tri)
+{
+  int64_t sx[3], sy[3];
+  double z[3], invW[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    invW[i] = 1.0 / v[i].pos.w;
+    const double ndcX = v[i].pos.x * invW[i];
+    const double ndcY = v[i].pos.y * invW[i];
+    z[i] = v[i].pos.z * invW[i] * 0.5 + 0.5;
+    // Snap to the subpixel grid so shared edges produce identical edge functions.
+    sx[i] = std::llround((ndcX * 0.5 + 0.5) * raster.width * kSubpixels);
+    sy[i] = std::llround((0.5 - ndcY * 0.5) * raster.height * kSubpixels);
+  }
+
+  int order[3] = {0, 1, 2};
+  int64_t area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+  if (area == 0) return false;
+  // Nothing is culled, so normalize the winding instead.
+  if (area < 0)
+  {
+    std::swap(order[1], order[2]);
+    area = -area;
+  }
+
+  double px[3], py[3], pz[3];
+  int64_t X[3], Y[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    const int o = order[i];
+    X[i] = sx[o];
+    Y[i] = sy[o];
+    px[i] = static_cast<double>(sx[o]) / kSubpixels;
+    py[i] = static_cast<double>(sy[o]) / kSubpixels;
+    pz[i] = z[o];
+  }
+
+  const int64_t minX = std::min({X[0], X[1], X[2]});
+  const int64_t maxX = std::max({X[0], X[1], X[2]});
+  const int64_t minY = std::min({Y[0], Y[1], Y[2]});
+  const int64_t maxY = std::max({Y[0], Y[1], Y[2]});
+  // Pixel centers sit at x * 16 + 8.
+  tri.minX = static_cast<int>(std::max<int64_t>(0, floorDiv(minX - kSubpixels / 2 + kSubpixels - 1, kSubpixels)));
+  tri.maxX = static_cast<int>(std::min<int64_t>(raster.width - 1, floorDiv(maxX - kSubpixels / 2, kSubpixels)));
+  tri.minY = static_cast<int>(std::max<int64_t>(0, floorDiv(minY - kSubpixels / 2 + kSubpixels - 1, kSubpixels)));
+  tri.maxY = static_cast<int>(std::min<int64_t>(raster.height - 1, floorDiv(maxY - kSubpixels / 2, kSubpixels)));
+  if (tri.minX > tri.maxX || tri.minY > tri.maxY) return false;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    const int a = (i + 1) % 3;
+    const int b = (i + 2) % 3;
+    const int64_t A = -(Y[b] - Y[a]);
+    const int64_t B = X[b] - X[a];
+    const bool topLeft = A > 0 || (A == 0 && B > 0);
+    tri.edgeA[i] = A;
+    tri.edgeB[i] = B;
+    // Pixels exactly on an edge belong to the triangle only for top and left edges.
+    tri.edgeC[i] = -(A * X[a] + B * Y[a]) - (topLeft ? 0 : 1);
+  }
+
+  const double invArea = static_cast<double>(kSubpixels) * kSubpixels / static_cast<double>(area);
+  planeThrough(tri.zPlane, px, py, pz, invArea);
+  tri.zMin = static_cast<float>(std::min({pz[0], pz[1], pz[2]}));
+  return true;
+}
+
+int paddedWidth(const SoftRasterizer& raster)
+{
+  return raster.tilesX * kTileSize;
+}
+
+// Shades up to four pixels starting at (x, y). edges hold the edge function
+// values of the four pixels; a negative value in any edge means outside.
+#if defined(__SSE2__)
+bool shadeQuad(SoftRasterizer& raster, const SoftTriangle& tri, int x, int y, const __m128i edges[3])
+{
+  const __m128i outside = _mm_or_si128(_mm_or_si128(edges[0], edges[1]), edges[2]);
+  const __m128 covered = _mm_castsi128_ps(_mm_cmpgt_epi32(outside, _mm_set1_epi32(-1)));
+  if (_mm_movemask_ps(covered) == 0) return false;
+
+  const size_t offset = static_cast<size_t>(y) * paddedWidth(raster) + x;
+  const float fx = x + 0.5f;
+  const float fy = y + 0.5f;
+  const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  auto evalPlane = [&](const double plane[3]) {
+    const float origin = static_cast<float>(plane[0] * fx + plane[1] * fy + plane[2]);
+    return _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(plane[0]))));
+  };
+
+  const __m128 z = evalPlane(tri.zPlane);
+  float* depth = raster.depth.data() + offset;
+  const __m128 stored = _mm_loadu_ps(depth);
+  const __m128 pass = _mm_and_ps(covered, _mm_cmplt_ps(z, stored));
+  if (_mm_movemask_ps(pass) == 0) return false;
+  _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+
+  const __m128i rgba = _mm_set1_epi32(static_cast<int>(packColor(kBaseColor)));
+
+  uint32_t* color = raster.color.data() + offset;
+  const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color));
+  const __m128i mask = _mm_castps_si128(pass);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(color), _mm_or_si128(_mm_and_si128(mask, rgba), _mm_andnot_si128(mask, old)));
+  return true;
+}
+#else
+bool shadeQuad(SoftRasterizer& raster, const SoftTriangle& tri, int x, int y, const int32_t edges[3][4])
+{
+  const size_t offset = static_cast<size_t>(y) * paddedWidth(raster) + x;
+  bool wrote = false;
+  for (int i = 0; i < 4; ++i)
+  {
+    if ((edges[0][i] | edges[1][i] | edges[2][i]) < 0) continue;
+    const float fx = x + i + 0.5f;
+    const float fy = y + 0.5f;
+    auto evalPlane = [&](const double plane[3]) { return static_cast<float>(plane[0] * fx + plane[1] * fy + plane[2]); };
+    const float z = evalPlane(tri.zPlane);
+    if (!(z < raster.depth[offset + i])) continue;
+    raster.depth[offset + i] = z;
+    raster.color[offset + i] = packColor(kBaseColor);
+    wrote = true;
+  }
+  return wrote;
+}
+#endif
+
+void rasterTriangle(SoftRasterizer& raster, const SoftTriangle& tri, int tileX, int tileY)
+{
+  const int x0 = std::max(tri.minX, tileX) & ~(kBlockSize - 1);
+  const int y0 = std::max(tri.minY, tileY) & ~(kBlockSize - 1);
+  const int x1 = std::min(tri.maxX, tileX + kTileSize - 1);
+  const int y1 = std::min(tri.maxY, tileY + kTileSize - 1);
+  const int blocksPerRow = paddedWidth(raster) / kBlockSize;
+  const int64_t blockSpan = (kBlockSize - 1) * kSubpixels;
+
+  for (int by = y0; by <= y1; by += kBlockSize)
+  {
+    for (int bx = x0; bx <= x1; bx += kBlockSize)
+    {
+      float& blockMaxZ = raster.blockMaxZ[(by / kBlockSize) * blocksPerRow + bx / kBlockSize];
+      if (tri.zMin >= blockMaxZ) continue;
+
+      // Classify the block against each edge from its corner pixel centers.
+      // Edges that contain the whole block are dropped from the per-pixel test,
+      // which also keeps the remaining values small enough for 32-bit lanes.
+      int32_t origin[3], stepX[3], stepY[3];
+      bool rejected = false;
+      for (int i = 0; i < 3; ++i)
+      {
+        const int64_t A = tri.edgeA[i];
+        const int64_t B = tri.edgeB[i];
+        const int64_t e = A * (bx * kSubpixels + kSubpixels / 2) + B * (by * kSubpixels + kSubpixels / 2) + tri.edgeC[i];
+        const int64_t lo = e + std::min<int64_t>(0, A * blockSpan) + std::min<int64_t>(0, B * blockSpan);
+        const int64_t hi = e + std::max<int64_t>(0, A * blockSpan) + std::max<int64_t>(0, B * blockSpan);
+        if (hi < 0)
+        {
+          rejected = true;
+          break;
+        }
+        const bool inside = lo >= 0;
+        origin[i] = inside ? 0 : static_cast<int32_t>(e);
+        stepX[i] = inside ? 0 : static_cast<int32_t>(A * kSubpixels);
+        stepY[i] = inside ? 0 : static_cast<int32_t>(B * kSubpixels);
+      }
+      if (rejected) continue;
+
+      bool wrote = false;
+      for (int row = 0; row < kBlockSize; ++row)
+      {
+        for (int col = 0; col < kBlockSize; col += 4)
+        {
+#if defined(__SSE2__)
+          __m128i edges[3];
+          for (int i = 0; i < 3; ++i)
+          {
+            const int32_t start = origin[i] + stepY[i] * row + stepX[i] * col;
+            edges[i] = _mm_add_epi32(_mm_set1_epi32(start), _mm_setr_epi32(0, stepX[i], 2 * stepX[i], 3 * stepX[i]));
+          }
+#else
+          int32_t edges[3][4];
+          for (int i = 0; i < 3; ++i)
+          {
+            for (int lane = 0; lane < 4; ++lane) edges[i][lane] = origin[i] + stepY[i] * row + stepX[i] * (col + lane);
+          }
+#endif
+          wrote |= shadeQuad(raster, tri, bx + col, by + row, edges);
+        }
+      }
+
+      if (wrote)
+      {
+        const int stride = paddedWidth(raster);
+        float farthest = 0.0f;
+        for (int row = 0; row < kBlockSize; ++row)
+        {
+          const float* depth = raster.depth.data() + static_cast<size_t>(by + row) * stride + bx;
+          for (int col = 0; col < kBlockSize; ++col) farthest = std::max(farthest, depth[col]);
+        }
+        blockMaxZ = farthest;
+      }
+    }
+  }
+}
+
+void rasterTile(SoftRasterizer& raster, int tile)
+{
+  const int tileX = (tile % raster.tilesX) * kTileSize;
+  const int tileY = (tile / raster.tilesX) * kTileSize;
+  const int stride = paddedWidth(raster);
+  const int blocksPerRow = stride / kBlockSize;
+
+  for (int y = tileY; y < tileY + kTileSize; ++y)
+  {
+    std::fill_n(raster.color.data() + static_cast<size_t>(y) * stride + tileX, kTileSize, kClearColor);
+    std::fill_n(raster.depth.data() + static_cast<size_t>(y) * stride + tileX, kTileSize, 1.0f);
+  }
+  for (int by = tileY / kBlockSize; by < (tileY + kTileSize) / kBlockSize; ++by)
+  {
+    std::fill_n(raster.blockMaxZ.data() + static_cast<size_t>(by) * blocksPerRow + tileX / kBlockSize, kTileSize / kBlockSize, 1.0f);
+  }
+
+  // Chunks are walked in submission order so overlapping triangles resolve
+  // the same way regardless of how many threads did the binning.
+  for (const SoftRasterizer::Chunk& chunk : raster.chunks)
+  {
+    for (uint32_t id : chunk.bins[tile])
+    {
+      rasterTriangle(raster, chunk.triangles[id], tileX, tileY);
+    }
+  }
+}
+
+}
+
+bool createSoftMeshes(std::vector<SoftMesh>& meshes, const tinygltf::Model& gltfmodel)
+{
+  meshes.assign(gltfmodel.meshes.size(), SoftMesh{});
+  size_t skipped = 0;
+  std::vector<glm::vec4> values;
+  std::vector<uint32_t> indices;
+  for (size_t m = 0; m < gltfmodel.meshes.size(); ++m)
+  {
+    SoftMesh& mesh = meshes[m];
+    for (const tinygltf::Primitive& primitive : gltfmodel.meshes[m].primitives)
+    {
+      const int mode = primitive.mode >= 0 ? primitive.mode : TINYGLTF_MODE_TRIANGLES;
+      const auto position = primitive.attributes.find("POSITION");
+      if (mode != TINYGLTF_MODE_TRIANGLES && mode != TINYGLTF_MODE_TRIANGLE_STRIP && mode != TINYGLTF_MODE_TRIANGLE_FAN)
+      {
+        ++skipped;
+        continue;
+      }
+      // The GL path skips primitives it cannot read, and so does this one.
+      if (position == primitive.attributes.end() || !readAccessor(gltfmodel, position->second, values, 1.0f) ||
+          (primitive.indices >= 0 && !readIndices(gltfmodel, primitive.indices, indices)))
+      {
+        std::printf("Mesh %zu has a primitive without readable positions or indices\n", m);
+        continue;
+      }
+      if (primitive.indices < 0)
+      {
+        indices.resize(values.size());
+        for (size_t i = 0; i < indices.size(); ++i) indices[i] = static_cast<uint32_t>(i);
+      }
+      if (std::any_of(indices.begin(), indices.end(), [&](uint32_t index) { return index >= values.size(); }))
+      {
+        std::printf("Mesh %zu has a primitive index out of range\n", m);
+        continue;
+      }
+
+      const uint32_t base = static_cast<uint32_t>(mesh.positions.size());
+      for (const glm::vec4& value : values) mesh.positions.push_back(glm::vec3(value));
+      auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+        mesh.indices.insert(mesh.indices.end(), { base + a, base + b, base + c });
+      };
+      const size_t count = indices.size();
+      if (mode == TINYGLTF_MODE_TRIANGLES)
+      {
+        for (size_t i = 0; i + 2 < count; i += 3) add(indices[i], indices[i + 1], indices[i + 2]);
+      }
+      else
+      {
+        // Winding does not matter: nothing is culled.
+        for (size_t i = 0; i + 2 < count; ++i)
+        {
+          if (mode == TINYGLTF_MODE_TRIANGLE_FAN) add(indices[0], indices[i + 1], indices[i + 2]);
+          else add(indices[i], indices[i + 1], indices[i + 2]);
+        }
+      }
+    }
+  }
+  if (skipped > 0) std::printf("Software renderer skips %zu point and line primitives\n", skipped);
+  return true;
+}
+
+bool createSoftRasterizer(SoftRasterizer& raster, int width, int height)
+{
+  if (width <= 0 || height <= 0 || width > kMaxSize || height > kMaxSize)
+  {
+    std::printf("Software framebuffer size %dx%d out of range\n", width, height);
+    return false;
+  }
+
+  raster.width = width;
+  raster.height = height;
+  raster.tilesX = (width + kTileSize - 1) / kTileSize;
+  raster.tilesY = (height + kTileSize - 1) / kTileSize;
+  // Clip to a guard band that keeps snapped coordinates within +-2^17 subpixels.
+  raster.guardBand = std::max(1.0f, (1 << 18) / static_cast<float>(kSubpixels * std::max(width, height)) - 1.0f);
+
+  const size_t pixels = static_cast<size_t>(raster.tilesX) * raster.tilesY * kTileSize * kTileSize;
+  raster.color.assign(pixels, kClearColor);
+  raster.depth.assign(pixels, 1.0f);
+  raster.blockMaxZ.assign(pixels / (kBlockSize * kBlockSize), 1.0f);
+  return true;
+}
+
+void softDrawFrame(SoftRasterizer& raster, const std::vector<SoftMesh>& meshes, const std::vector<SoftInstance>& instances)
+{
+  const size_t vertexChunk = 4096;
+  raster.vertexBase.assign(1, 0);
+  raster.triangleBase.assign(1, 0);
+  raster.chunkBase.assign(1, 0);
+  for (const SoftInstance& instance : instances)
+  {
+    const SoftMesh& mesh = meshes[instance.mesh];
+    raster.vertexBase.push_back(raster.vertexBase.back() + mesh.positions.size());
+    raster.triangleBase.push_back(raster.triangleBase.back() + mesh.indices.size() / 3);
+    raster.chunkBase.push_back(raster.chunkBase.back() + (mesh.positions.size() + vertexChunk - 1) / vertexChunk);
+  }
+
+  raster.clipPositions.resize(raster.vertexBase.back());
+  parallelFor(raster.chunkBase.back(), [&](size_t chunk) {
+    const size_t instance = std::upper_bound(raster.chunkBase.begin(), raster.chunkBase.end(), chunk) - raster.chunkBase.begin() - 1;
+    const SoftMesh& mesh = meshes[instances[instance].mesh];
+    const size_t begin = (chunk - raster.chunkBase[instance]) * vertexChunk;
+    const size_t end = std::min(mesh.positions.size(), begin + vertexChunk);
+    const glm::mat4& mvp = instances[instance].mvp;
+    glm::vec4* out = raster.clipPositions.data() + raster.vertexBase[instance];
+    for (size_t i = begin; i < end; ++i)
+    {
+      out[i] = mvp * glm::vec4(mesh.positions[i], 1.0f);
+    }
+  });
+
+  // Triangle t belongs to the instance whose triangleBase range holds it.
+  const size_t triangleCount = raster.triangleBase.back();
+  const size_t tiles = static_cast<size_t>(raster.tilesX) * raster.tilesY;
+  const size_t chunkSize = std::max<size_t>(1024, (triangleCount + workerCount() * 4 - 1) / (workerCount() * 4));
+  raster.chunks.resize((triangleCount + chunkSize - 1) / chunkSize);
+
+  const float g = raster.guardBand;
+  const glm::vec4 planes[] = {
+    { 0.0f,  0.0f,  1.0f, 1.0f },  // near
+    { 0.0f,  0.0f, -1.0f, 1.0f },  // far
+    { 1.0f,  0.0f,  0.0f, g },
+    {-1.0f,  0.0f,  0.0f, g },
+    { 0.0f,  1.0f,  0.0f, g },
+    { 0.0f, -1.0f,  0.0f, g },
+  };
+
+  parallelFor(raster.chunks.size(), [&](size_t c) {
+    SoftRasterizer::Chunk& chunk = raster.chunks[c];
+    chunk.triangles.clear();
+    chunk.bins.resize(tiles);
+    for (std::vector<uint32_t>& bin : chunk.bins) bin.clear();
+
+    const size_t end = std::min(triangleCount, (c + 1) * chunkSize);
+    size_t instance = std::upper_bound(raster.triangleBase.begin(), raster.triangleBase.end(), c * chunkSize) - raster.triangleBase.begin() - 1;
+    for (size_t t = c * chunkSize; t < end; ++t)
+    {
+      while (t >= raster.triangleBase[instance + 1]) ++instance;
+      const SoftMesh& mesh = meshes[instances[instance].mesh];
+      const glm::vec4* clip = raster.clipPositions.data() + raster.vertexBase[instance];
+      const size_t first = (t - raster.triangleBase[instance]) * 3;
+
+      ClipVertex polygon[2][3 + 6];
+      int count = 3;
+      uint32_t outsideAll = ~0u;
+      uint32_t outsideAny = 0;
+      for (int i = 0; i < 3; ++i)
+      {
+        polygon[0][i] = ClipVertex { clip[mesh.indices[first + i]] };
+        uint32_t outside = 0;
+        for (int p = 0; p < 6; ++p)
+        {
+          if (glm::dot(planes[p], polygon[0][i].pos) < 0.0f) outside |= 1u << p;
+        }
+        outsideAll &= outside;
+        outsideAny |= outside;
+      }
+      if (outsideAll) continue;
+
+      int current = 0;
+      for (int p = 0; p < 6 && count >= 3; ++p)
+      {
+        if (!(outsideAny & (1u << p))) continue;
+        count = clipAgainstPlane(polygon[current], count, polygon[current ^ 1], planes[p]);
+        current ^= 1;
+      }
+
+      for (int i = 1; i + 1 < count; ++i)
+      {
+        const ClipVertex fan[3] = { polygon[current][0], polygon[current][i], polygon[current][i + 1] };
+        SoftTriangle tri;
+        if (!setupTriangle(raster, fan, tri)) continue;
+
+        const uint32_t id = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(tri);
+        for (int ty = tri.minY / kTileSize; ty <= tri.maxY / kTileSize; ++ty)
+        {
+          for (int tx = tri.minX / kTileSize; tx <= tri.maxX / kTileSize; ++tx)
+          {
+            chunk.bins[ty * raster.tilesX + tx].push_back(id);
+          }
+        }
+      }
+    }
+  });
+
+  parallelFor(tiles, [&](size_t tile) { rasterTile(raster, static_cast<int>(tile)); });
+}
+
+bool writeSoftFramebufferPng(const SoftRasterizer& raster, const char* path, int level)
+{
+  const bool ok = writeImage(path, reinterpret_cast<const unsigned char*>(raster.color.data()), raster.width, raster.height, 4, paddedWidth(raster) * 4, level);
+  if (!ok)
+  {
+    std::printf("Failed to write %s\n", path);
+  }
+  return ok;
+}
+
+namespace {
+
+// loadModel(), or with a subset only that part of the file.
+bool loadSoftwareModel(tinygltf::Model& gltfmodel, const HeadlessOptions& options)
+{
+  if (isWholeModel(options.subset)) return loadModel(gltfmodel, options.modelPath);
+  std::vector<unsigned char> data;
+  std::vector<DeferredImage> images;
+  std::string error;
+  if (!readModelSubset(options.modelPath, options.subset, data, error))
+  {
+    std::printf("Unable to load part of %s: %s\n", options.modelPath.c_str(), error.c_str());
+    return false;
+  }
+  if (!parseModel(gltfmodel, data, options.modelPath, images)) return false;
+  for (const DeferredImage& image : images)
+  {
+    if (!decodeImage(gltfmodel, image)) return false;
+  }
+  return true;
+}
+
+}
+
+int runSoftware(const HeadlessOptions& options)
+{
+  tinygltf::Model gltfmodel;
+  SceneGraph scene;
+  std::vector<SoftMesh> meshes;
+  SoftRasterizer raster;
+  if (!loadSoftwareModel(gltfmodel, options) || !buildSceneGraph(scene, gltfmodel) || !createSoftMeshes(meshes, gltfmodel) ||
+      !createSoftRasterizer(raster, options.width, options.height))
+  {
+    return -1;
+  }
+  std::printf("Software renderer: %u threads, %dx%d tiles\n", workerCount(), raster.tilesX, raster.tilesY);
+
+  const Camera camera = makeDefaultCamera();
+  glm::mat4 proj = glm::perspectiveRH(45.0f, options.width / (float)options.height, 1.0f, 100.0f);
+  const glm::mat4 viewProj = proj * getViewMatrix(camera);
+  std::vector<SoftInstance> instances;
+  for (size_t i = 0; i < nodeCount(scene); ++i)
+  {
+    const int mesh = scene.mesh[i];
+    if (mesh >= 0 && static_cast<size_t>(mesh) < meshes.size())
+    {
+      instances.push_back(SoftInstance{ static_cast<uint32_t>(mesh), viewProj * scene.world[i] });
+    }
+  }
+
+  const bool perFrameOutput = options.outputPath.find('%') != std::string::npos;
+  double total = 0.0;
+  for (int frame = 0; frame < options.frames; ++frame)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    softDrawFrame(raster, meshes, instances);
+    const auto end = std::chrono::steady_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    total += ms;
+    std::printf("frame %d: cpu %.3f ms\n", frame, ms);
+
+    if (perFrameOutput || frame == options.frames - 1)
+    {
+      std::string path;
+      if (!expandFramePattern(options.outputPath, frame, path) || !writeSoftFramebufferPng(raster, path.c_str(), options.pngLevel))
+      {
+        return -1;
+      }
+    }
+  }
+
+  if (options.frames > 0)
+  {
+    std::printf("%d frames: avg cpu %.3f ms\n", options.frames, total / options.frames);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "image_encode.h"
+#include "tiny_gltf.h"
+
+struct HeadlessOptions;
+
+// CPU implementation of the viewer's draw path, used when no GL driver is
+// available and as a deterministic reference. Every mesh node of the scene
+// is drawn with its world transform and shaded like the GL fragment shader,
+// in constant red. Skinning, morph targets and animation are not applied,
+// and point and line primitives are skipped. Triangles are binned into
+// 64x64 tiles and every tile is rasterized as one parallelFor job, so the
+// output does not depend on the number of threads.
+
+// The triangles, strips and fans of one glTF mesh as one triangle list.
+struct SoftMesh {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// One mesh node to draw.
+struct SoftInstance {
+  uint32_t mesh;
+  glm::mat4 mvp;
+};
+
+// Screen-space triangle after clipping and setup.
+struct SoftTriangle {
+  int minX, minY, maxX, maxY;
+  // Edge functions A*x + B*y + C in 1/16 pixel units, fill rule folded into C.
+  int64_t edgeA[3], edgeB[3], edgeC[3];
+  // Plane equation a*x + b*y + c in pixels for depth.
+  double zPlane[3];
+  float zMin;
+};
+
+struct SoftRasterizer {
+  int width = 0;
+  int height = 0;
+  int tilesX = 0;
+  int tilesY = 0;
+  float guardBand = 1.0f;
+  // RGBA8 top row first, ready for stbi_write_png.
+  std::vector<uint32_t> color;
+  std::vector<float> depth;
+  // Hierarchical Z: the farthest depth stored in each 8x8 block.
+  std::vector<float> blockMaxZ;
+
+  // Per-frame scratch, kept to avoid reallocating every frame.
+  std::vector<glm::vec4> clipPositions;
+  // Where each instance starts in clipPositions, in the frame's triangles
+  // and in the vertex transform chunks, with the totals at the end.
+  std::vector<size_t> vertexBase;
+  std::vector<size_t> triangleBase;
+  std::vector<size_t> chunkBase;
+  struct Chunk {
+    std::vector<SoftTriangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;
+  };
+  std::vector<Chunk> chunks;
+};
+
+// One SoftMesh per glTF mesh, indexed like gltfmodel.meshes.
+bool createSoftMeshes(std::vector<SoftMesh>& meshes, const tinygltf::Model& gltfmodel);
+
+// Sizes are limited to 8192 so edge functions stay exact in 64-bit integers.
+bool createSoftRasterizer(SoftRasterizer& raster, int width, int height);
+
+// Clears to white and draws every instance with depth testing, like
+// drawFrame(). Instances are binned in order, so the result does not depend
+// on the thread count.
+void softDrawFrame(SoftRasterizer& raster, const std::vector<SoftMesh>& meshes, const std::vector<SoftInstance>& instances);
+
+// Writes the color buffer through writeImage(), so a .qoi path gives QOI.
+bool writeSoftFramebufferPng(const SoftRasterizer& raster, const char* path, int level = kDefaultPngLevel);
+
+int runSoftware(const HeadlessOptions& options);
@@ -0,0 +1,587 @@
+#include "sort_last.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "asset_pipeline.h"
+#include "camera.h"
+#include "parallel.h"
+#include "renderer.h"
+
+extern char** environ;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// How often a process blocked on the barrier checks that the others live.
+const long kLivenessCheckNs = 100 * 1000 * 1000;
+const size_t kPlaneAlign = 4096;
+
+// Barrier between processes. Once aborted, because some process died, every
+// wait on it fails at once.
+struct SharedBarrier {
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  uint32_t parties;
+  uint32_t arrived;
+  uint32_t generation;
+  uint32_t aborted;
+};
+
+struct WorkerTimes {
+  double renderMs;
+  double compositeMs;
+};
+
+// Start of the shared segment. Each worker's color (RGBA8, bottom-up as GL
+// reads it) and depth (float) planes follow at kPlaneAlign boundaries.
+struct SharedHeader {
+  SharedBarrier barrier;
+  pid_t coordinator;
+  int32_t workers;
+  int32_t width;
+  int32_t height;
+  // Written by the coordinator before each frame-start barrier.
+  int32_t frame;
+  int32_t quit;
+  char modelPath[4096];
+  // options.subset, for the workers to load the same part of the model.
+  int32_t scene;
+  char nodePath[1024];
+  WorkerTimes times[kMaxSortLastWorkers];
+};
+
+struct SharedFrame {
+  SharedHeader* header = nullptr;
+  unsigned char* base = nullptr;
+  size_t bytes = 0;
+};
+
+size_t alignUp(size_t bytes)
+{
+  return (bytes + kPlaneAlign - 1) / kPlaneAlign * kPlaneAlign;
+}
+
+size_t planeBytes(int width, int height)
+{
+  return alignUp(static_cast<size_t>(width) * height * 4);
+}
+
+size_t sharedBytes(int workers, int width, int height)
+{
+  return alignUp(sizeof(SharedHeader)) + static_cast<size_t>(workers) * 2 * planeBytes(width, height);
+}
+
+uint32_t* colorPlane(const SharedFrame& shared, int rank)
+{
+  const SharedHeader& header = *shared.header;
+  const size_t offset = alignUp(sizeof(SharedHeader)) + static_cast<size_t>(rank) * 2 * planeBytes(header.width, header.height);
+  return reinterpret_cast<uint32_t*>(shared.base + offset);
+}
+
+float* depthPlane(const SharedFrame& shared, int rank)
+{
+  const SharedHeader& header = *shared.header;
+  return reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(colorPlane(shared, rank)) + planeBytes(header.width, header.height));
+}
+
+// Creates the segment when bytes is given, otherwise maps an existing one.
+bool mapShared(SharedFrame& shared, const std::string& name, size_t bytes)
+{
+  const int fd = bytes ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    std::printf("Unable to open shared memory %s: %s\n", name.c_str(), std::strerror(errno));
+    return false;
+  }
+  struct stat info;
+  const bool sized = bytes ? ftruncate(fd, static_cast<off_t>(bytes)) == 0 : fstat(fd, &info) == 0;
+  if (!bytes && sized) bytes = static_cast<size_t>(info.st_size);
+  void* mapping = sized ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    std::printf("Unable to map shared memory %s: %s\n", name.c_str(), std::strerror(errno));
+    return false;
+  }
+  shared.base = static_cast<unsigned char*>(mapping);
+  shared.header = static_cast<SharedHeader*>(mapping);
+  shared.bytes = bytes;
+  return true;
+}
+
+void unmapShared(SharedFrame& shared)
+{
+  if (shared.base) munmap(shared.base, shared.bytes);
+  shared = SharedFrame{};
+}
+
+void initBarrier(SharedBarrier& barrier, uint32_t parties)
+{
+  pthread_mutexattr_t mutexAttr;
+  pthread_mutexattr_init(&mutexAttr);
+  pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+  // A process killed while holding the lock must not block the rest.
+  pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&barrier.mutex, &mutexAttr);
+  pthread_mutexattr_destroy(&mutexAttr);
+
+  pthread_condattr_t condAttr;
+  pthread_condattr_init(&condAttr);
+  pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+  pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&barrier.changed, &condAttr);
+  pthread_condattr_destroy(&condAttr);
+
+  barrier.parties = parties;
+  barrier.arrived = 0;
+  barrier.generation = 0;
+  barrier.aborted = 0;
+}
+
+// Called with the mutex held after a lock or wait returned EOWNERDEAD: the
+// process that died cannot arrive any more.
+void recoverBarrier(SharedBarrier& barrier)
+{
+  pthread_mutex_consistent(&barrier.mutex);
+  barrier.aborted = 1;
+  pthread_cond_broadcast(&barrier.changed);
+}
+
+void abortBarrier(SharedBarrier& barrier)
+{
+  const int locked = pthread_mutex_lock(&barrier.mutex);
+  if (locked == EOWNERDEAD) recoverBarrier(barrier);
+  else if (locked != 0) return;
+  barrier.aborted = 1;
+  pthread_cond_broadcast(&barrier.changed);
+  pthread_mutex_unlock(&barrier.mutex);
+}
+
+// Returns true once every party has arrived, or false if the barrier is
+// aborted first. stillAlive() is asked every kLivenessCheckNs while waiting; false
+// aborts the barrier for everyone.
+template <typename Alive>
+bool waitAtBarrier(SharedBarrier& barrier, Alive&& stillAlive)
+{
+  const int locked = pthread_mutex_lock(&barrier.mutex);
+  if (locked == EOWNERDEAD) recoverBarrier(barrier);
+  else if (locked != 0) return false;
+
+  const uint32_t generation = barrier.generation;
+  if (!barrier.aborted && ++barrier.arrived == barrier.parties)
+  {
+    barrier.arrived = 0;
+    ++barrier.generation;
+    pthread_cond_broadcast(&barrier.changed);
+  }
+  while (!barrier.aborted && barrier.generation == generation)
+  {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += kLivenessCheckNs;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_nsec -= 1000000000;
+      ++deadline.tv_sec;
+    }
+    const int waited = pthread_cond_timedwait(&barrier.changed, &barrier.mutex, &deadline);
+    if (waited == EOWNERDEAD) recoverBarrier(barrier);
+    // Parties that already left this barrier may exit, so only check on
+    // them while it is still incomplete.
+    else if (waited == ETIMEDOUT && barrier.generation == generation && !stillAlive())
+    {
+      barrier.aborted = 1;
+      pthread_cond_broadcast(&barrier.changed);
+    }
+  }
+  const bool passed = barrier.generation != generation;
+  pthread_mutex_unlock(&barrier.mutex);
+  return passed;
+}
+
+// Largest power of two not above workers: the ranks that take part in the
+// binary swap.
+int swapWorkers(int workers)
+{
+  int swapping = 1;
+  while (swapping * 2 <= workers) swapping *= 2;
+  return swapping;
+}
+
+// Barriers after the partial images are ready: the fold of the extra
+// workers, if any, then one per binary-swap round.
+int compositeSteps(int workers)
+{
+  int steps = swapWorkers(workers) != workers ? 1 : 0;
+  for (int bit = 1; bit < swapWorkers(workers); bit <<= 1) ++steps;
+  return steps;
+}
+
+// Rows [begin, end) that a swapping rank owns once every round is done.
+void finalRows(int rank, int workers, int height, int& begin, int& end)
+{
+  begin = 0;
+  end = height;
+  for (int bit = 1; bit < swapWorkers(workers); bit <<= 1)
+  {
+    const int mid = (begin + end) / 2;
+    if (rank & bit) begin = mid;
+    else end = mid;
+  }
+}
+
+// Merges rows [begin, end) of from's planes into into's, keeping the nearer
+// sample of each pixel. Equal depths keep the lower rank, so the result does
+// not depend on which side merges.
+void compositeRows(const SharedFrame& shared, int into, int from, int begin, int end)
+{
+  const size_t width = static_cast<size_t>(shared.header->width);
+  uint32_t* intoColor = colorPlane(shared, into);
+  float* intoDepth = depthPlane(shared, into);
+  const uint32_t* fromColor = colorPlane(shared, from);
+  const float* fromDepth = depthPlane(shared, from);
+  const bool fromWinsTies = from < into;
+  parallelFor(static_cast<size_t>(end - begin), [&](size_t row) {
+    const size_t first = (begin + row) * width;
+    for (size_t i = first; i < first + width; ++i)
+    {
+      if (fromDepth[i] < intoDepth[i] || (fromWinsTies && fromDepth[i] == intoDepth[i]))
+      {
+        intoColor[i] = fromColor[i];
+        intoDepth[i] = fromDepth[i];
+      }
+    }
+  });
+}
+
+// Flat nodes this rank draws. Mesh nodes go heaviest first, by index count,
+// to the worker with the least so far, which every worker computes alike.
+std::vector<uint8_t> ownedNodes(const RuntimeScene& scene, int workers, int rank)
+{
+  const SceneGraph& graph = scene.graph;
+  std::vector<std::pair<uint64_t, uint32_t>> weighted;
+  for (uint32_t i = 0; i < nodeCount(graph); ++i)
+  {
+    if (graph.mesh[i] < 0) continue;
+    const RuntimeMesh& mesh = scene.meshes[graph.mesh[i]];
+    uint64_t weight = 1;
+    for (uint32_t p = mesh.firstPrimitive; p < mesh.firstPrimitive + mesh.primitiveCount; ++p)
+    {
+      weight += static_cast<uint64_t>(scene.primitives[p].count);
+    }
+    weighted.push_back({ weight, i });
+  }
+  std::stable_sort(weighted.begin(), weighted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  std::vector<uint64_t> load(workers, 0);
+  std::vector<uint8_t> owned(nodeCount(graph), 0);
+  for (const auto& [weight, node] : weighted)
+  {
+    const size_t lightest = std::min_element(load.begin(), load.end()) - load.begin();
+    load[lightest] += weight;
+    if (static_cast<int>(lightest) == rank) owned[node] = 1;
+  }
+  return owned;
+}
+
+double msBetween(Clock::time_point start, Clock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+}
+
+int runSortLastWorker(const std::string& sharedName, int rank)
+{
+  SharedFrame shared;
+  if (!mapShared(shared, sharedName, 0))
+  {
+    return -1;
+  }
+  SharedHeader& header = *shared.header;
+  const pid_t coordinator = header.coordinator;
+  auto coordinatorAlive = [coordinator] { return getppid() == coordinator; };
+
+  HeadlessContext ctx;
+  Renderer renderer;
+  RuntimeScene scene;
+  Framebuffer fb;
+  const bool ready = createHeadlessContext(ctx) && gladLoadGL(eglGetProcAddress) && createRenderer(renderer) &&
+                     runUntilComplete(loadRuntimeSceneAsync(scene, header.modelPath, { header.scene, header.nodePath })) &&
+                     createFramebuffer(fb, header.width, header.height);
+  if (!ready)
+  {
+    std::printf("Sort-last worker %d failed to start\n", rank);
+    abortBarrier(header.barrier);
+    destroyHeadlessContext(ctx);
+    unmapShared(shared);
+    return -1;
+  }
+
+  const int workers = header.workers;
+  const int swapping = swapWorkers(workers);
+  const std::vector<uint8_t> owned = ownedNodes(scene, workers, rank);
+  const Camera camera = makeDefaultCamera();
+  const glm::mat4 proj = glm::perspectiveRH(45.0f, header.width / (float)header.height, 1.0f, 100.0f);
+  const glm::mat4 view = getViewMatrix(camera);
+  std::vector<AnimationInstance> animations;
+  if (!scene.animations.empty()) startAnimation(animations, scene.animations, 0);
+  FrameArena frameArena;
+  createFrameArena(frameArena, kFrameArenaBytes);
+  VisibilityCache visibility;
+
+  int result = 0;
+  auto sync = [&] {
+    if (waitAtBarrier(header.barrier, coordinatorAlive)) return true;
+    result = -1;
+    return false;
+  };
+  // The first wait tells the coordinator this worker is ready; each frame
+  // then starts once the coordinator has set it up.
+  const bool started = sync();
+  while (started && sync() && !header.quit)
+  {
+    const auto start = Clock::now();
+    // Animations step a fixed 60 Hz from the rest pose, as in runHeadless().
+    beginArenaFrame(frameArena, header.frame);
+    animateScene(animations, scene.animations, scene.graph, header.frame > 0 ? 1.0 / 60.0 : 0.0);
+    updateVisibility(visibility, scene, view, proj);
+    std::erase_if(visibility.visibleNodes, [&](uint32_t node) { return !owned[node]; });
+    drawFrame(renderer, proj * view, scene, visibility, frameArena);
+    glReadPixels(0, 0, header.width, header.height, GL_RGBA, GL_UNSIGNED_BYTE, colorPlane(shared, rank));
+    glReadPixels(0, 0, header.width, header.height, GL_DEPTH_COMPONENT, GL_FLOAT, depthPlane(shared, rank));
+    const auto rendered = Clock::now();
+    // The coordinator reads the times once the frame's last barrier passes,
+    // so they are written before it: after the last round, or right away
+    // when a single worker has nothing to composite.
+    auto recordTimes = [&] { header.times[rank] = { msBetween(start, rendered), msBetween(rendered, Clock::now()) }; };
+    if (swapping == 1) recordTimes();
+
+    // Every partial image is in place.
+    if (!sync()) break;
+    if (swapping != workers)
+    {
+      if (rank < workers - swapping) compositeRows(shared, rank, rank + swapping, 0, header.height);
+      if (!sync()) break;
+    }
+    // Each round this rank keeps half of its rows and merges the partner's
+    // copy of them; the partner reads only the other half, which this rank
+    // no longer writes.
+    int begin = 0, end = header.height;
+    bool failed = false;
+    for (int bit = 1; bit < swapping && !failed; bit <<= 1)
+    {
+      if (rank < swapping)
+      {
+        const int mid = (begin + end) / 2;
+        if (rank & bit) begin = mid;
+        else end = mid;
+        compositeRows(shared, rank, rank ^ bit, begin, end);
+      }
+      if (bit << 1 >= swapping) recordTimes();
+      failed = !sync();
+    }
+    if (failed) break;
+  }
+
+  destroyFramebuffer(fb);
+  destroyRenderer(renderer);
+  destroyRuntimeScene(scene);
+  destroyHeadlessContext(ctx);
+  unmapShared(shared);
+  return result;
+}
+
+int runSortLast(const HeadlessOptions& options)
+{
+  const int workers = options.sortLastWorkers;
+  if (workers < 1 || workers > kMaxSortLastWorkers)
+  {
+    std::printf("--sort-last takes 1 to %d workers\n", kMaxSortLastWorkers);
+    return -1;
+  }
+  if (options.outputPath.size() >= 4 && options.outputPath.compare(options.outputPath.size() - 4, 4, ".y4m") == 0)
+  {
+    std::printf("Sort-last rendering writes PNG or QOI images, not Y4M\n");
+    return -1;
+  }
+
+  char sharedName[64];
+  std::snprintf(sharedName, sizeof(sharedName), "/modelviewer-sort-last-%d", static_cast<int>(getpid()));
+  SharedFrame shared;
+  if (options.modelPath.size() >= sizeof(SharedHeader::modelPath) ||
+      options.subset.nodePath.size() >= sizeof(SharedHeader::nodePath) ||
+      !mapShared(shared, sharedName, sharedBytes(workers, options.width, options.height)))
+  {
+    return -1;
+  }
+  SharedHeader& header = *shared.header;
+  initBarrier(header.barrier, static_cast<uint32_t>(workers + 1));
+  header.coordinator = getpid();
+  header.workers = workers;
+  header.width = options.width;
+  header.height = options.height;
+  std::memcpy(header.modelPath, options.modelPath.c_str(), options.modelPath.size() + 1);
+  header.scene = options.subset.scene;
+  std::memcpy(header.nodePath, options.subset.nodePath.c_str(), options.subset.nodePath.size() + 1);
+
+  // Each worker gets an equal part of the cores for its job system and for
+  // llvmpipe.
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  const std::string threads = std::to_string(std::max(1u, cores / workers));
+  std::vector<std::string> environment;
+  for (char** variable = environ; *variable; ++variable) environment.push_back(*variable);
+  if (!std::getenv("LP_NUM_THREADS")) environment.push_back("LP_NUM_THREADS=" + threads);
+  std::vector<char*> envp;
+  for (std::string& variable : environment) envp.push_back(variable.data());
+  envp.push_back(nullptr);
+
+  std::vector<pid_t> pids;
+  for (int rank = 0; rank < workers; ++rank)
+  {
+    std::string rankArg = std::to_string(rank);
+    std::string threadsArg = threads;
+    char program[] = "modelviewer";
+    char workerFlag[] = "--sort-last-worker";
+    char threadsFlag[] = "--threads";
+    char* argv[] = { program, workerFlag, sharedName, rankArg.data(), threadsFlag, threadsArg.data(), nullptr };
+    pid_t pid;
+    const int spawned = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv, envp.data());
+    if (spawned != 0)
+    {
+      std::printf("Unable to start sort-last worker %d: %s\n", rank, std::strerror(spawned));
+      abortBarrier(header.barrier);
+      break;
+    }
+    pids.push_back(pid);
+  }
+
+  // A worker that exits while the coordinator waits means the frame can
+  // never finish.
+  auto workersAlive = [&pids] {
+    for (pid_t& pid : pids)
+    {
+      int status;
+      if (pid > 0 && waitpid(pid, &status, WNOHANG) == pid)
+      {
+        pid = -1;
+        return false;
+      }
+    }
+    return true;
+  };
+
+  const int steps = compositeSteps(workers);
+  const size_t stride = static_cast<size_t>(options.width) * 4;
+  const bool perFrameOutput = options.outputPath.find('%') != std::string::npos;
+  // Frames are encoded on the job system while the next one renders; two
+  // images so the gather never waits for more than the frame before.
+  std::vector<unsigned char> images[2];
+  JobCounter encodes[2];
+  std::atomic<int> failedWrites {0};
+  double frameMs = 0.0, renderMs = 0.0, compositeMs = 0.0;
+  int frames = 0;
+
+  // The first wait returns once every worker has loaded the model and the
+  // segment is mapped everywhere, after which its name is not needed.
+  bool running = waitAtBarrier(header.barrier, workersAlive);
+  shm_unlink(sharedName);
+  const auto firstFrame = Clock::now();
+  for (int frame = 0; running && frame < options.frames; ++frame)
+  {
+    const auto start = Clock::now();
+    header.frame = frame;
+    header.quit = 0;
+    for (int wait = 0; running && wait < 2 + steps; ++wait)
+    {
+      running = waitAtBarrier(header.barrier, workersAlive);
+    }
+    if (!running) break;
+
+    double slowestRender = 0.0, slowestComposite = 0.0;
+    for (int rank = 0; rank < workers; ++rank)
+    {
+      slowestRender = std::max(slowestRender, header.times[rank].renderMs);
+      slowestComposite = std::max(slowestComposite, header.times[rank].compositeMs);
+    }
+
+    if (perFrameOutput || frame == options.frames - 1)
+    {
+      std::vector<unsigned char>& image = images[frame % 2];
+      waitForCounter(encodes[frame % 2]);
+      image.resize(stride * options.height);
+      for (int rank = 0; rank < swapWorkers(workers); ++rank)
+      {
+        int begin, end;
+        finalRows(rank, workers, options.height, begin, end);
+        std::memcpy(image.data() + stride * begin, reinterpret_cast<const unsigned char*>(colorPlane(shared, rank)) + stride * begin,
+                    stride * (end - begin));
+      }
+      std::string path = options.outputPath;
+      // The pattern was checked when the options were read.
+      if (perFrameOutput) expandFramePattern(options.outputPath, frame, path);
+      submitJob([&image, path, &options, stride, &failedWrites] {
+        // A negative stride from the last row flips GL's bottom-up rows.
+        const unsigned char* top = image.data() + stride * (options.height - 1);
+        if (!writeImage(path, top, options.width, options.height, 4, -static_cast<ptrdiff_t>(stride), options.pngLevel))
+        {
+          std::printf("Unable to write %s\n", path.c_str());
+          ++failedWrites;
+        }
+      }, &encodes[frame % 2]);
+    }
+
+    const double ms = msBetween(start, Clock::now());
+    std::printf("frame %d: %.3f ms, slowest worker render %.3f ms, composite %.3f ms\n", frame, ms, slowestRender,
+                slowestComposite);
+    frameMs += ms;
+    renderMs += slowestRender;
+    compositeMs += slowestComposite;
+    ++frames;
+  }
+  const double totalMs = msBetween(firstFrame, Clock::now());
+
+  // Releases the workers, which see quit after the frame-start barrier.
+  header.quit = 1;
+  if (running) waitAtBarrier(header.barrier, workersAlive);
+  else abortBarrier(header.barrier);
+  int result = running && frames == options.frames ? 0 : -1;
+  for (pid_t pid : pids)
+  {
+    int status;
+    if (pid > 0 && (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) result = -1;
+  }
+  waitForCounter(encodes[0]);
+  waitForCounter(encodes[1]);
+  if (failedWrites > 0) result = -1;
+  if (!running) shm_unlink(sharedName);
+  unmapShared(shared);
+
+  if (frames > 0)
+  {
+    std::printf("%d workers, %d frames: avg %.3f ms (render %.3f ms, composite %.3f ms), %.1f frames/s\n", workers,
+                frames, frameMs / frames, renderMs / frames, compositeMs / frames, frames / (totalMs / 1000.0));
+  }
+  if (result != 0) std::printf("Sort-last rendering failed\n");
+  return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include "headless.h"
+
+// Sort-last rendering over local processes, for models too heavy for one
+// context. The mesh nodes are split into one share per worker process,
+// balanced by index count; every worker loads the model, draws only its
+// share from the same camera and leaves color and depth in shared memory.
+// The workers then depth-composite the partial images by binary swap: over
+// log2(N) rounds each pairs with another, keeps half of the rows it is
+// responsible for and merges the partner's copy of that half into its own,
+// so every worker ends up owning 1/N of the final image. The coordinator
+// gathers those slices and writes the frame while the next one renders.
+// With a worker count that is not a power of two, the workers beyond the
+// largest power first fold their whole image into a partner.
+//
+// The workers are copies of this executable on a process-shared barrier;
+// if any process dies the others notice within a fraction of a second and
+// stop. Each gets an equal part of the cores, for both its job system and
+// llvmpipe's threads (LP_NUM_THREADS, unless already set), so the workers
+// together use the machine once.
+//
+// Blended materials composite by depth like opaque ones, so overlapping
+// transparent surfaces of different shares can differ from a
+// single-process render.
+
+const int kMaxSortLastWorkers = 64;
+
+// Coordinator: renders options.frames frames of options.modelPath with
+// options.sortLastWorkers workers and writes them like runHeadless(), apart
+// from Y4M output, which it does not support.
+int runSortLast(const HeadlessOptions& options);
+
+// Entry point of a worker process, started by runSortLast() with the name
+// of the shared memory segment and the worker's rank.
+int runSortLastWorker(const std::string& sharedName, int rank);
@@ -0,0 +1,62 @@
+#include "task.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+
+struct MainThreadQueue {
+  std::mutex mutex;
+  std::condition_variable posted;
+  std::vector<std::coroutine_handle<>> handles;
+  // Swapped with handles on every run, so steady state never allocates.
+  std::vector<std::coroutine_handle<>> running;
+};
+
+std::atomic<void (*)()> mainThreadWakeup {nullptr};
+
+MainThreadQueue& mainThreadQueue()
+{
+  static MainThreadQueue queue;
+  return queue;
+}
+
+}
+
+void postToMainThread(std::coroutine_handle<> handle)
+{
+  MainThreadQueue& queue = mainThreadQueue();
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.handles.push_back(handle);
+  }
+  queue.posted.notify_one();
+  if (void (*wakeup)() = mainThreadWakeup.load()) wakeup();
+}
+
+void setMainThreadWakeup(void (*wakeup)())
+{
+  mainThreadWakeup = wakeup;
+}
+
+size_t runMainThreadTasks()
+{
+  MainThreadQueue& queue = mainThreadQueue();
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.handles.empty()) return 0;
+    queue.running.swap(queue.handles);
+  }
+  // Coroutines resumed here may post again; those run on the next call.
+  for (std::coroutine_handle<> handle : queue.running) handle.resume();
+  const size_t resumed = queue.running.size();
+  queue.running.clear();
+  return resumed;
+}
+
+void waitForMainThreadTasks(const std::atomic<bool>& done)
+{
+  MainThreadQueue& queue = mainThreadQueue();
+  std::unique_lock<std::mutex> lock(queue.mutex);
+  queue.posted.wait(lock, [&] { return done.load() || !queue.handles.empty(); });
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+// Coroutine tasks on top of the job system, so multi-step asset work reads as
+// straight-line code:
+//
+//   Task<bool> load(...)
+//   {
+//     co_await switchToWorker();      // file I/O and parsing off the GL thread
+//     ...
+//     Task<void> all = whenAll(std::move(decodes));
+//     co_await all;
+//     co_await switchToMainThread();  // GL calls
+//     co_return true;
+//   }
+//
+// A Task does nothing until it is awaited or started with spawn(). Work moved
+// to the main thread resumes at the main loop's runMainThreadTasks() call.
+// Await a task held in a variable rather than a call that takes arguments
+// by value: GCC 12 frees such arguments from the wrong coroutine frame.
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+// Resumes whoever awaited the task once it finishes.
+struct FinalAwaiter {
+  bool await_ready() const noexcept { return false; }
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept
+  {
+    const std::coroutine_handle<> continuation = finished.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+  void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+  void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+  std::optional<T> value;
+  Task<T> get_return_object();
+  void return_value(T v) { value = std::move(v); }
+  T result() { return std::move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+  Task<void> get_return_object();
+  void return_void() const noexcept {}
+  void result() const noexcept {}
+};
+
+}
+
+template <typename T = void>
+class Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task() = default;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task()
+  {
+    if (handle) handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return !handle || handle.done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+  {
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+  T await_resume() { return handle.promise().result(); }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object()
+{
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object()
+{
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+namespace detail {
+
+// Coroutine that owns itself: it starts at once and frees its frame when it
+// finishes.
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() const noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+}
+
+// Continues the coroutine as a job on the worker threads. Without worker
+// threads it just keeps running on the calling thread.
+struct WorkerAwaiter {
+  bool await_ready() const { return workerCount() == 1; }
+  void await_suspend(std::coroutine_handle<> handle) const
+  {
+    submitJob([handle] { handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+};
+
+inline WorkerAwaiter switchToWorker()
+{
+  return {};
+}
+
+// Queues a coroutine for the next runMainThreadTasks() call.
+void postToMainThread(std::coroutine_handle<> handle);
+
+// Resumes every coroutine posted to the main thread so far, on the calling
+// thread. Call once per frame from the thread that owns the GL context.
+// Returns the number resumed.
+size_t runMainThreadTasks();
+
+// Called by postToMainThread(), on the posting thread, so a main loop that
+// sleeps in glfwWaitEvents*() can be woken; e.g. glfwPostEmptyEvent.
+void setMainThreadWakeup(void (*wakeup)());
+
+// Blocks until something is posted to the main thread or done is set.
+void waitForMainThreadTasks(const std::atomic<bool>& done);
+
+struct MainThreadAwaiter {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) const { postToMainThread(handle); }
+  void await_resume() const noexcept {}
+};
+
+inline MainThreadAwaiter switchToMainThread()
+{
+  return {};
+}
+
+// Starts a task without waiting for it; it frees itself when done.
+inline void spawn(Task<void> task)
+{
+  [](Task<void> owned) -> detail::DetachedTask { co_await owned; }(std::move(task));
+}
+
+// Starts every task at once and resumes the awaiting coroutine when the last
+// one finishes. Tasks that switch to a worker run in parallel.
+inline Task<void> whenAll(std::vector<Task<void>> tasks)
+{
+  struct Latch {
+    std::atomic<size_t> remaining;
+    std::coroutine_handle<> waiter;
+  };
+  struct Awaiter {
+    std::vector<Task<void>>& tasks;
+    Latch latch;
+
+    bool await_ready() const noexcept { return tasks.empty(); }
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+      latch.waiter = handle;
+      // One extra count for this function, so no task can resume the waiter
+      // before every task has been started.
+      latch.remaining = tasks.size() + 1;
+      for (Task<void>& task : tasks)
+      {
+        [](Task<void>& child, Latch& done) -> detail::DetachedTask {
+          co_await child;
+          if (done.remaining.fetch_sub(1) == 1) done.waiter.resume();
+        }(task, latch);
+      }
+      return latch.remaining.fetch_sub(1) != 1;
+    }
+    void await_resume() const noexcept {}
+  };
+  co_await Awaiter{ tasks, {} };
+}
+
+// Runs a task to completion from the main thread, resuming its main-thread
+// parts in between. For code paths without a frame loop.
+template <typename T>
+T runUntilComplete(Task<T> task)
+{
+  std::atomic<bool> done {false};
+  std::optional<T> result;
+  [](Task<T>& owned, std::optional<T>& out, std::atomic<bool>& finished) -> detail::DetachedTask {
+    out = co_await owned;
+    finished = true;
+    postToMainThread(std::noop_coroutine());
+  }(task, result, done);
+  while (!done)
+  {
+    waitForMainThreadTasks(done);
+    runMainThreadTasks();
+  }
+  return std::move(*result);
+}
@@ -0,0 +1,522 @@
+#include "thumbnail_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "headless.h"
+#include "render_job.h"
+
+namespace {
+
+// Framebuffer sizes kept between requests.
+const size_t kCachedTargets = 4;
+// A client that sends more than this without a newline is disconnected.
+const size_t kMaxRequestBytes = 64 * 1024;
+
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+struct Client {
+  uint64_t id = 0;
+  int fd = -1;
+  std::string received;
+  std::string unsent;
+  // Requests not answered yet; the connection stays open for them after the
+  // client shuts down its end.
+  int pending = 0;
+  bool hungUp = false;
+  bool closed = false;
+};
+
+struct ModelHash {
+  int64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t hash = 0;
+};
+
+struct RenderTarget {
+  Framebuffer fb;
+  uint64_t lastUsed = 0;
+};
+
+struct Server {
+  ServerOptions options;
+  std::filesystem::path cacheDir;
+  Renderer renderer;
+  SceneCache scenes;
+  std::vector<std::unique_ptr<RenderTarget>> targets;
+  std::vector<AnimationInstance> animations;
+  FrameArena frameArena;
+  uint64_t frame = 0;
+
+  std::vector<std::unique_ptr<Client>> clients;
+  uint64_t nextClient = 1;
+  int inFlight = 0;
+  int requests = 0;
+  int hits = 0;
+  int rendered = 0;
+  int failed = 0;
+
+  // Content hashes by model path, reused while size and mtime match. Read
+  // and filled in from worker threads.
+  std::mutex hashMutex;
+  std::unordered_map<std::string, ModelHash> modelHashes;
+  std::atomic<uint64_t> tempFiles {0};
+};
+
+// Written to wake the poll() loop: by postToMainThread() and on SIGINT or
+// SIGTERM.
+int wakeFd = -1;
+volatile std::sig_atomic_t stopRequested = 0;
+
+void wakeServer()
+{
+  const uint64_t one = 1;
+  const ssize_t written = write(wakeFd, &one, sizeof(one));
+  (void)written;
+}
+
+void onStopSignal(int)
+{
+  stopRequested = 1;
+  wakeServer();
+}
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = kFnvOffset)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+// Hash of the model file's bytes. Only the file named is hashed, so a .gltf
+// whose external buffers or images change in place keeps its old entries.
+bool hashModel(Server& server, const std::string& path, uint64_t& hash)
+{
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return false;
+  const int64_t mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+  {
+    std::lock_guard<std::mutex> lock(server.hashMutex);
+    auto known = server.modelHashes.find(path);
+    if (known != server.modelHashes.end() && known->second.size == info.st_size && known->second.mtime == mtime)
+    {
+      hash = known->second.hash;
+      return true;
+    }
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::vector<char> chunk(1 << 20);
+  hash = kFnvOffset;
+  while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0)
+  {
+    hash = fnv1a(chunk.data(), static_cast<size_t>(file.gcount()), hash);
+  }
+
+  std::lock_guard<std::mutex> lock(server.hashMutex);
+  server.modelHashes[path] = { static_cast<int64_t>(info.st_size), mtime, hash };
+  return true;
+}
+
+// <cache>/<first two hex digits>/<16 hex digits>.<png|qoi>, hashed from
+// the model hash and every parameter that changes the image.
+std::filesystem::path thumbnailPath(const Server& server, uint64_t modelHash, const RenderJob& job, ImageFormat format)
+{
+  const Camera& camera = job.camera;
+  char params[256];
+  std::snprintf(params, sizeof(params), "%016llx %dx%d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d %.17g %d",
+                static_cast<unsigned long long>(modelHash), job.width, job.height, camera.pos.x, camera.pos.y,
+                camera.pos.z, camera.orientation.x, camera.orientation.y, camera.orientation.z, camera.orientation.w,
+                job.variantIndex, job.time, static_cast<int>(format));
+  const uint64_t key = fnv1a(job.variant.data(), job.variant.size(), fnv1a(params, std::strlen(params)));
+
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(key),
+                format == ImageFormat::Qoi ? ".qoi" : ".png");
+  return server.cacheDir / std::string(name, 2) / name;
+}
+
+// A framebuffer of the job's size, evicting the least recently used one.
+Framebuffer* acquireTarget(Server& server, int width, int height)
+{
+  ++server.frame;
+  for (std::unique_ptr<RenderTarget>& target : server.targets)
+  {
+    if (target->fb.width == width && target->fb.height == height)
+    {
+      target->lastUsed = server.frame;
+      return &target->fb;
+    }
+  }
+
+  if (server.targets.size() >= kCachedTargets)
+  {
+    auto oldest = std::min_element(server.targets.begin(), server.targets.end(),
+                                   [](const auto& a, const auto& b) { return a->lastUsed < b->lastUsed; });
+    destroyFramebuffer((*oldest)->fb);
+    server.targets.erase(oldest);
+  }
+
+  auto target = std::make_unique<RenderTarget>();
+  if (!createFramebuffer(target->fb, width, height)) return nullptr;
+  target->lastUsed = server.frame;
+  server.targets.push_back(std::move(target));
+  return &server.targets.back()->fb;
+}
+
+// Answers one request line: from the cache if the image exists, otherwise
+// by loading (or reusing) the scene and drawing it on the main thread and
+// encoding the image on a worker.
+Task<nlohmann::json> renderThumbnail(Server& server, std::string line)
+{
+  co_await switchToWorker();
+  const nlohmann::json request = nlohmann::json::parse(line, nullptr, false);
+  nlohmann::json response = nlohmann::json::object();
+  if (request.is_object() && request.contains("id")) response["id"] = request["id"];
+
+  RenderJob job;
+  std::string error;
+  if (request.is_discarded() || !readRenderJob(request, job, error))
+  {
+    response["error"] = request.is_discarded() ? "not a JSON object" : error;
+    co_return response;
+  }
+  ImageFormat format = ImageFormat::Png;
+  if (request.contains("format"))
+  {
+    const nlohmann::json& name = request["format"];
+    if (name == "qoi") format = ImageFormat::Qoi;
+    else if (name != "png")
+    {
+      response["error"] = "format must be png or qoi";
+      co_return response;
+    }
+  }
+
+  uint64_t modelHash = 0;
+  if (!hashModel(server, job.model, modelHash))
+  {
+    response["error"] = "unable to read " + job.model;
+    co_return response;
+  }
+  const std::filesystem::path path = thumbnailPath(server, modelHash, job, format);
+  response["path"] = path.string();
+  std::error_code ec;
+  if (std::filesystem::exists(path, ec))
+  {
+    response["cached"] = true;
+    co_return response;
+  }
+
+  co_await switchToMainThread();
+  Task<CachedScene*> acquire = acquireScene(server.scenes, job.model, modelHash);
+  CachedScene* cached = co_await acquire;
+  if (!cached)
+  {
+    response.erase("path");
+    response["error"] = "unable to load " + job.model;
+    co_return response;
+  }
+  // The batch renderer falls back to the default materials; a cache entry
+  // named for a variant must not.
+  if (!job.variant.empty() && findMaterialVariant(cached->scene, job.variant) < 0)
+  {
+    releaseScene(*cached);
+    response.erase("path");
+    response["error"] = "no variant " + job.variant;
+    co_return response;
+  }
+  Framebuffer* fb = acquireTarget(server, job.width, job.height);
+  if (!fb)
+  {
+    releaseScene(*cached);
+    response.erase("path");
+    response["error"] = "unable to create a framebuffer of that size";
+    co_return response;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fb->fbo);
+  glViewport(0, 0, job.width, job.height);
+  drawRenderJob(server.renderer, *cached, job, server.animations, server.frameArena, server.frame);
+  releaseScene(*cached);
+  const size_t stride = static_cast<size_t>(job.width) * 4;
+  std::vector<unsigned char> pixels(stride * job.height);
+  glReadPixels(0, 0, job.width, job.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  co_await switchToWorker();
+  // Written next to the entry under a name no other request or server uses,
+  // with the entry's extension so writeImage() picks the same format.
+  std::filesystem::create_directories(path.parent_path(), ec);
+  char suffix[64];
+  std::snprintf(suffix, sizeof(suffix), ".%d-%llu", static_cast<int>(getpid()),
+                static_cast<unsigned long long>(server.tempFiles.fetch_add(1)));
+  const std::filesystem::path temp = path.parent_path() / (path.stem().string() + suffix + path.extension().string());
+  // A negative stride from the last row flips GL's bottom-up rows.
+  const unsigned char* top = pixels.data() + stride * (job.height - 1);
+  if (!writeImage(temp.string(), top, job.width, job.height, 4, -static_cast<ptrdiff_t>(stride), server.options.pngLevel) ||
+      std::rename(temp.c_str(), path.c_str()) != 0)
+  {
+    std::filesystem::remove(temp, ec);
+    response.erase("path");
+    response["error"] = "unable to write " + path.string();
+    co_return response;
+  }
+  response["cached"] = false;
+  co_return response;
+}
+
+void flushClient(Client& client)
+{
+  while (!client.unsent.empty())
+  {
+    const ssize_t sent = send(client.fd, client.unsent.data(), client.unsent.size(), MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) client.closed = true;
+      return;
+    }
+    client.unsent.erase(0, static_cast<size_t>(sent));
+  }
+}
+
+Task<void> serveRequest(Server& server, uint64_t clientId, std::string line)
+{
+  Task<nlohmann::json> render = renderThumbnail(server, std::move(line));
+  const nlohmann::json response = co_await render;
+  co_await switchToMainThread();
+  if (response.contains("error")) ++server.failed;
+  else if (response["cached"].get<bool>()) ++server.hits;
+  else ++server.rendered;
+  --server.inFlight;
+
+  for (std::unique_ptr<Client>& client : server.clients)
+  {
+    if (client->id != clientId) continue;
+    --client->pending;
+    if (client->closed) break;
+    // Model paths and ids come from the client and need not be valid UTF-8.
+    client->unsent += response.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    client->unsent += '\n';
+    flushClient(*client);
+    break;
+  }
+}
+
+// Reads what the client sent and starts a request for every complete line.
+void readClient(Server& server, Client& client)
+{
+  char buffer[16384];
+  for (;;)
+  {
+    const ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (received == 0)
+    {
+      client.hungUp = true;
+      break;
+    }
+    if (received < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) client.closed = true;
+      break;
+    }
+    client.received.append(buffer, static_cast<size_t>(received));
+  }
+
+  size_t start = 0;
+  for (size_t end; (end = client.received.find('\n', start)) != std::string::npos; start = end + 1)
+  {
+    std::string line = client.received.substr(start, end - start);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.find_first_not_of(" \t") == std::string::npos) continue;
+    ++client.pending;
+    ++server.inFlight;
+    ++server.requests;
+    spawn(serveRequest(server, client.id, std::move(line)));
+  }
+  client.received.erase(0, start);
+  if (client.received.size() > kMaxRequestBytes)
+  {
+    std::printf("Dropping client %llu: request longer than %zu bytes\n", static_cast<unsigned long long>(client.id),
+                kMaxRequestBytes);
+    client.closed = true;
+  }
+}
+
+int openListener(const std::string& socketPath)
+{
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path))
+  {
+    std::printf("Socket path %s is too long\n", socketPath.c_str());
+    return -1;
+  }
+  std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+  // A socket left behind by a server that did not shut down cleanly.
+  struct stat info;
+  if (lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) unlink(socketPath.c_str());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+  {
+    std::printf("Unable to listen on %s: %s\n", socketPath.c_str(), std::strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}
+
+int runServer(const ServerOptions& options)
+{
+  auto server = std::make_unique<Server>();
+  server->options = options;
+  std::error_code ec;
+  std::filesystem::create_directories(options.cacheDir, ec);
+  server->cacheDir = std::filesystem::absolute(options.cacheDir, ec);
+  if (ec || !std::filesystem::is_directory(server->cacheDir))
+  {
+    std::printf("Unable to use %s as the thumbnail cache\n", options.cacheDir.c_str());
+    return -1;
+  }
+
+  HeadlessContext ctx;
+  if (!createHeadlessContext(ctx))
+  {
+    return -1;
+  }
+  if (!gladLoadGL(eglGetProcAddress))
+  {
+    std::printf("Failed to initialize OpenGL context\n");
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  enableDebugOutput(false);
+  if (!createRenderer(server->renderer))
+  {
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  server->scenes.capacity = static_cast<size_t>(std::max(1, options.cachedScenes));
+  createFrameArena(server->frameArena, kFrameArenaBytes);
+
+  const int listener = openListener(options.socketPath);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (listener < 0 || wakeFd < 0)
+  {
+    if (listener >= 0) close(listener);
+    destroyRenderer(server->renderer);
+    destroyHeadlessContext(ctx);
+    return -1;
+  }
+  setMainThreadWakeup(wakeServer);
+  struct sigaction stop {};
+  stop.sa_handler = onStopSignal;
+  // No SA_RESTART, so a signal also interrupts poll().
+  sigaction(SIGINT, &stop, nullptr);
+  sigaction(SIGTERM, &stop, nullptr);
+  std::printf("Serving thumbnails on %s, cached in %s\n", options.socketPath.c_str(), server->cacheDir.c_str());
+
+  // After a stop signal no new requests are read, but those in flight are
+  // still answered.
+  std::vector<pollfd> fds;
+  while (!stopRequested || server->inFlight > 0)
+  {
+    const bool stopping = stopRequested;
+    fds.clear();
+    fds.push_back({ wakeFd, POLLIN, 0 });
+    fds.push_back({ listener, static_cast<short>(stopping ? 0 : POLLIN), 0 });
+    for (const std::unique_ptr<Client>& client : server->clients)
+    {
+      short events = 0;
+      if (!stopping && !client->hungUp) events |= POLLIN;
+      if (!client->unsent.empty()) events |= POLLOUT;
+      fds.push_back({ client->fd, events, 0 });
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+    {
+      std::printf("poll failed: %s\n", std::strerror(errno));
+      break;
+    }
+
+    uint64_t wakes;
+    while (read(wakeFd, &wakes, sizeof(wakes)) > 0) {}
+    runMainThreadTasks();
+
+    // Clients accepted below are polled from the next iteration.
+    const size_t polledClients = fds.size() - 2;
+    for (size_t i = 0; i < polledClients; ++i)
+    {
+      Client& client = *server->clients[i];
+      const short revents = fds[i + 2].revents;
+      if (client.closed) continue;
+      if (revents & (POLLIN | POLLHUP | POLLERR)) readClient(*server, client);
+      if (revents & POLLOUT) flushClient(client);
+    }
+    for (auto it = server->clients.begin(); it != server->clients.end();)
+    {
+      Client& client = **it;
+      if (client.closed || (client.hungUp && client.pending == 0 && client.unsent.empty()))
+      {
+        close(client.fd);
+        it = server->clients.erase(it);
+      }
+      else ++it;
+    }
+
+    if (fds[1].revents & POLLIN)
+    {
+      for (int fd; (fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0;)
+      {
+        auto client = std::make_unique<Client>();
+        client->id = server->nextClient++;
+        client->fd = fd;
+        server->clients.push_back(std::move(client));
+      }
+    }
+  }
+
+  for (std::unique_ptr<Client>& client : server->clients) close(client->fd);
+  server->clients.clear();
+  close(listener);
+  unlink(options.socketPath.c_str());
+  setMainThreadWakeup(nullptr);
+  close(wakeFd);
+  wakeFd = -1;
+
+  for (std::unique_ptr<RenderTarget>& target : server->targets) destroyFramebuffer(target->fb);
+  destroySceneCache(server->scenes);
+  destroyRenderer(server->renderer);
+  destroyHeadlessContext(ctx);
+
+  std::printf("%d requests: %d from the cache, %d rendered, %d failed\n", server->requests, server->hits,
+              server->rendered, server->failed);
+  return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include "image_encode.h"
+
+// Long-running thumbnail renderer behind a Unix stream socket. Each line a
+// client sends is a request, a --batch job with the output replaced by an
+// optional id, which is echoed back, and an optional format, "png" (the
+// default) or "qoi":
+//
+//   {"id": 7, "model": "/assets/shoe.glb", "size": [256, 256], "variant": "beach"}
+//
+// and each line the server sends back answers one of them, in the order they
+// finish rather than the order they came in:
+//
+//   {"id": 7, "path": "/var/cache/thumbs/3f/3fa41c0de9b27715.png", "cached": false}
+//   {"id": 8, "error": "unable to load /assets/missing.glb"}
+//
+// Model paths are resolved by the server. Images live in a content-addressed
+// cache: the file name is a hash of the model file's bytes and of the parsed
+// view parameters, so an edited model or a different view gets a new entry
+// and no entry ever goes stale. A request whose image exists is answered
+// without loading the model or touching GL. Images are written to a
+// temporary file and renamed into place, so clients never read a partial
+// image and several servers can share one cache directory.
+//
+// Rendering shares one EGL context and renderer, on the main thread, with a
+// cache of compiled scenes as in --batch. The model hash, glTF parse, scene
+// preparation and image encode of concurrent requests run on the job system
+// and overlap each other's draws.
+
+struct ServerOptions {
+  std::string socketPath;
+  std::string cacheDir = "thumbnails";
+  // Compiled scenes kept loaded between requests.
+  int cachedScenes = 4;
+  int pngLevel = kDefaultPngLevel;
+};
+
+// Serves until SIGINT or SIGTERM, then finishes the requests in flight.
+// Returns 0 after a clean shutdown.
+int runServer(const ServerOptions& options);
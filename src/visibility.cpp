@@ -0,0 +1,167 @@
+#include "visibility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+#include "parallel.h"
+#include "runtime_scene.h"
+
+namespace {
+
+// Above this many nodes the tests are spread over the workers.
+const size_t kParallelCullSize = 4096;
+const size_t kNodesPerJob = 1024;
+
+struct Frustum {
+  // Normalized, pointing inwards.
+  glm::vec4 planes[6];
+};
+
+Frustum extractFrustum(const glm::mat4& viewProj)
+{
+  const glm::vec4 x(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+  const glm::vec4 y(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+  const glm::vec4 z(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+  const glm::vec4 w(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+  Frustum frustum { { w + x, w - x, w + y, w - y, w + z, w - z } };
+  for (glm::vec4& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+  return frustum;
+}
+
+// Angle of the rotation between two camera orientations. Taken from the
+// size of the difference, |R1 - R0| = 2 sqrt(2) sin(angle / 2), rather than
+// the trace, whose acos rounds small angles down to zero.
+float turnAngle(const glm::mat4& from, const glm::mat4& to)
+{
+  float sum = 0.0f;
+  for (int c = 0; c < 3; ++c)
+  {
+    const glm::vec3 d = glm::vec3(to[c]) - glm::vec3(from[c]);
+    sum += glm::dot(d, d);
+  }
+  return 2.0f * std::asin(std::min(1.0f, std::sqrt(sum) / (2.0f * std::sqrt(2.0f))));
+}
+
+glm::vec3 eyePosition(const glm::mat4& view)
+{
+  return glm::vec3(glm::inverse(view)[3]);
+}
+
+bool isCullable(const RuntimeScene& scene, uint32_t node)
+{
+  const int32_t mesh = scene.graph.mesh[node];
+  if (mesh < 0 || !scene.meshes[mesh].bounded) return false;
+  const std::vector<int32_t>& skinned = scene.skinning.nodeFirstDraw;
+  const std::vector<int32_t>& morphed = scene.morphs.nodeFirstDraw;
+  return (skinned.empty() || skinned[node] < 0) && (morphed.empty() || morphed[node] < 0);
+}
+
+void testNode(NodeVisibility& result, const RuntimeMesh& mesh, const glm::mat4& world, const Frustum& frustum,
+              const glm::vec3& eye)
+{
+  const glm::vec3 center = glm::vec3(world * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+  const float scale = std::max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])),
+                                 glm::length(glm::vec3(world[2])) });
+  const float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+
+  // Smallest distance by which the sphere reaches inside a plane; negative
+  // when it is entirely outside one.
+  float inside = FLT_MAX;
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    inside = std::min(inside, glm::dot(glm::vec3(plane), center) + plane.w + radius);
+  }
+  result.visible = inside >= 0.0f;
+  result.margin = std::fabs(inside);
+  result.distance = glm::length(center - eye);
+}
+
+}
+
+void updateVisibility(VisibilityCache& cache, const RuntimeScene& scene, const glm::mat4& view, const glm::mat4& proj)
+{
+  const SceneGraph& graph = scene.graph;
+  const size_t count = nodeCount(graph);
+  cache.stats.tested = 0;
+
+  bool retestAll = !cache.valid || cache.nodes.size() != count || cache.proj != proj || graph.epoch < cache.graphEpoch;
+  if (retestAll)
+  {
+    cache.nodes.assign(count, NodeVisibility{});
+    cache.travel = 0.0;
+    cache.turn = 0.0;
+  }
+  else if (cache.view == view && graph.epoch == cache.graphEpoch)
+  {
+    return;
+  }
+  else
+  {
+    cache.travel += glm::length(eyePosition(view) - eyePosition(cache.view));
+    cache.turn += turnAngle(cache.view, view);
+  }
+
+  const Frustum frustum = extractFrustum(proj * view);
+  const glm::vec3 eye = eyePosition(view);
+  const uint32_t graphEpoch = cache.graphEpoch;
+  std::atomic<uint32_t> tested {0};
+  auto updateRange = [&](size_t begin, size_t end) {
+    uint32_t rangeTested = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+      NodeVisibility& node = cache.nodes[i];
+      const uint32_t index = static_cast<uint32_t>(i);
+      if (!isCullable(scene, index))
+      {
+        node.visible = graph.mesh[i] >= 0;
+        node.margin = FLT_MAX;
+        continue;
+      }
+      if (!retestAll && graph.queuedEpoch[i] <= graphEpoch)
+      {
+        // Each plane moves, relative to the sphere, by at most the camera
+        // travel plus the turn times the sphere's distance from the eye.
+        const double travel = cache.travel - node.travel;
+        const double turn = cache.turn - node.turn;
+        if (travel + (node.distance + travel) * turn < node.margin) continue;
+      }
+      testNode(node, scene.meshes[graph.mesh[i]], graph.world[i], frustum, eye);
+      node.travel = cache.travel;
+      node.turn = cache.turn;
+      ++rangeTested;
+    }
+    tested.fetch_add(rangeTested, std::memory_order_relaxed);
+  };
+  if (count >= kParallelCullSize)
+  {
+    parallelFor((count + kNodesPerJob - 1) / kNodesPerJob, [&](size_t job) {
+      updateRange(job * kNodesPerJob, std::min(count, (job + 1) * kNodesPerJob));
+    });
+  }
+  else
+  {
+    updateRange(0, count);
+  }
+
+  cache.visibleNodes.clear();
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    if (cache.nodes[i].visible && graph.mesh[i] >= 0) cache.visibleNodes.push_back(i);
+  }
+  cache.stats.tested = tested.load(std::memory_order_relaxed);
+  cache.stats.visible = static_cast<uint32_t>(cache.visibleNodes.size());
+  cache.view = view;
+  cache.proj = proj;
+  cache.graphEpoch = graph.epoch;
+  cache.valid = true;
+}
+
+void resetVisibility(VisibilityCache& cache)
+{
+  cache.valid = false;
+  cache.nodes.clear();
+  cache.visibleNodes.clear();
+  cache.stats = VisibilityStats{};
+}
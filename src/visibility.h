@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct RuntimeScene;
+
+// View frustum culling that carries its results from frame to frame. Each
+// node remembers how far its bounding sphere was from changing state (the
+// margin) when it was last tested, and how much the camera had moved by then.
+// A node is tested again only once the camera has moved enough since that
+// test to use up the margin, or when its world transform changed. A static
+// camera over a static scene skips culling altogether, and a slow orbit
+// re-tests only the nodes near the frustum edges.
+//
+// Nodes whose vertices move on the GPU (skinned or morphed) and meshes
+// without POSITION bounds are never culled.
+
+struct NodeVisibility {
+  // Distance the node's sphere could move relative to the frustum planes
+  // before the test result might change.
+  float margin = 0.0f;
+  // Camera travel and turn totals when the node was tested.
+  double travel = 0.0;
+  double turn = 0.0;
+  // Distance from the eye to the sphere center when tested.
+  float distance = 0.0f;
+  uint8_t visible = 0;
+};
+
+struct VisibilityStats {
+  uint32_t tested = 0;
+  uint32_t visible = 0;
+};
+
+struct VisibilityCache {
+  bool valid = false;
+  glm::mat4 view {1.0f};
+  glm::mat4 proj {1.0f};
+  // SceneGraph::epoch at the last update; nodes updated after it are tested.
+  uint32_t graphEpoch = 0;
+  // Camera translation (world units) and rotation (radians) summed over
+  // every update since the cache was last reset. Doubles, so that long runs
+  // do not lose the small per-frame differences.
+  double travel = 0.0;
+  double turn = 0.0;
+  std::vector<NodeVisibility> nodes;
+  // Flat indices of the visible nodes that have a mesh, in flat order.
+  std::vector<uint32_t> visibleNodes;
+  VisibilityStats stats;
+};
+
+// Brings the visible node list up to date for the given camera. Call after
+// world transforms are updated and before drawFrame(). A changed projection
+// or scene layout resets the cache.
+void updateVisibility(VisibilityCache& cache, const RuntimeScene& scene, const glm::mat4& view, const glm::mat4& proj);
+
+// Forgets every result, e.g. after the scene is replaced.
+void resetVisibility(VisibilityCache& cache);
@@ -0,0 +1,388 @@
+// Writes synthetic glTF/GLB scenes of a chosen size for scalability sweeps.
+// Every knob that affects load time, memory or frame time is a parameter:
+// node count, hierarchy depth, unique vs instanced meshes, triangles per
+// mesh, materials, textures and animated nodes.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tiny_gltf.h"
+#include "stb_image_write.h"
+
+struct GenOptions {
+  std::string outputPath;
+  int nodes = 1000;
+  int depth = 4;
+  // Unique meshes; nodes reuse them round-robin, so 1 means fully instanced.
+  int meshes = -1;
+  int triangles = 1000;
+  int materials = 16;
+  int textures = 4;
+  int textureSize = 256;
+  int animated = 0;
+  unsigned seed = 1;
+};
+
+static void printUsage(const char* program)
+{
+  std::printf(
+    "Usage: %s [options] out.glb|out.gltf\n"
+    "  --nodes N           total nodes, every node draws a mesh (default 1000)\n"
+    "  --depth D           hierarchy levels, 1 is flat (default 4)\n"
+    "  --meshes M          unique meshes shared round-robin (default: one per node)\n"
+    "  --triangles T       triangles per mesh (default 1000)\n"
+    "  --materials K       materials (default 16)\n"
+    "  --textures X        base color textures spread over the materials (default 4)\n"
+    "  --texture-size S    texture width and height (default 256)\n"
+    "  --animated A        nodes spun by a looping animation clip (default 0)\n"
+    "  --seed N            seed for the hierarchy shape (default 1)\n",
+    program);
+}
+
+static bool parseArgs(int argc, char** argv, GenOptions& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(arg, "--nodes") == 0 && hasValue) options.nodes = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--depth") == 0 && hasValue) options.depth = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--meshes") == 0 && hasValue) options.meshes = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--triangles") == 0 && hasValue) options.triangles = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--materials") == 0 && hasValue) options.materials = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--textures") == 0 && hasValue) options.textures = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--texture-size") == 0 && hasValue) options.textureSize = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--animated") == 0 && hasValue) options.animated = std::atoi(argv[++i]);
+    else if (std::strcmp(arg, "--seed") == 0 && hasValue) options.seed = static_cast<unsigned>(std::atoi(argv[++i]));
+    else if (arg[0] == '-') return false;
+    else options.outputPath = arg;
+  }
+  if (options.meshes < 0) options.meshes = options.nodes;
+  options.meshes = std::min(options.meshes, options.nodes);
+  options.depth = std::min(options.depth, options.nodes);
+  options.animated = std::clamp(options.animated, 0, options.nodes);
+  return !options.outputPath.empty() && options.nodes > 0 && options.depth > 0 && options.meshes > 0
+    && options.triangles > 0 && options.materials > 0 && options.textures >= 0 && options.textureSize > 0;
+}
+
+// Appends raw bytes to buffer 0 as a new bufferView, 4-byte aligned.
+static int addBufferView(tinygltf::Model& model, const void* data, size_t size, int target)
+{
+  std::vector<unsigned char>& bytes = model.buffers[0].data;
+  bytes.resize((bytes.size() + 3) & ~size_t(3));
+  tinygltf::BufferView view;
+  view.buffer = 0;
+  view.byteOffset = bytes.size();
+  view.byteLength = size;
+  view.target = target;
+  bytes.insert(bytes.end(), static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+  model.bufferViews.push_back(view);
+  return static_cast<int>(model.bufferViews.size() - 1);
+}
+
+static int addAccessor(tinygltf::Model& model, int bufferView, int componentType, int type, size_t count)
+{
+  tinygltf::Accessor accessor;
+  accessor.bufferView = bufferView;
+  accessor.componentType = componentType;
+  accessor.type = type;
+  accessor.count = count;
+  model.accessors.push_back(accessor);
+  return static_cast<int>(model.accessors.size() - 1);
+}
+
+// A wavy grid patch of exactly `triangles` triangles filling the unit cell.
+static void addMesh(tinygltf::Model& model, int meshIndex, int triangles, int material)
+{
+  const int cols = std::max(1, static_cast<int>(std::sqrt(triangles / 2.0)));
+  const int rows = (triangles + 2 * cols - 1) / (2 * cols);
+  const float size = 0.8f;
+  const float phase = meshIndex * 0.7f;
+
+  std::vector<float> positions, normals, uvs;
+  float minPos[3] = { 1e30f, 1e30f, 1e30f };
+  float maxPos[3] = { -1e30f, -1e30f, -1e30f };
+  for (int r = 0; r <= rows; ++r)
+  {
+    for (int c = 0; c <= cols; ++c)
+    {
+      const float u = c / static_cast<float>(cols);
+      const float v = r / static_cast<float>(rows);
+      const float angle = 6.2831853f * u + phase;
+      const float p[3] = { (u - 0.5f) * size, (v - 0.5f) * size, 0.05f * std::sin(angle) * std::cos(6.2831853f * v) };
+      // Normal from the partial derivatives of the height field.
+      const float dx = 0.05f * 6.2831853f / size * std::cos(angle) * std::cos(6.2831853f * v);
+      const float dy = -0.05f * 6.2831853f / size * std::sin(angle) * std::sin(6.2831853f * v);
+      const float len = std::sqrt(dx * dx + dy * dy + 1.0f);
+      for (int k = 0; k < 3; ++k)
+      {
+        positions.push_back(p[k]);
+        minPos[k] = std::min(minPos[k], p[k]);
+        maxPos[k] = std::max(maxPos[k], p[k]);
+      }
+      normals.insert(normals.end(), { -dx / len, -dy / len, 1.0f / len });
+      uvs.insert(uvs.end(), { u, v });
+    }
+  }
+
+  std::vector<uint32_t> indices;
+  for (int r = 0; r < rows; ++r)
+  {
+    for (int c = 0; c < cols; ++c)
+    {
+      const uint32_t i0 = r * (cols + 1) + c;
+      const uint32_t i1 = i0 + 1;
+      const uint32_t i2 = i0 + cols + 1;
+      const uint32_t i3 = i2 + 1;
+      indices.insert(indices.end(), { i0, i1, i3, i0, i3, i2 });
+    }
+  }
+  indices.resize(static_cast<size_t>(triangles) * 3);
+
+  const size_t vertexCount = positions.size() / 3;
+  tinygltf::Primitive primitive;
+  primitive.mode = TINYGLTF_MODE_TRIANGLES;
+  primitive.material = material;
+
+  const int posView = addBufferView(model, positions.data(), positions.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER);
+  primitive.attributes["POSITION"] = addAccessor(model, posView, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+  model.accessors.back().minValues.assign(minPos, minPos + 3);
+  model.accessors.back().maxValues.assign(maxPos, maxPos + 3);
+
+  const int normalView = addBufferView(model, normals.data(), normals.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER);
+  primitive.attributes["NORMAL"] = addAccessor(model, normalView, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount);
+
+  const int uvView = addBufferView(model, uvs.data(), uvs.size() * sizeof(float), TINYGLTF_TARGET_ARRAY_BUFFER);
+  primitive.attributes["TEXCOORD_0"] = addAccessor(model, uvView, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount);
+
+  if (vertexCount <= 65535)
+  {
+    std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+    const int view = addBufferView(model, shortIndices.data(), shortIndices.size() * sizeof(uint16_t), TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+    primitive.indices = addAccessor(model, view, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, shortIndices.size());
+  }
+  else
+  {
+    const int view = addBufferView(model, indices.data(), indices.size() * sizeof(uint32_t), TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+    primitive.indices = addAccessor(model, view, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, indices.size());
+  }
+
+  tinygltf::Mesh mesh;
+  mesh.name = "mesh" + std::to_string(meshIndex);
+  mesh.primitives.push_back(primitive);
+  model.meshes.push_back(mesh);
+}
+
+// One two-second looping clip over the first `animated` nodes, all sharing
+// one time track: every node spins about z with LINEAR rotation keys and
+// every other node also bobs up and down with CUBICSPLINE translation keys.
+static void addAnimation(tinygltf::Model& model, int animated)
+{
+  const int keys = 17;
+  const float duration = 2.0f;
+  const float pi = 3.14159265f;
+  std::vector<float> times(keys);
+  for (int k = 0; k < keys; ++k) times[k] = duration * k / (keys - 1);
+  const int input = addAccessor(model, addBufferView(model, times.data(), times.size() * sizeof(float), 0),
+                                TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, keys);
+  model.accessors[input].minValues = { 0.0 };
+  model.accessors[input].maxValues = { duration };
+
+  tinygltf::Animation animation;
+  animation.name = "spin";
+  for (int i = 0; i < animated; ++i)
+  {
+    const float phase = 2.0f * pi * (i % 7) / 7.0f;
+    std::vector<float> rotation(keys * 4);
+    for (int k = 0; k < keys; ++k)
+    {
+      const float angle = 0.5f * (2.0f * pi * k / (keys - 1) + phase);
+      rotation[k * 4 + 2] = std::sin(angle);
+      rotation[k * 4 + 3] = std::cos(angle);
+    }
+    tinygltf::AnimationSampler sampler;
+    sampler.input = input;
+    sampler.output = addAccessor(model, addBufferView(model, rotation.data(), rotation.size() * sizeof(float), 0),
+                                 TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4, keys);
+    sampler.interpolation = "LINEAR";
+    animation.samplers.push_back(sampler);
+    tinygltf::AnimationChannel channel;
+    channel.sampler = static_cast<int>(animation.samplers.size() - 1);
+    channel.target_node = i;
+    channel.target_path = "rotation";
+    animation.channels.push_back(channel);
+
+    if (i % 2) continue;
+    // In-tangent, value, out-tangent per key.
+    const std::vector<double>& base = model.nodes[i].translation;
+    std::vector<float> translation(keys * 9);
+    for (int k = 0; k < keys; ++k)
+    {
+      const float angle = 2.0f * pi * k / (keys - 1) + phase;
+      const float tangent = 0.2f * 2.0f * pi / duration * std::cos(angle);
+      float* key = translation.data() + k * 9;
+      for (int c = 0; c < 3; ++c) key[3 + c] = static_cast<float>(base[c]);
+      key[2] = key[8] = tangent;
+      key[5] += 0.2f * std::sin(angle);
+    }
+    sampler.output = addAccessor(model, addBufferView(model, translation.data(), translation.size() * sizeof(float), 0),
+                                 TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, keys * 3);
+    sampler.interpolation = "CUBICSPLINE";
+    animation.samplers.push_back(sampler);
+    channel.sampler = static_cast<int>(animation.samplers.size() - 1);
+    channel.target_path = "translation";
+    animation.channels.push_back(channel);
+  }
+  model.animations.push_back(animation);
+}
+
+static void stbiAppend(void* context, void* data, int size)
+{
+  auto* out = static_cast<std::vector<unsigned char>*>(context);
+  out->insert(out->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+}
+
+// A checkerboard PNG stored in the binary buffer, like textures in real GLBs.
+static void addTexture(tinygltf::Model& model, int textureIndex, int size)
+{
+  std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 4);
+  const unsigned char hue[3] = {
+    static_cast<unsigned char>(80 + (textureIndex * 67) % 176),
+    static_cast<unsigned char>(80 + (textureIndex * 131) % 176),
+    static_cast<unsigned char>(80 + (textureIndex * 29) % 176),
+  };
+  const int cell = std::max(1, size / 8);
+  for (int y = 0; y < size; ++y)
+  {
+    for (int x = 0; x < size; ++x)
+    {
+      unsigned char* p = &pixels[(static_cast<size_t>(y) * size + x) * 4];
+      const bool dark = ((x / cell) + (y / cell)) % 2 == 0;
+      for (int k = 0; k < 3; ++k) p[k] = dark ? hue[k] / 2 : hue[k];
+      p[3] = 255;
+    }
+  }
+
+  std::vector<unsigned char> png;
+  stbi_write_png_to_func(stbiAppend, &png, size, size, 4, pixels.data(), size * 4);
+
+  tinygltf::Image image;
+  image.name = "texture" + std::to_string(textureIndex);
+  image.mimeType = "image/png";
+  image.bufferView = addBufferView(model, png.data(), png.size(), 0);
+  model.images.push_back(image);
+
+  tinygltf::Texture texture;
+  texture.source = static_cast<int>(model.images.size() - 1);
+  texture.sampler = 0;
+  model.textures.push_back(texture);
+}
+
+int main(int argc, char** argv)
+{
+  GenOptions options;
+  if (!parseArgs(argc, argv, options))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  tinygltf::Model model;
+  model.asset.version = "2.0";
+  model.asset.generator = "modelviewer scenegen";
+  model.buffers.emplace_back();
+
+  tinygltf::Sampler sampler;
+  sampler.magFilter = TINYGLTF_TEXTURE_FILTER_LINEAR;
+  sampler.minFilter = TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR;
+  model.samplers.push_back(sampler);
+
+  for (int t = 0; t < options.textures; ++t)
+  {
+    addTexture(model, t, options.textureSize);
+  }
+
+  for (int m = 0; m < options.materials; ++m)
+  {
+    tinygltf::Material material;
+    material.name = "material" + std::to_string(m);
+    const float shade = 0.3f + 0.7f * ((m * 37) % 100) / 100.0f;
+    material.pbrMetallicRoughness.baseColorFactor = { shade, 1.0 - shade * 0.5, 0.5, 1.0 };
+    material.pbrMetallicRoughness.roughnessFactor = 0.5 + 0.5 * (m % 2);
+    if (options.textures > 0)
+    {
+      material.pbrMetallicRoughness.baseColorTexture.index = m % options.textures;
+    }
+    model.materials.push_back(material);
+  }
+
+  for (int m = 0; m < options.meshes; ++m)
+  {
+    addMesh(model, m, options.triangles, m % options.materials);
+  }
+
+  // Nodes are spread evenly over the levels. Each node hangs off a random node
+  // of the level above and is placed on a square grid in world space, so the
+  // scene stays readable whatever its depth.
+  const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(options.nodes))));
+  std::vector<int> levelStart(options.depth + 1);
+  for (int level = 0; level <= options.depth; ++level)
+  {
+    levelStart[level] = static_cast<int>(static_cast<long long>(options.nodes) * level / options.depth);
+  }
+
+  unsigned state = options.seed;
+  auto random = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  };
+
+  model.nodes.resize(options.nodes);
+  std::vector<int> parent(options.nodes, -1);
+  tinygltf::Scene scene;
+  for (int level = 0; level < options.depth; ++level)
+  {
+    for (int i = levelStart[level]; i < levelStart[level + 1]; ++i)
+    {
+      tinygltf::Node& node = model.nodes[i];
+      node.name = "node" + std::to_string(i);
+      node.mesh = i % options.meshes;
+
+      double world[3] = { static_cast<double>(i % side), static_cast<double>(i / side), 0.0 };
+      if (level == 0)
+      {
+        scene.nodes.push_back(i);
+      }
+      else
+      {
+        const int span = levelStart[level] - levelStart[level - 1];
+        parent[i] = levelStart[level - 1] + static_cast<int>(random() % span);
+        model.nodes[parent[i]].children.push_back(i);
+        world[0] -= parent[i] % side;
+        world[1] -= parent[i] / side;
+      }
+      node.translation = { world[0], world[1], world[2] };
+    }
+  }
+  model.scenes.push_back(scene);
+  model.defaultScene = 0;
+  if (options.animated > 0) addAnimation(model, options.animated);
+
+  const bool binary = options.outputPath.size() > 4 && options.outputPath.compare(options.outputPath.size() - 4, 4, ".glb") == 0;
+  tinygltf::TinyGLTF writer;
+  if (!writer.WriteGltfSceneToFile(&model, options.outputPath, binary, binary, !binary, binary))
+  {
+    std::printf("Failed to write %s\n", options.outputPath.c_str());
+    return -1;
+  }
+
+  std::printf("Wrote %s: %d nodes, depth %d, %d meshes x %d triangles, %d materials, %d textures, %d animated, %zu buffer bytes\n",
+    options.outputPath.c_str(), options.nodes, options.depth, options.meshes, options.triangles,
+    options.materials, options.textures, options.animated, model.buffers[0].data.size());
+  return 0;
+}
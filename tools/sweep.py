@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Scalability sweep: generates scenes of growing size with scenegen, runs
+modelviewer-bench and loader-bench on each and records how load time, its
+phases, peak memory and frame time scale. Writes sweep.csv and, when matplotlib is installed, sweep.png.
+
+Example:
+    tools/sweep.py --bin build/linux/x86_64/release --out sweep
+"""
+
+import argparse
+import csv
+import json
+import os
+import subprocess
+import sys
+
+# (name, scenegen arguments). Each series varies one knob.
+SERIES = {
+    "nodes-unique": [["--nodes", str(n), "--triangles", "500"] for n in (100, 1000, 5000, 20000, 50000)],
+    "nodes-instanced": [["--nodes", str(n), "--meshes", "16", "--triangles", "500"] for n in (100, 1000, 5000, 20000, 50000)],
+    "triangles": [["--nodes", "100", "--triangles", str(t)] for t in (100, 1000, 10000, 50000, 200000)],
+    "depth": [["--nodes", "10000", "--depth", str(d), "--meshes", "16"] for d in (1, 2, 4, 8, 16, 32)],
+    "textures": [["--nodes", "1000", "--meshes", "64", "--materials", "64", "--textures", str(t)] for t in (0, 4, 16, 64)],
+}
+
+
+def run(cmd):
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if result.returncode not in (0, 2):
+        sys.stderr.write(result.stdout + result.stderr)
+        raise SystemExit("failed: " + " ".join(cmd))
+    return result.stdout
+
+
+def arg_value(args, name, default):
+    return int(args[args.index(name) + 1]) if name in args else default
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=".", help="directory with scenegen, modelviewer-bench and loader-bench")
+    parser.add_argument("--out", default="sweep", help="output directory")
+    parser.add_argument("--frames", type=int, default=120)
+    parser.add_argument("--series", nargs="*", default=list(SERIES), choices=list(SERIES))
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    scenegen = os.path.join(args.bin, "scenegen")
+    bench = os.path.join(args.bin, "modelviewer-bench")
+    loader_bench = os.path.join(args.bin, "loader-bench")
+
+    rows = []
+    for series in args.series:
+        for gen_args in SERIES[series]:
+            scene = os.path.join(args.out, "%s_%s.glb" % (series, "_".join(a.lstrip("-") for a in gen_args)))
+            run([scenegen] + gen_args + [scene])
+            report_path = scene + ".json"
+            run([bench, "--frames", str(args.frames), "--warmup", "10", "--output", report_path, scene])
+            with open(report_path) as f:
+                report = json.load(f)
+            loader_path = scene + ".loader.json"
+            run([loader_bench, "--repeat", "3", "--output", loader_path, scene])
+            with open(loader_path) as f:
+                phases = json.load(f)["models"][0]
+            row = {
+                "series": series,
+                "nodes": arg_value(gen_args, "--nodes", 1000),
+                "depth": arg_value(gen_args, "--depth", 4),
+                "meshes": arg_value(gen_args, "--meshes", arg_value(gen_args, "--nodes", 1000)),
+                "triangles_per_mesh": arg_value(gen_args, "--triangles", 1000),
+                "textures": arg_value(gen_args, "--textures", 4),
+                "file_mb": os.path.getsize(scene) / 1e6,
+                "load_ms": report["load_ms"],
+                "cold_load_ms": phases["cold"]["load"]["median_ms"],
+                "json_parse_ms": phases["isolated"]["JSON parse"]["median_ms"],
+                "image_decode_ms": phases["warm"]["image decode"]["median_ms"],
+                "peak_rss_mb": report["peak_rss_mb"],
+                "frame_p50_ms": report["frame_ms"]["p50"],
+                "frame_p95_ms": report["frame_ms"]["p95"],
+                "cpu_mean_ms": report["cpu_ms"]["mean"],
+                "draw_calls": report["draw"]["draw_calls"],
+            }
+            rows.append(row)
+            print("%-16s %s" % (series, " ".join("%s=%.4g" % (k, v) for k, v in row.items() if k != "series")))
+
+    csv_path = os.path.join(args.out, "sweep.csv")
+    with open(csv_path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+        writer.writeheader()
+        writer.writerows(rows)
+    print("wrote", csv_path)
+
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib not installed, skipping plots")
+        return
+
+    x_axis = {"nodes-unique": "nodes", "nodes-instanced": "nodes", "triangles": "triangles_per_mesh",
+              "depth": "depth", "textures": "textures"}
+    metrics = ["load_ms", "peak_rss_mb", "frame_p50_ms"]
+    fig, axes = plt.subplots(len(args.series), len(metrics), figsize=(4 * len(metrics), 3 * len(args.series)), squeeze=False)
+    for row_axes, series in zip(axes, args.series):
+        points = [r for r in rows if r["series"] == series]
+        xs = [r[x_axis[series]] for r in points]
+        for ax, metric in zip(row_axes, metrics):
+            ax.plot(xs, [r[metric] for r in points], marker="o")
+            ax.set_xlabel(x_axis[series])
+            ax.set_ylabel(metric)
+            ax.set_title(series)
+            if series.startswith("nodes") or series == "triangles":
+                ax.set_xscale("log")
+                ax.set_yscale("log")
+    fig.tight_layout()
+    plot_path = os.path.join(args.out, "sweep.png")
+    fig.savefig(plot_path)
+    print("wrote", plot_path)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,4 @@
-add_requires("glfw", "glm", "stb")
+add_requires("glfw", "glm", "stb", "zlib")
 add_requires("imgui", {configs = {glfw = true, opengl3 = true}})
 
 add_rules("plugin.compile_commands.autoupdate", {outputdir = "."})
@@ -8,6 +8,50 @@ target("modelviewer")
   set_languages("cxx20")
   add_files("src/*.cpp", "src/*.c")
   add_includedirs("include")
-  add_syslinks("dl", "OpenGL")
-  add_packages("glfw", "glm", "stb", "imgui")
+  add_syslinks("dl", "pthread", "rt", "OpenGL", "EGL")
+  add_packages("glfw", "glm", "stb", "imgui", "zlib")
   set_rundir("$(projectdir)/")
+
+target("modelviewer-bench")
+  set_kind("binary")
+  set_optimize("fastest")
+  set_languages("cxx20")
+  add_files("bench/frame_bench.cpp", "src/*.cpp|main.cpp", "src/*.c")
+  add_includedirs("include", "src")
+  add_syslinks("dl", "pthread", "rt", "OpenGL", "EGL")
+  add_packages("glfw", "glm", "stb", "zlib")
+  set_rundir("$(projectdir)/")
+
+target("scenegen")
+  set_kind("binary")
+  set_optimize("fastest")
+  set_languages("cxx20")
+  add_files("tools/scenegen.cpp", "src/loader.cpp")
+  add_includedirs("include", "src")
+  add_packages("stb")
+
+target("loader-bench")
+  set_kind("binary")
+  set_optimize("fastest")
+  set_languages("cxx20")
+  add_files("bench/loader_bench.cpp")
+  add_includedirs("include", "src")
+  add_packages("stb")
+  set_rundir("$(projectdir)/")
+
+target("job-bench")
+  set_kind("binary")
+  set_optimize("fastest")
+  set_languages("cxx20")
+  add_files("bench/job_bench.cpp", "src/parallel.cpp")
+  add_includedirs("include", "src")
+  add_syslinks("pthread")
+
+target("image-bench")
+  set_kind("binary")
+  set_optimize("fastest")
+  set_languages("cxx20")
+  add_files("bench/image_bench.cpp", "src/image_encode.cpp", "src/parallel.cpp")
+  add_includedirs("include", "src")
+  add_syslinks("pthread")
+  add_packages("stb", "zlib")